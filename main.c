@@ -1,10 +1,30 @@
+#define GL_GLEXT_PROTOTYPES
 #include <GL/glut.h> 
 #include <GL/glu.h> 
 #include <GL/gl.h>  
 #include <stdio.h>  
 #include <stdlib.h> 
+#include <stddef.h>
 #include <string.h> 
+#include <strings.h>
 #include <math.h>   
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <zlib.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
@@ -16,9 +36,15 @@ typedef struct {
     float u, v;
 } vec2f;
 
+typedef struct {
+    unsigned char* pixels;
+    int width, height, channels;
+} image_t;
+
 typedef struct {
     char name[128];
     unsigned int texture_id;
+    image_t image;
 } material_t;
 
 typedef struct {
@@ -32,6 +58,35 @@ typedef struct {
     int material_id;
 } face_t;
 
+// Trecho de faces consecutivas com o mesmo material dentro de um submesh.
+typedef struct {
+    size_t first_face, num_faces;
+    int material_id;
+} material_range_t;
+
+// Grupo ("g") ou objeto ("o") do OBJ: faixa contigua de g_faces. Os submeshes
+// cobrem todas as faces em ordem; a mesma parte reaberta vira outra faixa.
+typedef struct {
+    char name[128];
+    size_t first_face, num_faces;
+    float bmin[3], bmax[3];
+    size_t first_range, num_ranges;
+} submesh_t;
+
+#define MAX_LODS 5
+
+typedef struct {
+    face_t* faces;
+    size_t num_faces;
+    float error;
+    int* wedges;
+} lod_t;
+
+typedef struct {
+    double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+    double w;
+} quadric_t;
+
 vec3f* g_vertices = NULL;
 size_t g_num_vertices = 0;
 
@@ -44,36 +99,237 @@ size_t g_num_texcoords = 0;
 face_t* g_faces = NULL;
 size_t g_num_faces = 0;
 
+// Capacidade reservada pelos add_*; 0 quando o array veio de outro lugar com
+// o tamanho exato. Quem troca ou libera um desses arrays zera a dele.
+size_t g_vertices_cap = 0, g_normals_cap = 0, g_texcoords_cap = 0, g_faces_cap = 0;
+
 material_t* g_materials = NULL;
 size_t g_num_materials = 0;
 
+// Vazio quando o arquivo nao tem "o"/"g".
+submesh_t* g_submeshes = NULL;
+size_t g_num_submeshes = 0;
+material_range_t* g_material_ranges = NULL;
+size_t g_num_material_ranges = 0;
+
+// Carregadores binarios podem deixar os atributos apontando para o arquivo mapeado.
+int g_vertices_mapped = 0;
+int g_normals_mapped = 0;
+int g_texcoords_mapped = 0;
+int g_faces_mapped = 0;
+void* g_mesh_mapping = NULL;
+size_t g_mesh_mapping_size = 0;
+
+// Cor por vertice (indexada como g_vertices), multiplica a iluminacao; NULL se nao houver.
+vec3f* g_vertex_colors = NULL;
+
 int g_isDragging = 0; 
 int g_lastX = 0, g_lastY = 0;
 float g_rotateX = 0.0f;
 float g_rotateY = 0.0f; 
+float g_targetRotateX = 0.0f;
+float g_targetRotateY = 0.0f;
+int g_inputPending = 0;
+double g_inputTime = 0.0;
+int g_refreshRate = 60;
 
 float g_center[3] = {0.0f, 0.0f, 0.0f}; 
 float g_size = 1.0f;
 
 unsigned int g_default_texture = 0;
+unsigned char g_default_pixels[8] = {0, 255, 0, 255, 0, 0, 255, 255};
+image_t g_default_image = {g_default_pixels, 2, 1, 4};
+// Pixels das texturas ficam na memoria so para quem le do lado da CPU:
+// backend em software, path tracer, -convert e -build-ooc.
+int g_keep_images = 0;
+// Modos sem janela nao tem contexto GL: texturas nao sao enviadas.
+int g_no_gl = 0;
+
+lod_t g_lods[MAX_LODS];
+int g_num_lods = 0;
+int g_lod_levels = 0;
+float g_lod_pixel_error = 1.0f;
+
+int g_window_width = 1000;
+int g_window_height = 900;
+
+typedef struct {
+    int frames;
+    double frame_ms_sum;
+    double frame_ms_max;
+    size_t faces_drawn;
+    int latency_samples;
+    double latency_ms_sum;
+    double latency_ms_max;
+    double last_report;
+} render_stats_t;
+
+render_stats_t g_stats;
+int g_show_stats = 0;
+
+float g_target_frame_ms = 0.0f;
+float g_render_scale = 1.0f;
+float g_min_render_scale = 0.25f;
+unsigned int g_fbo = 0;
+unsigned int g_fbo_color = 0;
+unsigned int g_fbo_depth = 0;
+
+int g_accum_samples = 0;
+int g_accum_count = 0;
+float g_accum_idle_ms = 300.0f;
+float g_accum_rotate[2] = {0.0f, 0.0f};
+double g_last_change_time = 0.0;
+
+float g_frame_budget_ms = 16.0f;
+int g_drag_level = 0;
+#define MAX_DRAG_STRIDE 64
+
+double get_time_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+uint32_t pcgNext(uint64_t* state) {
+    uint64_t old = *state;
+    *state = old * 6364136223846793005ULL + 1442695040888963407ULL;
+    uint32_t xorshifted = (uint32_t)(((old >> 18u) ^ old) >> 27u);
+    uint32_t rot = (uint32_t)(old >> 59u);
+    return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+}
+
+float pcgFloat(uint64_t* state) {
+    return (pcgNext(state) >> 8) * (1.0f / 16777216.0f);
+}
+
+void radix_sort_u64(uint64_t* keys, uint64_t* tmp, size_t n) {
+    uint64_t* src = keys;
+    uint64_t* dst = tmp;
+    if (n == 0) return;
+
+    for (int shift = 0; shift < 64; shift += 8) {
+        size_t count[256] = {0};
+        for (size_t i = 0; i < n; i++) count[(src[i] >> shift) & 0xFF]++;
+        if (count[(src[0] >> shift) & 0xFF] == n) continue;
+
+        size_t sum = 0;
+        for (int b = 0; b < 256; b++) {
+            size_t c = count[b];
+            count[b] = sum;
+            sum += c;
+        }
+        for (size_t i = 0; i < n; i++) dst[count[(src[i] >> shift) & 0xFF]++] = src[i];
+
+        uint64_t* t = src;
+        src = dst;
+        dst = t;
+    }
+    if (src != keys) memcpy(keys, src, n * sizeof(uint64_t));
+}
+
+typedef void (*parallel_fn)(void* ctx, int thread_index);
+
+typedef struct {
+    pthread_t* threads;
+    int num_threads;
+    int started;
+    pthread_mutex_t lock;
+    pthread_cond_t start_cond;
+    pthread_cond_t done_cond;
+    parallel_fn fn;
+    void* ctx;
+    int generation;
+    int pending;
+} thread_pool_t;
+
+thread_pool_t g_pool = {NULL, 0, 0, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, NULL, 0, 0};
+int g_num_threads = 0;
+
+void* poolWorker(void* arg) {
+    int index = (int)(intptr_t)arg;
+    int seen = 0;
+
+    pthread_mutex_lock(&g_pool.lock);
+    for (;;) {
+        while (g_pool.generation == seen) pthread_cond_wait(&g_pool.start_cond, &g_pool.lock);
+        seen = g_pool.generation;
+        parallel_fn fn = g_pool.fn;
+        void* ctx = g_pool.ctx;
+        pthread_mutex_unlock(&g_pool.lock);
+
+        fn(ctx, index);
+
+        pthread_mutex_lock(&g_pool.lock);
+        if (--g_pool.pending == 0) pthread_cond_signal(&g_pool.done_cond);
+    }
+    return NULL;
+}
+
+int numThreads() {
+    if (g_num_threads <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        g_num_threads = cpus > 0 ? (int)cpus : 1;
+    }
+    return g_pool.started ? g_pool.num_threads : g_num_threads;
+}
+
+// Executa fn em todas as threads do pool (a thread chamadora e a de indice 0)
+// e espera todas terminarem. Nao pode ser chamado de dentro de um job.
+void runParallel(parallel_fn fn, void* ctx) {
+    if (numThreads() == 1) {
+        fn(ctx, 0);
+        return;
+    }
+
+    if (!g_pool.started) {
+        g_pool.num_threads = g_num_threads;
+        g_pool.threads = (pthread_t*)malloc(g_num_threads * sizeof(pthread_t));
+        for (int i = 1; i < g_num_threads; i++) {
+            pthread_create(&g_pool.threads[i], NULL, poolWorker, (void*)(intptr_t)i);
+        }
+        g_pool.started = 1;
+    }
+
+    pthread_mutex_lock(&g_pool.lock);
+    g_pool.fn = fn;
+    g_pool.ctx = ctx;
+    g_pool.pending = g_pool.num_threads - 1;
+    g_pool.generation++;
+    pthread_cond_broadcast(&g_pool.start_cond);
+    pthread_mutex_unlock(&g_pool.lock);
+
+    fn(ctx, 0);
+
+    pthread_mutex_lock(&g_pool.lock);
+    while (g_pool.pending > 0) pthread_cond_wait(&g_pool.done_cond, &g_pool.lock);
+    pthread_mutex_unlock(&g_pool.lock);
+}
+
+
+// Crescimento geometrico: a realocacao so acontece quando count alcanca *cap.
+static void* grow_array(void* data, size_t count, size_t* cap, size_t size) {
+    if (count < *cap) return data;
+    *cap = count < 512 ? 1024 : count * 2;
+    return realloc(data, *cap * size);
+}
 
 void add_vertex(float x, float y, float z) {
-    g_vertices = (vec3f*)realloc(g_vertices, (g_num_vertices + 1) * sizeof(vec3f));
+    g_vertices = (vec3f*)grow_array(g_vertices, g_num_vertices, &g_vertices_cap, sizeof(vec3f));
     g_vertices[g_num_vertices++] = (vec3f){x, y, z};
 }
 
 void add_normal(float nx, float ny, float nz) {
-    g_normals = (vec3f*)realloc(g_normals, (g_num_normals + 1) * sizeof(vec3f));
+    g_normals = (vec3f*)grow_array(g_normals, g_num_normals, &g_normals_cap, sizeof(vec3f));
     g_normals[g_num_normals++] = (vec3f){nx, ny, nz};
 }
 
 void add_texcoord(float u, float v) {
-    g_texcoords = (vec2f*)realloc(g_texcoords, (g_num_texcoords + 1) * sizeof(vec2f));
+    g_texcoords = (vec2f*)grow_array(g_texcoords, g_num_texcoords, &g_texcoords_cap, sizeof(vec2f));
     g_texcoords[g_num_texcoords++] = (vec2f){u, v};
 }
 
 void add_face(face_vertex_t v0, face_vertex_t v1, face_vertex_t v2, int material_id) {
-    g_faces = (face_t*)realloc(g_faces, (g_num_faces + 1) * sizeof(face_t));
+    g_faces = (face_t*)grow_array(g_faces, g_num_faces, &g_faces_cap, sizeof(face_t));
     g_faces[g_num_faces].v[0] = v0;
     g_faces[g_num_faces].v[1] = v1;
     g_faces[g_num_faces].v[2] = v2;
@@ -86,9 +342,74 @@ int add_material(const char* name) {
     strncpy(g_materials[g_num_materials].name, name, 127);
     g_materials[g_num_materials].name[127] = '\0';
     g_materials[g_num_materials].texture_id = 0;
+    memset(&g_materials[g_num_materials].image, 0, sizeof(image_t));
     return g_num_materials++;
 }
 
+// Fecha o submesh aberto e abre outro a partir da proxima face; um
+// submesh que terminou sem faces e reaproveitado.
+void begin_submesh(const char* name) {
+    if (g_num_submeshes > 0) {
+        submesh_t* last = &g_submeshes[g_num_submeshes - 1];
+        last->num_faces = g_num_faces - last->first_face;
+        if (last->num_faces == 0) g_num_submeshes--;
+    } else if (g_num_faces > 0) {
+        // Faces antes do primeiro "o"/"g" ficam num submesh proprio.
+        g_submeshes = (submesh_t*)calloc(1, sizeof(submesh_t));
+        strcpy(g_submeshes[0].name, "default");
+        g_submeshes[0].num_faces = g_num_faces;
+        g_num_submeshes = 1;
+    }
+    g_submeshes = (submesh_t*)realloc(g_submeshes, (g_num_submeshes + 1) * sizeof(submesh_t));
+    submesh_t* s = &g_submeshes[g_num_submeshes++];
+    memset(s, 0, sizeof(*s));
+    strncpy(s->name, name, sizeof(s->name) - 1);
+    s->first_face = g_num_faces;
+}
+
+// Recalcula caixas e faixas de material; chamado ao fim da carga e depois
+// de passadas que mexem nas faces.
+void updateSubmeshes() {
+    if (g_num_submeshes == 0) return;
+    submesh_t* last = &g_submeshes[g_num_submeshes - 1];
+    last->num_faces = g_num_faces - last->first_face;
+    if (last->num_faces == 0 && g_num_submeshes > 1) g_num_submeshes--;
+
+    free(g_material_ranges);
+    g_material_ranges = NULL;
+    g_num_material_ranges = 0;
+    size_t capacity = 0;
+    for (size_t i = 0; i < g_num_submeshes; i++) {
+        submesh_t* s = &g_submeshes[i];
+        s->first_range = g_num_material_ranges;
+        for (int a = 0; a < 3; a++) {
+            s->bmin[a] = 1e30f;
+            s->bmax[a] = -1e30f;
+        }
+        for (size_t f = s->first_face; f < s->first_face + s->num_faces; f++) {
+            const face_t* face = &g_faces[f];
+            if (f == s->first_face || face->material_id != g_material_ranges[g_num_material_ranges - 1].material_id) {
+                if (g_num_material_ranges == capacity) {
+                    capacity = capacity ? capacity * 2 : 64;
+                    g_material_ranges = (material_range_t*)realloc(g_material_ranges, capacity * sizeof(material_range_t));
+                }
+                g_material_ranges[g_num_material_ranges++] = (material_range_t){f, 0, face->material_id};
+            }
+            g_material_ranges[g_num_material_ranges - 1].num_faces++;
+            for (int k = 0; k < 3; k++) {
+                int v_idx = face->v[k].v_idx;
+                if (v_idx < 1 || (size_t)v_idx > g_num_vertices) continue;
+                const float* v = &g_vertices[v_idx - 1].x;
+                for (int a = 0; a < 3; a++) {
+                    if (v[a] < s->bmin[a]) s->bmin[a] = v[a];
+                    if (v[a] > s->bmax[a]) s->bmax[a] = v[a];
+                }
+            }
+        }
+        s->num_ranges = g_num_material_ranges - s->first_range;
+    }
+}
+
 int find_material(const char* name) {
     for (size_t i = 0; i < g_num_materials; i++) {
         if (strcmp(g_materials[i].name, name) == 0) {
@@ -98,8 +419,23 @@ int find_material(const char* name) {
     return -1;
 }
 
+vec3f face_normal(const vec3f* p0, const vec3f* p1, const vec3f* p2) {
+    vec3f e1 = {p1->x - p0->x, p1->y - p0->y, p1->z - p0->z};
+    vec3f e2 = {p2->x - p0->x, p2->y - p0->y, p2->z - p0->z};
+    return (vec3f){e1.y * e2.z - e1.z * e2.y, e1.z * e2.x - e1.x * e2.z, e1.x * e2.y - e1.y * e2.x};
+}
+
+void mat4_mul(float* out, const float* a, const float* b) {
+    float r[16];
+    for (int c = 0; c < 4; c++)
+        for (int row = 0; row < 4; row++)
+            r[c * 4 + row] = a[row] * b[c * 4] + a[4 + row] * b[c * 4 + 1] + a[8 + row] * b[c * 4 + 2] + a[12 + row] * b[c * 4 + 3];
+    memcpy(out, r, sizeof(r));
+}
+
 unsigned int createDefaultTexture() {
-    unsigned int textureID;
+    if (g_no_gl) return 0;
+    unsigned int textureID = 0;
     glGenTextures(1, &textureID);
     glBindTexture(GL_TEXTURE_2D, textureID);
     
@@ -108,15 +444,20 @@ unsigned int createDefaultTexture() {
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     
-    unsigned char gradient[8] = {0, 255, 0, 255, 0, 0, 255, 255};
-    
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 2, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, gradient);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 2, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, g_default_pixels);
     
     return textureID;
 }
 
-unsigned int loadTexture(const char* filename) {
-    unsigned int textureID;
+// Envia os pixels decodificados pelo stb_image e fica com eles em image se
+// g_keep_images. Sem contexto GL (g_no_gl) so os pixels importam e o ID e 0.
+unsigned int createTexture(unsigned char* data, int width, int height, int nrChannels, image_t* image) {
+    unsigned int textureID = 0;
+    if (g_no_gl) {
+        if (g_keep_images && image) *image = (image_t){data, width, height, nrChannels};
+        else stbi_image_free(data);
+        return 0;
+    }
     glGenTextures(1, &textureID);
     glBindTexture(GL_TEXTURE_2D, textureID);
 
@@ -125,15 +466,24 @@ unsigned int loadTexture(const char* filename) {
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
+    GLenum format = (nrChannels == 4) ? GL_RGBA : GL_RGB;
+    glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
+    if (g_keep_images && image) {
+        *image = (image_t){data, width, height, nrChannels};
+    } else {
+        stbi_image_free(data);
+    }
+    return textureID;
+}
+
+unsigned int loadTexture(const char* filename, image_t* image) {
     int width, height, nrChannels;
     stbi_set_flip_vertically_on_load(1);
     unsigned char *data = stbi_load(filename, &width, &height, &nrChannels, 0);
     
     if (data) {
-        GLenum format = (nrChannels == 4) ? GL_RGBA : GL_RGB;
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
+        unsigned int textureID = createTexture(data, width, height, nrChannels, image);
         printf("Carregando textura: %s (ID: %d)\n", filename, textureID);
-        stbi_image_free(data);
         return textureID;
     }
     
@@ -169,200 +519,7118 @@ void loadMTL(const char* filename, const char* base_dir) {
             snprintf(tex_path, sizeof(tex_path), "%s/%s", base_dir, tex_name);
             
             printf("Carregando textura '%s': %s\n", g_materials[current_material].name, tex_path);
-            g_materials[current_material].texture_id = loadTexture(tex_path);
+            g_materials[current_material].texture_id = loadTexture(tex_path, &g_materials[current_material].image);
         }
     }
     fclose(file);
 }
 
-void loadOBJ(const char* filename) {
-    char base_dir[1024] = ".";
-    char* path_copy = strdup(filename);
-    char* last_slash = strrchr(path_copy, '/');
-    if (!last_slash) last_slash = strrchr(path_copy, '\\');
-    
-    if (last_slash) {
-        *last_slash = '\0';
-        strncpy(base_dir, path_copy, sizeof(base_dir) - 1);
+#define MAX_POLY_VERTICES 64
+
+// Le um vertice de face em qualquer forma (v, v/vt, v//vn, v/vt/vn).
+// Indices negativos sao relativos ao fim das listas lidas ate aqui; 0 indica ausente.
+// counts: quantos v, vt e vn existiam ate a linha, para os indices relativos.
+int parse_face_vertex_counts(char** cursor, face_vertex_t* out, const size_t* counts) {
+    char* s = *cursor;
+    while (*s == ' ' || *s == '\t') s++;
+    char* end;
+    long idx[3] = {0, 0, 0};
+
+    idx[0] = strtol(s, &end, 10);
+    if (end == s) return 0;
+    s = end;
+    for (int k = 1; k < 3 && *s == '/'; k++) {
+        s++;
+        idx[k] = strtol(s, &end, 10);
+        s = end;
     }
-    free(path_copy);
+    *cursor = s;
 
-    FILE* file = fopen(filename, "r");
-    char line[1024];
-    float min_v[3] = {1e9, 1e9, 1e9};
-    float max_v[3] = {-1e9, -1e9, -1e9};
-    int current_material_id = -1;
+    for (int k = 0; k < 3; k++) {
+        if (idx[k] < 0) idx[k] += (long)counts[k] + 1;
+        if (idx[k] < 0 || idx[k] > (long)counts[k]) idx[k] = 0;
+    }
+    if (idx[0] == 0) return 0;
+    *out = (face_vertex_t){(int)idx[0], (int)idx[2], (int)idx[1]};
+    return 1;
+}
 
-    while (fgets(line, sizeof(line), file)) {
-        if (strncmp(line, "v ", 2) == 0) {
-            float x, y, z;
-            sscanf(line, "v %f %f %f", &x, &y, &z);
-            add_vertex(x, y, z);
-            
-            if (x < min_v[0]) min_v[0] = x;
-            if (x > max_v[0]) max_v[0] = x;
-            if (y < min_v[1]) min_v[1] = y;
-            if (y > max_v[1]) max_v[1] = y;
-            if (z < min_v[2]) min_v[2] = z;
-            if (z > max_v[2]) max_v[2] = z;
-        }
-        else if (strncmp(line, "vn ", 3) == 0) {
-            float nx, ny, nz;
-            sscanf(line, "vn %f %f %f", &nx, &ny, &nz);
-            add_normal(nx, ny, nz);
-        }
-        else if (strncmp(line, "vt ", 3) == 0) {
-            float u, v;
-            sscanf(line, "vt %f %f", &u, &v);
-            add_texcoord(u, v);
-        }
-        else if (strncmp(line, "mtllib ", 7) == 0) {
-            char mtl_filename[1024];
-            sscanf(line, "mtllib %1023s", mtl_filename);
-            loadMTL(mtl_filename, base_dir);
-        }
-        else if (strncmp(line, "usemtl ", 7) == 0) {
-            char mtl_name[128];
-            sscanf(line, "usemtl %127s", mtl_name);
-            current_material_id = find_material(mtl_name);
-        }
-        else if (strncmp(line, "f ", 2) == 0) {
-            int v1, vt1, vn1, v2, vt2, vn2, v3, vt3, vn3;
-            sscanf(line, "f %d/%d/%d %d/%d/%d %d/%d/%d", 
-                   &v1, &vt1, &vn1, &v2, &vt2, &vn2, &v3, &vt3, &vn3);
-            
-            face_vertex_t fv0 = {v1, vn1, vt1};
-            face_vertex_t fv1 = {v2, vn2, vt2};
-            face_vertex_t fv2 = {v3, vn3, vt3};
-            
-            add_face(fv0, fv1, fv2, current_material_id);
+int parse_face_vertex(char** cursor, face_vertex_t* out) {
+    size_t counts[3] = {g_num_vertices, g_num_texcoords, g_num_normals};
+    return parse_face_vertex_counts(cursor, out, counts);
+}
+
+// Poligonos convexos viram leque; concavos passam por ear clipping no plano
+// de projecao dominante da normal de Newell. Tudo em buffers da pilha; as
+// faces vao para g_faces, que cresce geometricamente.
+void triangulatePolygon(const face_vertex_t* poly, int n, int material_id) {
+    if (n < 3) return;
+    if (n == 3) {
+        add_face(poly[0], poly[1], poly[2], material_id);
+        return;
+    }
+
+    float normal[3] = {0.0f, 0.0f, 0.0f};
+    for (int i = 0; i < n; i++) {
+        const vec3f* a = &g_vertices[poly[i].v_idx - 1];
+        const vec3f* b = &g_vertices[poly[(i + 1) % n].v_idx - 1];
+        normal[0] += (a->y - b->y) * (a->z + b->z);
+        normal[1] += (a->z - b->z) * (a->x + b->x);
+        normal[2] += (a->x - b->x) * (a->y + b->y);
+    }
+    int axis = 2;
+    if (fabsf(normal[0]) > fabsf(normal[1]) && fabsf(normal[0]) > fabsf(normal[2])) axis = 0;
+    else if (fabsf(normal[1]) > fabsf(normal[2])) axis = 1;
+    int ax = (axis + 1) % 3, ay = (axis + 2) % 3;
+    float sign = normal[axis] >= 0.0f ? 1.0f : -1.0f;
+
+    float px[MAX_POLY_VERTICES], py[MAX_POLY_VERTICES];
+    for (int i = 0; i < n; i++) {
+        const float* p = &g_vertices[poly[i].v_idx - 1].x;
+        px[i] = p[ax];
+        py[i] = p[ay] * sign;
+    }
+
+    int convex = 1;
+    for (int i = 0; i < n && convex; i++) {
+        int a = (i + n - 1) % n, c = (i + 1) % n;
+        float cross = (px[i] - px[a]) * (py[c] - py[i]) - (py[i] - py[a]) * (px[c] - px[i]);
+        if (cross < 0.0f) convex = 0;
+    }
+    if (convex) {
+        for (int i = 1; i + 1 < n; i++) add_face(poly[0], poly[i], poly[i + 1], material_id);
+        return;
+    }
+
+    int remaining[MAX_POLY_VERTICES];
+    int count = n;
+    for (int i = 0; i < n; i++) remaining[i] = i;
+    int guard = 0;
+    int i = 0;
+    while (count > 3 && guard < count) {
+        int a = remaining[(i + count - 1) % count], b = remaining[i % count], c = remaining[(i + 1) % count];
+        float cross = (px[b] - px[a]) * (py[c] - py[b]) - (py[b] - py[a]) * (px[c] - px[b]);
+        int ear = cross > 0.0f;
+        for (int j = 0; j < count && ear; j++) {
+            int p = remaining[j];
+            if (p == a || p == b || p == c) continue;
+            float d0 = (px[b] - px[a]) * (py[p] - py[a]) - (py[b] - py[a]) * (px[p] - px[a]);
+            float d1 = (px[c] - px[b]) * (py[p] - py[b]) - (py[c] - py[b]) * (px[p] - px[b]);
+            float d2 = (px[a] - px[c]) * (py[p] - py[c]) - (py[a] - py[c]) * (px[p] - px[c]);
+            if (d0 >= 0.0f && d1 >= 0.0f && d2 >= 0.0f) ear = 0;
+        }
+        if (ear) {
+            add_face(poly[a], poly[b], poly[c], material_id);
+            int at = i % count;
+            for (int j = at; j + 1 < count; j++) remaining[j] = remaining[j + 1];
+            count--;
+            guard = 0;
+            i = at;
+        } else {
+            i++;
+            guard++;
         }
     }
-    fclose(file);
+    // Poligono degenerado ou auto-intersectante: o que sobrou vai em leque.
+    for (int j = 1; j + 1 < count; j++) add_face(poly[remaining[0]], poly[remaining[j]], poly[remaining[j + 1]], material_id);
+}
 
-    g_center[0] = (min_v[0] + max_v[0]) / 2.0f;
-    g_center[1] = (min_v[1] + max_v[1]) / 2.0f;
-    g_center[2] = (min_v[2] + max_v[2]) / 2.0f;
+// Parsers especializados por formato e aridade de face, gerados por macro.
+// Retornam o numero de vertices ou 0 se a linha nao segue exatamente o
+// formato (ou tem indice fora do intervalo); nesse caso vale o parser generico.
+typedef int (*face_parser_fn)(const char* s, face_vertex_t* poly);
 
-    float size_x = max_v[0] - min_v[0];
-    float size_y = max_v[1] - min_v[1];
-    float size_z = max_v[2] - min_v[2];
+#define FACE_DETECT_LINES 8
 
-    g_size = fmax(fmax(fabs(size_x), fabs(size_y)), fabs(size_z));
+static inline int parse_index(const char** cursor, long* out) {
+    const char* s = *cursor;
+    int negative = *s == '-';
+    s += negative;
+    if (*s < '0' || *s > '9') return 0;
+    long value = 0;
+    while (*s >= '0' && *s <= '9') value = value * 10 + (*s++ - '0');
+    *out = negative ? -value : value;
+    *cursor = s;
+    return 1;
 }
 
-void myDisplay(void) {
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    glMatrixMode(GL_MODELVIEW);
-    glLoadIdentity();
-    
-    gluLookAt(g_center[0], g_center[1], g_center[2] + g_size * 2.0, g_center[0], g_center[1], g_center[2],  0.0, 1.0, 0.0);
-    GLfloat light_pos[] = {g_center[0], g_center[1] + g_size, g_center[2] + g_size, 1.0};
-    glLightfv(GL_LIGHT0, GL_POSITION, light_pos);
-    
-    glRotatef(g_rotateX, 1.0f, 0.0f, 0.0f);
-    glRotatef(g_rotateY, 0.0f, 1.0f, 0.0f);
-    
-    for (size_t i = 0; i < g_num_faces; i++) {
-        face_t* f = &g_faces[i];
-        
-        if (f->material_id >= 0) {
-            glBindTexture(GL_TEXTURE_2D, g_materials[f->material_id].texture_id);
-        } else {
-            glBindTexture(GL_TEXTURE_2D, g_default_texture);
+static inline int resolve_index(long idx, size_t count) {
+    if (idx < 0) idx += (long)count + 1;
+    return idx > 0 && idx <= (long)count ? (int)idx : 0;
+}
+
+#define DEFINE_FACE_PARSER(name, arity, has_vt, has_vn)                                     \
+int name(const char* s, face_vertex_t* poly) {                                             \
+    for (int k = 0; k < (arity); k++) {                                                     \
+        long v = 0, vt = 0, vn = 0;                                                         \
+        while (*s == ' ' || *s == '\t') s++;                                                \
+        if (!parse_index(&s, &v)) return 0;                                                 \
+        if (has_vt || has_vn) {                                                             \
+            if (*s++ != '/') return 0;                                                      \
+            if (has_vt && !parse_index(&s, &vt)) return 0;                                  \
+        }                                                                                   \
+        if (has_vn) {                                                                       \
+            if (*s++ != '/') return 0;                                                      \
+            if (!parse_index(&s, &vn)) return 0;                                            \
+        }                                                                                   \
+        if (*s != ' ' && *s != '\t' && *s != '\r' && *s != '\n' && *s != '\0') return 0;    \
+        poly[k].v_idx = resolve_index(v, g_num_vertices);                                   \
+        poly[k].vt_idx = has_vt ? resolve_index(vt, g_num_texcoords) : 0;                   \
+        poly[k].vn_idx = has_vn ? resolve_index(vn, g_num_normals) : 0;                     \
+        if (!poly[k].v_idx || (has_vt && !poly[k].vt_idx) || (has_vn && !poly[k].vn_idx))   \
+            return 0;                                                                       \
+    }                                                                                       \
+    while (*s == ' ' || *s == '\t' || *s == '\r' || *s == '\n') s++;                        \
+    return *s == '\0' ? (arity) : 0;                                                        \
+}
+
+DEFINE_FACE_PARSER(parseFaceV3, 3, 0, 0)
+DEFINE_FACE_PARSER(parseFaceV4, 4, 0, 0)
+DEFINE_FACE_PARSER(parseFaceVT3, 3, 1, 0)
+DEFINE_FACE_PARSER(parseFaceVT4, 4, 1, 0)
+DEFINE_FACE_PARSER(parseFaceVN3, 3, 0, 1)
+DEFINE_FACE_PARSER(parseFaceVN4, 4, 0, 1)
+DEFINE_FACE_PARSER(parseFaceVTN3, 3, 1, 1)
+DEFINE_FACE_PARSER(parseFaceVTN4, 4, 1, 1)
+
+typedef struct {
+    const char* name;
+    int arity, has_vt, has_vn;
+    face_parser_fn parse;
+} face_format_t;
+
+face_format_t g_face_formats[] = {
+    {"v x3", 3, 0, 0, parseFaceV3},           {"v x4", 4, 0, 0, parseFaceV4},
+    {"v/vt x3", 3, 1, 0, parseFaceVT3},       {"v/vt x4", 4, 1, 0, parseFaceVT4},
+    {"v//vn x3", 3, 0, 1, parseFaceVN3},      {"v//vn x4", 4, 0, 1, parseFaceVN4},
+    {"v/vt/vn x3", 3, 1, 1, parseFaceVTN3},   {"v/vt/vn x4", 4, 1, 1, parseFaceVTN4},
+};
+#define NUM_FACE_FORMATS (int)(sizeof(g_face_formats) / sizeof(g_face_formats[0]))
+
+// Classifica a linha (sem o "f ") pelo primeiro vertice e pela contagem de
+// vertices; -1 se nao houver variante especializada.
+int faceFormatOf(const char* s) {
+    int count = 0, has_vt = 0, has_vn = 0;
+    while (*s) {
+        while (*s == ' ' || *s == '\t' || *s == '\r' || *s == '\n') s++;
+        if (!*s) break;
+        const char* token = s;
+        while (*s && *s != ' ' && *s != '\t' && *s != '\r' && *s != '\n') s++;
+        if (count++ == 0) {
+            const char* slash = memchr(token, '/', s - token);
+            if (slash) {
+                has_vt = slash[1] != '/';
+                has_vn = memchr(slash + 1, '/', s - slash - 1) != NULL;
+            }
         }
-        
-        glBegin(GL_TRIANGLES);
-        for (int v = 0; v < 3; v++) {
-            face_vertex_t* fv = &f->v[v];
-            
-            int vt_idx = fv->vt_idx - 1;
-            int vn_idx = fv->vn_idx - 1;
-            int v_idx = fv->v_idx - 1;
+    }
+    for (int i = 0; i < NUM_FACE_FORMATS; i++) {
+        const face_format_t* f = &g_face_formats[i];
+        if (f->arity == count && f->has_vt == has_vt && f->has_vn == has_vn) return i;
+    }
+    return -1;
+}
 
-            glTexCoord2f(g_texcoords[vt_idx].u, g_texcoords[vt_idx].v);
-            glNormal3f(g_normals[vn_idx].x, g_normals[vn_idx].y, g_normals[vn_idx].z);
-            glVertex3f(g_vertices[v_idx].x, g_vertices[v_idx].y, g_vertices[v_idx].z);
+int parseFaceGeneric(char* s, face_vertex_t* poly, int max_vertices) {
+    int n = 0;
+    face_vertex_t fv;
+    while (n < max_vertices && parse_face_vertex(&s, &fv)) poly[n++] = fv;
+    return n;
+}
+
+// Gera linhas sinteticas de cada formato e compara o parser generico com a
+// variante especializada (so a leitura dos indices, sem emitir triangulos).
+void benchmarkFaceParsers(int lines) {
+    size_t saved[3] = {g_num_vertices, g_num_texcoords, g_num_normals};
+    g_num_vertices = g_num_texcoords = g_num_normals = (size_t)lines * 4;
+    char* buffer = (char*)malloc((size_t)lines * 128);
+    char** starts = (char**)malloc((size_t)lines * sizeof(char*));
+    face_vertex_t poly[MAX_POLY_VERTICES];
+
+    for (int f = 0; f < NUM_FACE_FORMATS; f++) {
+        const face_format_t* fmt = &g_face_formats[f];
+        char* out = buffer;
+        uint64_t rng = 12345;
+        for (int i = 0; i < lines; i++) {
+            starts[i] = out;
+            for (int k = 0; k < fmt->arity; k++) {
+                rng = rng * 6364136223846793005ULL + 1442695040888963407ULL;
+                int v = 1 + (int)((rng >> 33) % ((uint64_t)lines * 4));
+                if (fmt->has_vt && fmt->has_vn) out += sprintf(out, " %d/%d/%d", v, v, v);
+                else if (fmt->has_vt) out += sprintf(out, " %d/%d", v, v);
+                else if (fmt->has_vn) out += sprintf(out, " %d//%d", v, v);
+                else out += sprintf(out, " %d", v);
+            }
+            *out++ = '\n';
+            *out++ = '\0';
         }
-        glEnd();
+
+        double times[2];
+        long checksum[2] = {0, 0};
+        for (int pass = 0; pass < 2; pass++) {
+            double start = get_time_ms();
+            for (int i = 0; i < lines; i++) {
+                int n = pass == 0 ? parseFaceGeneric(starts[i], poly, MAX_POLY_VERTICES) : fmt->parse(starts[i], poly);
+                checksum[pass] += n ? poly[n - 1].v_idx : -1;
+            }
+            times[pass] = get_time_ms() - start;
+        }
+        printf("%-12s generico %7.2f Mfaces/s, especializado %7.2f Mfaces/s (%.2fx)%s\n", fmt->name,
+               lines / times[0] / 1000.0, lines / times[1] / 1000.0, times[0] / times[1],
+               checksum[0] == checksum[1] ? "" : " [resultado diferente!]");
     }
-    glTranslatef(-g_center[0], -g_center[1] + 1, -g_center[2]);
-    glutSwapBuffers();
+
+    free(starts);
+    free(buffer);
+    g_num_vertices = saved[0];
+    g_num_texcoords = saved[1];
+    g_num_normals = saved[2];
 }
 
-void myReshape(int w, int h) {
-    glViewport(0, 0, w, h);
-    glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
+// Tokenizador de linhas: acha os '\n' em blocos de 16 (SSE2) ou 32 (AVX2)
+// bytes e classifica o prefixo de cada linha em lote antes de despachar.
+enum { LINE_SKIP, LINE_V, LINE_VT, LINE_VN, LINE_F, LINE_MTLLIB, LINE_USEMTL, LINE_GROUP };
 
-    if (h == 0) h = 1;
-    float aspect = (float)w / (float)h;
+#define LINE_BATCH 4096
 
-    gluPerspective(60.0, aspect, 0.1, g_size * 100.0); 
-    glMatrixMode(GL_MODELVIEW);
+typedef struct obj_parser obj_parser_t;
+
+// line_hook (se definido) recebe as linhas no lugar de objParseLine, com
+// hook_ctx livre para quem o instalou.
+struct obj_parser {
+    char base_dir[1024];
+    float min_v[3], max_v[3];
+    int current_material_id;
+    char object_name[128];
+    face_parser_fn face_parser;
+    int detect_format, detect_count;
+    size_t fast_faces, generic_faces;
+    void (*line_hook)(obj_parser_t* p, char* line, int kind);
+    void* hook_ctx;
+};
+
+size_t scanLinesScalar(const char* data, size_t size, size_t* pos, size_t* ends, size_t max) {
+    size_t n = 0, i = *pos;
+    for (; i < size && n < max; i++)
+        if (data[i] == '\n') ends[n++] = i;
+    *pos = i;
+    return n;
 }
 
-void myMouse(int button, int state, int x, int y) { 
-    if (button == GLUT_LEFT_BUTTON) {
-        if (state == GLUT_DOWN) {
-            g_isDragging = 1;
-            g_lastX = x;
-            g_lastY = y;
-        } else if (state == GLUT_UP) {
-            g_isDragging = 0;
+// Registra ate max posicoes de '\n' a partir de *pos e avanca *pos ate onde parou.
+size_t scanLines(const char* data, size_t size, size_t* pos, size_t* ends, size_t max) {
+    size_t n = 0;
+#if defined(__AVX2__)
+    size_t i = *pos;
+    const __m256i newline = _mm256_set1_epi8('\n');
+    for (; i + 32 <= size; i += 32) {
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(data + i)), newline));
+        if (!mask) continue;
+        if (n + (size_t)__builtin_popcount(mask) > max) break;
+        while (mask) {
+            ends[n++] = i + __builtin_ctz(mask);
+            mask &= mask - 1;
+        }
+    }
+    *pos = i;
+#elif defined(__SSE2__)
+    size_t i = *pos;
+    const __m128i newline = _mm_set1_epi8('\n');
+    for (; i + 16 <= size; i += 16) {
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(data + i)), newline));
+        if (!mask) continue;
+        if (n + (size_t)__builtin_popcount(mask) > max) break;
+        while (mask) {
+            ends[n++] = i + __builtin_ctz(mask);
+            mask &= mask - 1;
         }
     }
+    *pos = i;
+#endif
+    return n + scanLinesScalar(data, size, pos, ends + n, max - n);
 }
 
-void myMotion(int x, int y) { 
-    if (g_isDragging) {
-        int deltaX = x - g_lastX;
-        int deltaY = y - g_lastY;
+// Os bytes lidos existem sempre: a linha termina num '\n' depois deles.
+static inline int classifyLine(const char* s) {
+    switch (s[0]) {
+    case 'v':
+        if (s[1] == ' ' || s[1] == '\t') return LINE_V;
+        if ((s[1] == 't' || s[1] == 'n') && (s[2] == ' ' || s[2] == '\t')) return s[1] == 't' ? LINE_VT : LINE_VN;
+        return LINE_SKIP;
+    case 'f':
+        return s[1] == ' ' || s[1] == '\t' ? LINE_F : LINE_SKIP;
+    case 'm':
+        return strncmp(s, "mtllib ", 7) == 0 ? LINE_MTLLIB : LINE_SKIP;
+    case 'u':
+        return strncmp(s, "usemtl ", 7) == 0 ? LINE_USEMTL : LINE_SKIP;
+    case 'o':
+    case 'g':
+        return s[1] == ' ' || s[1] == '\t' || s[1] == '\r' || s[1] == '\n' ? LINE_GROUP : LINE_SKIP;
+    default:
+        return LINE_SKIP;
+    }
+}
 
-        g_rotateX += deltaY * 0.5f;
-        g_rotateY += deltaX * 0.5f;
+// Nome do submesh de uma linha "o"/"g" de len bytes: "g" dentro de um "o"
+// vira "objeto/grupo"; sem nome, "default". object_name guarda o "o" atual.
+void obj_group_name(const char* line, size_t len, char* object_name, char* out, size_t out_size) {
+    const char* name = line + 1;
+    const char* end = line + len;
+    while (name < end && (*name == ' ' || *name == '\t')) name++;
+    while (end > name && (end[-1] == '\r' || end[-1] == '\n' || end[-1] == ' ' || end[-1] == '\t')) end--;
+    int n = (int)(end - name);
+    if (n == 0) {
+        name = "default";
+        n = 7;
+    }
+    if (n > 127) n = 127;
+    if (line[0] == 'o') {
+        snprintf(object_name, 128, "%.*s", n, name);
+        snprintf(out, out_size, "%s", object_name);
+    } else if (object_name[0]) {
+        snprintf(out, out_size, "%s/%.*s", object_name, n, name);
+    } else {
+        snprintf(out, out_size, "%.*s", n, name);
+    }
+}
 
-        g_lastX = x;
-        g_lastY = y;
+void objParseLine(obj_parser_t* p, char* line, int kind) {
+    if (kind == LINE_V) {
+        float x, y, z;
+        sscanf(line, "v %f %f %f", &x, &y, &z);
+        add_vertex(x, y, z);
 
-        glutPostRedisplay();
+        if (x < p->min_v[0]) p->min_v[0] = x;
+        if (x > p->max_v[0]) p->max_v[0] = x;
+        if (y < p->min_v[1]) p->min_v[1] = y;
+        if (y > p->max_v[1]) p->max_v[1] = y;
+        if (z < p->min_v[2]) p->min_v[2] = z;
+        if (z > p->max_v[2]) p->max_v[2] = z;
+    }
+    else if (kind == LINE_VN) {
+        float nx, ny, nz;
+        sscanf(line, "vn %f %f %f", &nx, &ny, &nz);
+        add_normal(nx, ny, nz);
+    }
+    else if (kind == LINE_VT) {
+        float u, v;
+        sscanf(line, "vt %f %f", &u, &v);
+        add_texcoord(u, v);
+    }
+    else if (kind == LINE_MTLLIB) {
+        char mtl_filename[1024];
+        sscanf(line, "mtllib %1023s", mtl_filename);
+        loadMTL(mtl_filename, p->base_dir);
+    }
+    else if (kind == LINE_USEMTL) {
+        char mtl_name[128];
+        sscanf(line, "usemtl %127s", mtl_name);
+        p->current_material_id = find_material(mtl_name);
+    }
+    else if (kind == LINE_GROUP) {
+        char full[256];
+        obj_group_name(line, strlen(line), p->object_name, full, sizeof(full));
+        begin_submesh(full);
+    }
+    else if (kind == LINE_F) {
+        face_vertex_t poly[MAX_POLY_VERTICES];
+        int n = p->face_parser ? p->face_parser(line + 2, poly) : 0;
+        if (n > 0) {
+            p->fast_faces++;
+            triangulatePolygon(poly, n, p->current_material_id);
+            return;
+        }
+
+        // Caminho generico; as primeiras faces tambem elegem o formato dominante.
+        p->generic_faces++;
+        if (!p->face_parser) {
+            int format = faceFormatOf(line + 2);
+            p->detect_count = format == p->detect_format ? p->detect_count + 1 : 1;
+            p->detect_format = format;
+            if (format >= 0 && p->detect_count >= FACE_DETECT_LINES) p->face_parser = g_face_formats[format].parse;
+        }
+        char* cursor = line + 2;
+        face_vertex_t fv;
+        while (parse_face_vertex(&cursor, &fv)) {
+            if (n < MAX_POLY_VERTICES) {
+                poly[n++] = fv;
+            } else {
+                // Acima do limite do buffer: fecha o leque e continua a partir do ultimo vertice.
+                triangulatePolygon(poly, n, p->current_material_id);
+                poly[1] = poly[n - 1];
+                poly[2] = fv;
+                n = 3;
+            }
+        }
+        triangulatePolygon(poly, n, p->current_material_id);
     }
 }
 
-int main(int argc, char** argv) {
-    glutInit(&argc, argv);
-    
-    if (argc < 2) {
-        printf("Uso: %s <arquivo.obj>\n", argv[0]);
-        return 1;
+// Processa as linhas completas de data (cada '\n' vira '\0') e retorna
+// quantos bytes foram consumidos; o resto e uma linha sem terminador.
+size_t objParseBuffer(obj_parser_t* p, char* data, size_t size) {
+    size_t ends[LINE_BATCH];
+    unsigned char kinds[LINE_BATCH];
+    size_t pos = 0, line_start = 0;
+
+    for (;;) {
+        size_t n = scanLines(data, size, &pos, ends, LINE_BATCH);
+        if (n == 0) break;
+        size_t start = line_start;
+        for (size_t i = 0; i < n; i++) {
+            kinds[i] = (unsigned char)classifyLine(data + start);
+            start = ends[i] + 1;
+        }
+        for (size_t i = 0; i < n; i++) {
+            data[ends[i]] = '\0';
+            if (kinds[i] != LINE_SKIP) (p->line_hook ? p->line_hook : objParseLine)(p, data + line_start, kinds[i]);
+            line_start = ends[i] + 1;
+        }
     }
+    return line_start;
+}
 
-    glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
-    glutInitWindowSize(1000, 900);
-    glutInitWindowPosition(100, 100);
-    glutCreateWindow("Trabalho Computacao grafica"); 
+// MTL e texturas resolvem contra g_base_dir (-base) ou, sem ele, o diretorio do arquivo.
+const char* g_base_dir = NULL;
 
-    loadOBJ(argv[1]);
-    
-    g_default_texture = createDefaultTexture();
-    for (size_t i = 0; i < g_num_materials; i++) {
-        if (g_materials[i].texture_id == 0) {
-            g_materials[i].texture_id = g_default_texture;
-        } 
+void objParserInit(obj_parser_t* p, const char* filename) {
+    memset(p, 0, sizeof(*p));
+    strcpy(p->base_dir, ".");
+    if (g_base_dir) {
+        strncpy(p->base_dir, g_base_dir, sizeof(p->base_dir) - 1);
+    } else {
+        char* path_copy = strdup(filename);
+        char* last_slash = strrchr(path_copy, '/');
+        if (!last_slash) last_slash = strrchr(path_copy, '\\');
+
+        if (last_slash) {
+            *last_slash = '\0';
+            strncpy(p->base_dir, path_copy, sizeof(p->base_dir) - 1);
+        }
+        free(path_copy);
     }
 
-    glEnable(GL_DEPTH_TEST); 
-    glEnable(GL_LIGHTING);   
-    glEnable(GL_LIGHT0);    
-    glShadeModel(GL_SMOOTH);
-    glEnable(GL_TEXTURE_2D);
+    for (int a = 0; a < 3; a++) {
+        p->min_v[a] = 1e9f;
+        p->max_v[a] = -1e9f;
+    }
+    p->current_material_id = -1;
+    p->detect_format = -1;
+}
 
-    GLfloat light_ambient[] = {1.0, 1.0, 1.0, 1.0};
-    GLfloat light_diffuse[] = {1.0, 1.0, 1.0, 1.0};
-    GLfloat light_specular[] = {1.0, 1.0, 1.0, 1.0};
-    glLightfv(GL_LIGHT0, GL_AMBIENT, light_ambient); 
-    glLightfv(GL_LIGHT0, GL_DIFFUSE, light_diffuse);
-    glLightfv(GL_LIGHT0, GL_SPECULAR, light_specular);
+void objParserFinish(obj_parser_t* p) {
+    updateSubmeshes();
+    if (p->face_parser) {
+        printf("Faces: formato %s, %zu pelo parser especializado, %zu pelo generico\n",
+               g_face_formats[p->detect_format].name, p->fast_faces, p->generic_faces);
+    }
+
+    g_center[0] = (p->min_v[0] + p->max_v[0]) / 2.0f;
+    g_center[1] = (p->min_v[1] + p->max_v[1]) / 2.0f;
+    g_center[2] = (p->min_v[2] + p->max_v[2]) / 2.0f;
+
+    float size_x = p->max_v[0] - p->min_v[0];
+    float size_y = p->max_v[1] - p->min_v[1];
+    float size_z = p->max_v[2] - p->min_v[2];
+
+    g_size = fmax(fmax(fabs(size_x), fabs(size_y)), fabs(size_z));
+}
+
+// Mapeia o arquivo com copia-na-escrita: o tokenizador termina as linhas no
+// proprio buffer sem copiar o arquivo.
+char* mapFile(const char* filename, size_t* size) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) return NULL;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        *size = 0;
+        return NULL;
+    }
+    void* data = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return NULL;
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+    *size = st.st_size;
+    return (char*)data;
+}
+
+// Entrada comprimida (.gz/.zst, detectada pelos bytes magicos) ou sem
+// posicionamento (stdin, pipes): uma thread le em blocos de g_stream_chunk
+// para um anel de STREAM_SLOTS buffers enquanto o tokenizador consome o
+// anterior, entao a memoria de entrada fica limitada a STREAM_SLOTS blocos.
+#define STREAM_SLOTS 2
+
+size_t g_stream_chunk = 4 << 20;
+
+enum { COMPRESSION_NONE, COMPRESSION_GZIP, COMPRESSION_ZSTD };
+
+typedef struct obj_stream obj_stream_t;
+
+struct obj_stream {
+    int (*read)(obj_stream_t* s, char* out, size_t size);
+    gzFile gz;
+#ifdef HAVE_ZSTD
+    FILE* file;
+    ZSTD_DStream* zstd;
+    ZSTD_inBuffer zin;
+    char* zin_data;
+#endif
+    char* slots[STREAM_SLOTS];
+    size_t sizes[STREAM_SLOTS];
+    int filled[STREAM_SLOTS];
+    size_t produced, consumed;
+    int eof, error;
+    double producer_ms;
+    size_t total_bytes;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+};
+
+int detectCompression(const char* filename) {
+    unsigned char magic[4] = {0, 0, 0, 0};
+    FILE* file = fopen(filename, "rb");
+    if (!file) return COMPRESSION_NONE;
+    size_t n = fread(magic, 1, 4, file);
+    fclose(file);
+    if (n >= 2 && magic[0] == 0x1f && magic[1] == 0x8b) return COMPRESSION_GZIP;
+    if (n == 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd) return COMPRESSION_ZSTD;
+    return COMPRESSION_NONE;
+}
+
+int streamReadGzip(obj_stream_t* s, char* out, size_t size) {
+    return gzread(s->gz, out, (unsigned)size);
+}
+
+#ifdef HAVE_ZSTD
+int streamReadZstd(obj_stream_t* s, char* out, size_t size) {
+    ZSTD_outBuffer zout = {out, size, 0};
+    while (zout.pos == 0) {
+        if (s->zin.pos == s->zin.size) {
+            size_t n = fread(s->zin_data, 1, ZSTD_DStreamInSize(), s->file);
+            if (n == 0) return 0;
+            s->zin = (ZSTD_inBuffer){s->zin_data, n, 0};
+        }
+        size_t ret = ZSTD_decompressStream(s->zstd, &zout, &s->zin);
+        if (ZSTD_isError(ret)) {
+            printf("Erro zstd: %s\n", ZSTD_getErrorName(ret));
+            return -1;
+        }
+    }
+    return (int)zout.pos;
+}
+#endif
+
+void streamAllocSlots(obj_stream_t* s) {
+    for (int i = 0; i < STREAM_SLOTS; i++) s->slots[i] = (char*)malloc(g_stream_chunk);
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->cond, NULL);
+}
+
+int streamOpen(obj_stream_t* s, const char* filename, int compression) {
+    memset(s, 0, sizeof(*s));
+    if (compression == COMPRESSION_GZIP) {
+        s->gz = gzopen(filename, "rb");
+        if (!s->gz) return 0;
+        gzbuffer(s->gz, 1 << 20);
+        s->read = streamReadGzip;
+    } else if (compression == COMPRESSION_ZSTD) {
+#ifdef HAVE_ZSTD
+        s->file = fopen(filename, "rb");
+        if (!s->file) return 0;
+        s->zstd = ZSTD_createDStream();
+        ZSTD_initDStream(s->zstd);
+        s->zin_data = (char*)malloc(ZSTD_DStreamInSize());
+        s->read = streamReadZstd;
+#else
+        printf("%s: suporte a zstd nao compilado (make ZSTD=1)\n", filename);
+        return 0;
+#endif
+    } else {
+        return 0;
+    }
+    streamAllocSlots(s);
+    return 1;
+}
+
+// Qualquer descritor; gzdopen deixa passar texto puro e tambem aceita gzip no pipe.
+int streamOpenFd(obj_stream_t* s, int fd) {
+    memset(s, 0, sizeof(*s));
+    s->gz = gzdopen(fd, "rb");
+    if (!s->gz) return 0;
+    gzbuffer(s->gz, 1 << 20);
+    s->read = streamReadGzip;
+    streamAllocSlots(s);
+    return 1;
+}
+
+void streamClose(obj_stream_t* s) {
+    if (s->gz) gzclose(s->gz);
+#ifdef HAVE_ZSTD
+    if (s->zstd) ZSTD_freeDStream(s->zstd);
+    if (s->file) fclose(s->file);
+    free(s->zin_data);
+#endif
+    for (int i = 0; i < STREAM_SLOTS; i++) free(s->slots[i]);
+    pthread_mutex_destroy(&s->lock);
+    pthread_cond_destroy(&s->cond);
+}
+
+void* streamProducer(void* arg) {
+    obj_stream_t* s = (obj_stream_t*)arg;
+    int slot = 0;
+    for (;;) {
+        pthread_mutex_lock(&s->lock);
+        while (s->filled[slot]) pthread_cond_wait(&s->cond, &s->lock);
+        pthread_mutex_unlock(&s->lock);
+
+        double start = get_time_ms();
+        size_t n = 0;
+        int r = 1;
+        while (n < g_stream_chunk && (r = s->read(s, s->slots[slot] + n, g_stream_chunk - n)) > 0) n += r;
+        s->producer_ms += get_time_ms() - start;
+
+        pthread_mutex_lock(&s->lock);
+        s->sizes[slot] = n;
+        s->filled[slot] = 1;
+        s->produced++;
+        s->total_bytes += n;
+        if (r <= 0) {
+            s->eof = 1;
+            s->error = r < 0;
+        }
+        pthread_cond_broadcast(&s->cond);
+        pthread_mutex_unlock(&s->lock);
+        if (r <= 0) break;
+        slot = (slot + 1) % STREAM_SLOTS;
+    }
+    return NULL;
+}
+
+static void append_bytes(char** buffer, size_t* len, size_t* cap, const char* data, size_t n) {
+    if (*len + n + 2 > *cap) {
+        *cap = (*len + n + 2) * 2;
+        *buffer = (char*)realloc(*buffer, *cap);
+    }
+    memcpy(*buffer + *len, data, n);
+    *len += n;
+}
+
+// Consome os blocos em ordem; a linha partida entre dois blocos e montada em
+// carry e processada assim que o '\n' dela chega.
+void objParseStream(obj_parser_t* p, obj_stream_t* s) {
+    pthread_t producer;
+    pthread_create(&producer, NULL, streamProducer, s);
+
+    char* carry = NULL;
+    size_t carry_len = 0, carry_cap = 0;
+    int slot = 0;
+    for (;;) {
+        pthread_mutex_lock(&s->lock);
+        while (!s->filled[slot] && !(s->eof && s->consumed == s->produced)) pthread_cond_wait(&s->cond, &s->lock);
+        int available = s->filled[slot];
+        size_t size = s->sizes[slot];
+        pthread_mutex_unlock(&s->lock);
+        if (!available) break;
+
+        char* data = s->slots[slot];
+        size_t start = 0;
+        if (carry_len > 0) {
+            char* newline = (char*)memchr(data, '\n', size);
+            start = newline ? (size_t)(newline - data) + 1 : size;
+            append_bytes(&carry, &carry_len, &carry_cap, data, start);
+            if (newline) {
+                objParseBuffer(p, carry, carry_len);
+                carry_len = 0;
+            }
+        }
+        size_t used = start + objParseBuffer(p, data + start, size - start);
+        append_bytes(&carry, &carry_len, &carry_cap, data + used, size - used);
+
+        pthread_mutex_lock(&s->lock);
+        s->filled[slot] = 0;
+        s->consumed++;
+        pthread_cond_broadcast(&s->cond);
+        pthread_mutex_unlock(&s->lock);
+        slot = (slot + 1) % STREAM_SLOTS;
+    }
+    if (carry_len > 0) {
+        carry[carry_len++] = '\n';
+        objParseBuffer(p, carry, carry_len);
+    }
+    free(carry);
+    pthread_join(producer, NULL);
+    if (s->error) printf("Erro ao descomprimir: arquivo truncado ou corrompido\n");
+}
+
+// base_path so define o diretorio de MTL e texturas; "-" le da entrada padrao.
+void loadOBJFile(const char* filename, const char* base_path) {
+    obj_parser_t parser;
+    objParserInit(&parser, base_path);
+
+    int from_stdin = strcmp(filename, "-") == 0;
+    struct stat st;
+    if (!from_stdin && stat(filename, &st) != 0) {
+        printf("Nao foi possivel abrir %s\n", filename);
+        return;
+    }
+
+    // Pipes e FIFOs nao permitem espiar os bytes magicos nem mapear.
+    int fd = -1;
+    int compression = COMPRESSION_NONE;
+    if (from_stdin) fd = 0;
+    else if (!S_ISREG(st.st_mode)) fd = open(filename, O_RDONLY);
+    else compression = detectCompression(filename);
+
+    if (fd >= 0 || compression != COMPRESSION_NONE) {
+        obj_stream_t stream;
+        if (!(fd >= 0 ? streamOpenFd(&stream, fd) : streamOpen(&stream, filename, compression))) {
+            printf("Nao foi possivel abrir %s\n", filename);
+            return;
+        }
+        double start = get_time_ms();
+        objParseStream(&parser, &stream);
+        printf("%s: %.1f MB em blocos de %zu KB, %.1f ms de leitura na thread, carga em %.1f ms\n", filename,
+               stream.total_bytes / 1048576.0, g_stream_chunk >> 10, stream.producer_ms, get_time_ms() - start);
+        streamClose(&stream);
+        objParserFinish(&parser);
+        return;
+    }
+
+    size_t size = 0;
+    char* data = mapFile(filename, &size);
+    if (!data && size != 0) {
+        printf("Nao foi possivel abrir %s\n", filename);
+        return;
+    }
+    if (data) {
+        size_t consumed = objParseBuffer(&parser, data, size);
+        if (consumed < size) {
+            // Ultima linha sem '\n': copia para um buffer com terminador.
+            char* tail = (char*)malloc(size - consumed + 2);
+            memcpy(tail, data + consumed, size - consumed);
+            tail[size - consumed] = '\n';
+            tail[size - consumed + 1] = '\0';
+            objParseBuffer(&parser, tail, size - consumed + 1);
+            free(tail);
+        }
+        munmap(data, size);
+    }
+    objParserFinish(&parser);
+}
+
+void loadOBJ(const char* filename) {
+    loadOBJFile(filename, filename);
+}
+
+void freeMesh() {
+    if (!g_vertices_mapped) free(g_vertices);
+    if (!g_normals_mapped) free(g_normals);
+    if (!g_texcoords_mapped) free(g_texcoords);
+    if (!g_faces_mapped) free(g_faces);
+    if (g_mesh_mapping) munmap(g_mesh_mapping, g_mesh_mapping_size);
+    g_vertices_mapped = g_normals_mapped = g_texcoords_mapped = g_faces_mapped = 0;
+    g_mesh_mapping = NULL;
+    g_mesh_mapping_size = 0;
+    free(g_vertex_colors);
+    for (size_t i = 0; i < g_num_materials; i++) {
+        if (g_materials[i].image.pixels) stbi_image_free(g_materials[i].image.pixels);
+    }
+    free(g_materials);
+    free(g_submeshes);
+    free(g_material_ranges);
+    g_submeshes = NULL;
+    g_material_ranges = NULL;
+    g_num_submeshes = g_num_material_ranges = 0;
+    g_vertices = g_normals = g_vertex_colors = NULL;
+    g_texcoords = NULL;
+    g_faces = NULL;
+    g_materials = NULL;
+    g_num_vertices = g_num_normals = g_num_texcoords = g_num_faces = g_num_materials = 0;
+    g_vertices_cap = g_normals_cap = g_texcoords_cap = g_faces_cap = 0;
+}
+
+#define STREAM_BENCH_ROUNDS 5
+
+// Descomprime para um arquivo temporario e carrega o .obj resultante; devolve
+// o tempo total (negativo se nao abriu) e, em *decompress_ms, so a descompressao.
+static double stream_bench_temp(const char* filename, int compression, double* decompress_ms) {
+    double start = get_time_ms();
+    obj_stream_t stream;
+    if (!streamOpen(&stream, filename, compression)) return -1.0;
+    char temp_path[] = "/tmp/objXXXXXX";
+    int fd = mkstemp(temp_path);
+    int n;
+    while ((n = stream.read(&stream, stream.slots[0], g_stream_chunk)) > 0) {
+        if (write(fd, stream.slots[0], n) != n) break;
+    }
+    close(fd);
+    streamClose(&stream);
+    *decompress_ms = get_time_ms() - start;
+    loadOBJFile(temp_path, filename);
+    double total_ms = get_time_ms() - start;
+    unlink(temp_path);
+    freeMesh();
+    return total_ms;
+}
+
+// Compara a carga em streaming com descomprimir para um arquivo temporario
+// e carregar o .obj resultante. Uma leitura inteira aquece o cache de paginas;
+// depois as duas variantes alternam quem vai primeiro a cada rodada e vale o
+// melhor tempo de cada uma.
+void benchmarkStream(const char* filename) {
+    int compression = detectCompression(filename);
+    if (compression == COMPRESSION_NONE) {
+        printf("%s nao esta comprimido\n", filename);
+        return;
+    }
+    FILE* file = fopen(filename, "rb");
+    if (!file) {
+        printf("Nao foi possivel abrir %s\n", filename);
+        return;
+    }
+    char warm[65536];
+    while (fread(warm, 1, sizeof(warm), file) > 0) {}
+    fclose(file);
+
+    double best_stream = INFINITY, best_temp = INFINITY, best_decompress = 0.0;
+    size_t faces = 0;
+    for (int round = 0; round < STREAM_BENCH_ROUNDS; round++) {
+        for (int k = 0; k < 2; k++) {
+            if ((round + k) % 2 == 0) {
+                double start = get_time_ms();
+                loadOBJ(filename);
+                double ms = get_time_ms() - start;
+                faces = g_num_faces;
+                freeMesh();
+                if (ms < best_stream) best_stream = ms;
+            } else {
+                double decompress_ms = 0.0;
+                double ms = stream_bench_temp(filename, compression, &decompress_ms);
+                if (ms < 0.0) return;
+                if (ms < best_temp) {
+                    best_temp = ms;
+                    best_decompress = decompress_ms;
+                }
+            }
+        }
+    }
+
+    printf("Melhor de %d rodadas, com ordem alternada e o arquivo no cache:\n", STREAM_BENCH_ROUNDS);
+    printf("Streaming: %.1f ms (%zu faces)\n", best_stream, faces);
+    printf("Descomprimir e carregar: %.1f ms (descompressao %.1f ms + carga %.1f ms)\n", best_temp, best_decompress,
+           best_temp - best_decompress);
+    if (best_temp >= best_stream) printf("Streaming %.2fx mais rapido\n", best_temp / best_stream);
+    else printf("Descomprimir antes %.2fx mais rapido\n", best_stream / best_temp);
+}
+
+// PLY binario little-endian. O arquivo fica mapeado (copia-na-escrita) e, se
+// o elemento vertex tiver so x, y, z float contiguos e alinhados, g_vertices
+// aponta direto para o mapeamento; outros layouts e as faces sao convertidos.
+#define PLY_MAX_PROPERTIES 32
+
+enum { PLY_INT8, PLY_UINT8, PLY_INT16, PLY_UINT16, PLY_INT32, PLY_UINT32, PLY_FLOAT32, PLY_FLOAT64, PLY_INVALID };
+
+typedef struct {
+    char name[32];
+    int type, count_type, is_list;
+    int offset;
+} ply_property_t;
+
+typedef struct {
+    char name[32];
+    size_t count;
+    ply_property_t props[PLY_MAX_PROPERTIES];
+    int num_props;
+    int record_size;
+    const unsigned char* data;
+} ply_element_t;
+
+int ply_type(const char* name) {
+    static const char* names[][2] = {{"char", "int8"}, {"uchar", "uint8"}, {"short", "int16"}, {"ushort", "uint16"},
+                                     {"int", "int32"}, {"uint", "uint32"}, {"float", "float32"}, {"double", "float64"}};
+    for (int t = 0; t < PLY_INVALID; t++)
+        if (strcmp(name, names[t][0]) == 0 || strcmp(name, names[t][1]) == 0) return t;
+    return PLY_INVALID;
+}
+
+static const int ply_type_size[] = {1, 1, 2, 2, 4, 4, 4, 8};
+
+static inline double ply_read(const unsigned char* p, int type) {
+    switch (type) {
+    case PLY_INT8: return *(const int8_t*)p;
+    case PLY_UINT8: return *p;
+    case PLY_INT16: { int16_t v; memcpy(&v, p, 2); return v; }
+    case PLY_UINT16: { uint16_t v; memcpy(&v, p, 2); return v; }
+    case PLY_INT32: { int32_t v; memcpy(&v, p, 4); return v; }
+    case PLY_UINT32: { uint32_t v; memcpy(&v, p, 4); return v; }
+    case PLY_FLOAT32: { float v; memcpy(&v, p, 4); return v; }
+    default: { double v; memcpy(&v, p, 8); return v; }
+    }
+}
+
+int ply_find(const ply_element_t* e, const char* a, const char* b) {
+    for (int i = 0; i < e->num_props; i++)
+        if (strcmp(e->props[i].name, a) == 0 || (b && strcmp(e->props[i].name, b) == 0)) return i;
+    return -1;
+}
+
+// Pula um registro de tamanho variavel (com listas) e devolve o proximo.
+const unsigned char* ply_skip_record(const ply_element_t* e, const unsigned char* p, const unsigned char* end) {
+    for (int i = 0; i < e->num_props && p; i++) {
+        const ply_property_t* prop = &e->props[i];
+        if (prop->is_list) {
+            if (p + ply_type_size[prop->count_type] > end) return NULL;
+            size_t count = (size_t)ply_read(p, prop->count_type);
+            p += ply_type_size[prop->count_type] + count * ply_type_size[prop->type];
+        } else {
+            p += ply_type_size[prop->type];
+        }
+        if (p > end) return NULL;
+    }
+    return p;
+}
+
+int loadPLY(const char* filename) {
+    size_t size = 0;
+    char* data = mapFile(filename, &size);
+    if (!data) {
+        printf("Nao foi possivel abrir %s\n", filename);
+        return 0;
+    }
+    const unsigned char* end = (const unsigned char*)data + size;
+
+    ply_element_t elements[8];
+    int num_elements = 0;
+    int binary_le = 0;
+    const char* line = data;
+    const unsigned char* body = NULL;
+    if (size < 4 || memcmp(data, "ply", 3) != 0) {
+        printf("%s: nao e um arquivo PLY\n", filename);
+        munmap(data, size);
+        return 0;
+    }
+    while (line < data + size) {
+        const char* eol = memchr(line, '\n', data + size - line);
+        if (!eol) break;
+        char text[256];
+        size_t len = eol - line < 255 ? (size_t)(eol - line) : 255;
+        memcpy(text, line, len);
+        text[len] = '\0';
+        line = eol + 1;
+
+        char a[32], b[32], c[32], d[32];
+        if (strncmp(text, "format ", 7) == 0) {
+            binary_le = strstr(text, "binary_little_endian") != NULL;
+        } else if (sscanf(text, "element %31s %31s", a, b) == 2 && num_elements < 8) {
+            ply_element_t* e = &elements[num_elements++];
+            memset(e, 0, sizeof(*e));
+            strcpy(e->name, a);
+            e->count = strtoull(b, NULL, 10);
+        } else if (num_elements > 0 && sscanf(text, "property list %31s %31s %31s", a, b, c) == 3) {
+            ply_element_t* e = &elements[num_elements - 1];
+            if (e->num_props == PLY_MAX_PROPERTIES) continue;
+            ply_property_t* prop = &e->props[e->num_props++];
+            strcpy(prop->name, c);
+            prop->is_list = 1;
+            prop->count_type = ply_type(a);
+            prop->type = ply_type(b);
+            if (prop->count_type == PLY_INVALID || prop->type == PLY_INVALID) binary_le = 0;
+        } else if (num_elements > 0 && sscanf(text, "property %31s %31s", a, d) == 2) {
+            ply_element_t* e = &elements[num_elements - 1];
+            if (e->num_props == PLY_MAX_PROPERTIES) continue;
+            ply_property_t* prop = &e->props[e->num_props++];
+            strcpy(prop->name, d);
+            prop->type = ply_type(a);
+            if (prop->type == PLY_INVALID) binary_le = 0;
+        } else if (strncmp(text, "end_header", 10) == 0) {
+            body = (const unsigned char*)line;
+            break;
+        }
+    }
+    if (!binary_le || !body) {
+        printf("%s: so PLY binary_little_endian e suportado\n", filename);
+        munmap(data, size);
+        return 0;
+    }
+
+    // Posicao de cada elemento no corpo; listas obrigam a percorrer os registros.
+    const unsigned char* p = body;
+    ply_element_t* vertex_e = NULL;
+    ply_element_t* face_e = NULL;
+    for (int i = 0; i < num_elements && p; i++) {
+        ply_element_t* e = &elements[i];
+        e->data = p;
+        e->record_size = 0;
+        for (int k = 0; k < e->num_props; k++) {
+            if (e->props[k].is_list) {
+                e->record_size = -1;
+                break;
+            }
+            e->props[k].offset = e->record_size;
+            e->record_size += ply_type_size[e->props[k].type];
+        }
+        if (e->record_size >= 0) {
+            p = (size_t)(end - p) / (e->record_size ? e->record_size : 1) >= e->count ? p + e->count * e->record_size : NULL;
+        } else {
+            for (size_t r = 0; r < e->count && p; r++) p = ply_skip_record(e, p, end);
+        }
+        if (strcmp(e->name, "vertex") == 0) vertex_e = e;
+        if (strcmp(e->name, "face") == 0) face_e = e;
+    }
+    int ix = vertex_e ? ply_find(vertex_e, "x", NULL) : -1;
+    int iy = vertex_e ? ply_find(vertex_e, "y", NULL) : -1;
+    int iz = vertex_e ? ply_find(vertex_e, "z", NULL) : -1;
+    if (!p || ix < 0 || iy < 0 || iz < 0 || vertex_e->record_size < 0) {
+        printf("%s: PLY truncado ou sem vertices x/y/z\n", filename);
+        munmap(data, size);
+        return 0;
+    }
+
+    double start = get_time_ms();
+    size_t nv = vertex_e->count;
+    const ply_property_t* props = vertex_e->props;
+    int stride = vertex_e->record_size;
+    int zero_copy = vertex_e->num_props == 3 && ix == 0 && iy == 1 && iz == 2 && props[0].type == PLY_FLOAT32 &&
+                    props[1].type == PLY_FLOAT32 && props[2].type == PLY_FLOAT32 &&
+                    ((uintptr_t)vertex_e->data & 3) == 0;
+    g_vertices_cap = 0;
+    if (zero_copy) {
+        g_vertices = (vec3f*)vertex_e->data;
+        g_vertices_mapped = 1;
+    } else {
+        g_vertices = (vec3f*)malloc(nv * sizeof(vec3f));
+        for (size_t i = 0; i < nv; i++) {
+            const unsigned char* r = vertex_e->data + i * stride;
+            g_vertices[i] = (vec3f){(float)ply_read(r + props[ix].offset, props[ix].type),
+                                    (float)ply_read(r + props[iy].offset, props[iy].type),
+                                    (float)ply_read(r + props[iz].offset, props[iz].type)};
+        }
+    }
+    g_num_vertices = nv;
+
+    int inx = ply_find(vertex_e, "nx", NULL), iny = ply_find(vertex_e, "ny", NULL), inz = ply_find(vertex_e, "nz", NULL);
+    if (inx >= 0 && iny >= 0 && inz >= 0) {
+        g_normals = (vec3f*)malloc(nv * sizeof(vec3f));
+        g_normals_cap = 0;
+        for (size_t i = 0; i < nv; i++) {
+            const unsigned char* r = vertex_e->data + i * stride;
+            g_normals[i] = (vec3f){(float)ply_read(r + props[inx].offset, props[inx].type),
+                                   (float)ply_read(r + props[iny].offset, props[iny].type),
+                                   (float)ply_read(r + props[inz].offset, props[inz].type)};
+        }
+        g_num_normals = nv;
+    }
+    int iu = ply_find(vertex_e, "u", "s"), iv = ply_find(vertex_e, "v", "t");
+    if (iu < 0 || iv < 0) {
+        iu = ply_find(vertex_e, "texture_u", NULL);
+        iv = ply_find(vertex_e, "texture_v", NULL);
+    }
+    if (iu >= 0 && iv >= 0) {
+        g_texcoords = (vec2f*)malloc(nv * sizeof(vec2f));
+        g_texcoords_cap = 0;
+        for (size_t i = 0; i < nv; i++) {
+            const unsigned char* r = vertex_e->data + i * stride;
+            g_texcoords[i] = (vec2f){(float)ply_read(r + props[iu].offset, props[iu].type),
+                                     (float)ply_read(r + props[iv].offset, props[iv].type)};
+        }
+        g_num_texcoords = nv;
+    }
+
+    float min_v[3] = {1e9f, 1e9f, 1e9f}, max_v[3] = {-1e9f, -1e9f, -1e9f};
+    for (size_t i = 0; i < nv; i++) {
+        const float* v = &g_vertices[i].x;
+        for (int a = 0; a < 3; a++) {
+            if (v[a] < min_v[a]) min_v[a] = v[a];
+            if (v[a] > max_v[a]) max_v[a] = v[a];
+        }
+    }
+
+    int list = face_e ? ply_find(face_e, "vertex_indices", "vertex_index") : -1;
+    if (list >= 0 && face_e->props[list].is_list) {
+        // So triangulos: escreve direto no array; poligonos passam pela triangulacao do OBJ.
+        int all_triangles = 1;
+        const unsigned char* r = face_e->data;
+        for (size_t f = 0; f < face_e->count && all_triangles; f++) {
+            const unsigned char* q = r;
+            for (int k = 0; k < face_e->num_props; k++) {
+                const ply_property_t* prop = &face_e->props[k];
+                if (prop->is_list) {
+                    size_t count = (size_t)ply_read(q, prop->count_type);
+                    if (k == list && count != 3) all_triangles = 0;
+                    q += ply_type_size[prop->count_type] + count * ply_type_size[prop->type];
+                } else {
+                    q += ply_type_size[prop->type];
+                }
+            }
+            r = q;
+        }
+        if (all_triangles) {
+            g_faces = (face_t*)malloc(face_e->count * sizeof(face_t));
+            g_faces_cap = 0;
+        }
+
+        r = face_e->data;
+        const ply_property_t* lp = &face_e->props[list];
+        face_vertex_t poly[MAX_POLY_VERTICES];
+        for (size_t f = 0; f < face_e->count; f++) {
+            const unsigned char* q = r;
+            int n = 0, valid = 1;
+            for (int k = 0; k < face_e->num_props; k++) {
+                const ply_property_t* prop = &face_e->props[k];
+                if (!prop->is_list) {
+                    q += ply_type_size[prop->type];
+                    continue;
+                }
+                size_t count = (size_t)ply_read(q, prop->count_type);
+                q += ply_type_size[prop->count_type];
+                if (k == list) {
+                    for (size_t j = 0; j < count; j++) {
+                        long idx = (long)ply_read(q + j * ply_type_size[lp->type], lp->type);
+                        if (idx < 0 || idx >= (long)nv) valid = 0;
+                        if (n < MAX_POLY_VERTICES) {
+                            int v = (int)idx + 1;
+                            poly[n++] = (face_vertex_t){v, g_num_normals ? v : 0, g_num_texcoords ? v : 0};
+                        }
+                    }
+                }
+                q += count * ply_type_size[prop->type];
+            }
+            r = q;
+            if (!valid) continue;
+            if (all_triangles) {
+                face_t* out = &g_faces[g_num_faces++];
+                out->v[0] = poly[0];
+                out->v[1] = poly[1];
+                out->v[2] = poly[2];
+                out->material_id = -1;
+            } else {
+                triangulatePolygon(poly, n, -1);
+            }
+        }
+    }
+
+    g_mesh_mapping = data;
+    g_mesh_mapping_size = size;
+    if (!zero_copy) {
+        // Nada aponta para o mapeamento: libera ja.
+        munmap(data, size);
+        g_mesh_mapping = NULL;
+        g_mesh_mapping_size = 0;
+    }
+
+    for (int a = 0; a < 3; a++) g_center[a] = (min_v[a] + max_v[a]) / 2.0f;
+    g_size = fmax(fmax(fabs(max_v[0] - min_v[0]), fabs(max_v[1] - min_v[1])), fabs(max_v[2] - min_v[2]));
+    printf("%s: %zu vertices%s, %zu faces, %.1f ms\n", filename, nv, zero_copy ? " (sem copia, direto do mmap)" : "",
+           g_num_faces, get_time_ms() - start);
+    return 1;
+}
+
+// Tolerancia de -weld (0 = so posicoes identicas) e chaves de soldagem,
+// usadas pelo STL e por weldPositions.
+float g_weld_epsilon = 0.0f;
+
+static inline uint64_t weld_hash(const uint32_t* k) {
+    uint64_t h = ((uint64_t)k[0] << 32 | k[1]) * 0x9E3779B97F4A7C15ULL;
+    h ^= (h >> 29) + k[2] * 0xBF58476D1CE4E5B9ULL;
+    h *= 0x94D049BB133111EBULL;
+    return h ^ (h >> 31);
+}
+
+// Chave de soldagem: bits do float (com -0 = 0) ou indice da celula de grade.
+static inline void weld_key(const vec3f* p, float epsilon, uint32_t* key) {
+    const float* c = &p->x;
+    for (int a = 0; a < 3; a++) {
+        if (epsilon > 0.0f) {
+            key[a] = (uint32_t)(int32_t)floorf(c[a] / epsilon);
+        } else {
+            float v = c[a] == 0.0f ? 0.0f : c[a];
+            memcpy(&key[a], &v, 4);
+        }
+    }
+}
+
+// JSON minimo para o chunk do glTF: arvore de json_value_t alocada no heap.
+enum { JSON_NULL, JSON_BOOL, JSON_NUMBER, JSON_STRING, JSON_ARRAY, JSON_OBJECT };
+
+typedef struct json_value json_value_t;
+
+struct json_value {
+    int type;
+    double number;
+    char* string;
+    char* key;
+    json_value_t* items;
+    size_t count;
+};
+
+static const char* json_skip(const char* s, const char* end) {
+    while (s < end && (*s == ' ' || *s == '\t' || *s == '\n' || *s == '\r')) s++;
+    return s;
+}
+
+static const char* json_parse_string(const char* s, const char* end, char** out) {
+    const char* start = ++s;
+    size_t len = 0;
+    while (s < end && *s != '"') {
+        if (*s == '\\') s++;
+        s++;
+        len++;
+    }
+    if (s >= end) return NULL;
+    char* str = (char*)malloc(len + 1);
+    size_t n = 0;
+    for (const char* p = start; p < s; p++) {
+        if (*p != '\\') {
+            str[n++] = *p;
+            continue;
+        }
+        p++;
+        switch (*p) {
+        case 'n': str[n++] = '\n'; break;
+        case 't': str[n++] = '\t'; break;
+        case 'r': str[n++] = '\r'; break;
+        case 'b': str[n++] = '\b'; break;
+        case 'f': str[n++] = '\f'; break;
+        case 'u': str[n++] = '?'; p += 4; break;
+        default: str[n++] = *p; break;
+        }
+    }
+    str[n] = '\0';
+    *out = str;
+    return s + 1;
+}
+
+const char* jsonParse(const char* s, const char* end, json_value_t* out) {
+    memset(out, 0, sizeof(*out));
+    s = json_skip(s, end);
+    if (s >= end) return NULL;
+    if (*s == '{' || *s == '[') {
+        int object = *s == '{';
+        char close = object ? '}' : ']';
+        out->type = object ? JSON_OBJECT : JSON_ARRAY;
+        size_t cap = 0;
+        s = json_skip(s + 1, end);
+        if (s < end && *s == close) return s + 1;
+        while (s && s < end) {
+            char* key = NULL;
+            if (object) {
+                if (*s != '"' || !(s = json_parse_string(s, end, &key))) return NULL;
+                s = json_skip(s, end);
+                if (s >= end || *s != ':') {
+                    free(key);
+                    return NULL;
+                }
+                s++;
+            }
+            if (out->count == cap) {
+                cap = cap ? cap * 2 : 4;
+                out->items = (json_value_t*)realloc(out->items, cap * sizeof(json_value_t));
+            }
+            json_value_t* item = &out->items[out->count++];
+            s = jsonParse(s, end, item);
+            item->key = key;
+            if (!s) return NULL;
+            s = json_skip(s, end);
+            if (s < end && *s == ',') s = json_skip(s + 1, end);
+            else if (s < end && *s == close) return s + 1;
+            else return NULL;
+        }
+        return NULL;
+    }
+    if (*s == '"') {
+        out->type = JSON_STRING;
+        return json_parse_string(s, end, &out->string);
+    }
+    if (end - s >= 4 && strncmp(s, "true", 4) == 0) {
+        out->type = JSON_BOOL;
+        out->number = 1.0;
+        return s + 4;
+    }
+    if (end - s >= 5 && strncmp(s, "false", 5) == 0) {
+        out->type = JSON_BOOL;
+        return s + 5;
+    }
+    if (end - s >= 4 && strncmp(s, "null", 4) == 0) return s + 4;
+    char* number_end;
+    out->type = JSON_NUMBER;
+    out->number = strtod(s, &number_end);
+    return number_end == s ? NULL : number_end;
+}
+
+void jsonFree(json_value_t* v) {
+    for (size_t i = 0; i < v->count; i++) jsonFree(&v->items[i]);
+    free(v->items);
+    free(v->string);
+    free(v->key);
+}
+
+const json_value_t* json_get(const json_value_t* v, const char* key) {
+    if (!v || v->type != JSON_OBJECT) return NULL;
+    for (size_t i = 0; i < v->count; i++)
+        if (strcmp(v->items[i].key, key) == 0) return &v->items[i];
+    return NULL;
+}
+
+const json_value_t* json_at(const json_value_t* v, long index) {
+    if (!v || v->type != JSON_ARRAY || index < 0 || (size_t)index >= v->count) return NULL;
+    return &v->items[index];
+}
+
+double json_number(const json_value_t* v, double fallback) {
+    return v && (v->type == JSON_NUMBER || v->type == JSON_BOOL) ? v->number : fallback;
+}
+
+// GLB: cabecalho de 12 bytes, chunk JSON e chunk BIN. Com uma unica
+// primitiva sem transformacao e atributos float compactos, g_vertices,
+// g_normals e g_texcoords apontam direto para o BIN mapeado; cenas com
+// varias instancias sao copiadas ja transformadas. So os indices viram face_t.
+enum { GLTF_BYTE = 5120, GLTF_UBYTE, GLTF_SHORT, GLTF_USHORT, GLTF_UINT = 5125, GLTF_FLOAT };
+
+typedef struct {
+    const unsigned char* data;
+    size_t count;
+    int component, components, stride;
+} gltf_view_t;
+
+typedef struct {
+    const json_value_t* json;
+    const unsigned char* bin;
+    size_t bin_size;
+    int material_base;
+    size_t instances;
+} gltf_loader_t;
+
+static int gltf_components(const char* type) {
+    if (strcmp(type, "SCALAR") == 0) return 1;
+    if (strcmp(type, "VEC2") == 0) return 2;
+    if (strcmp(type, "VEC3") == 0) return 3;
+    if (strcmp(type, "VEC4") == 0) return 4;
+    return 0;
+}
+
+static int gltf_component_size(int component) {
+    return component == GLTF_FLOAT || component == GLTF_UINT ? 4 : component == GLTF_SHORT || component == GLTF_USHORT ? 2 : 1;
+}
+
+int gltfBufferView(const gltf_loader_t* g, long index, const unsigned char** data, size_t* length, int* stride) {
+    const json_value_t* view = json_at(json_get(g->json, "bufferViews"), index);
+    if (!view || json_number(json_get(view, "buffer"), 0) != 0) return 0;
+    size_t offset = (size_t)json_number(json_get(view, "byteOffset"), 0);
+    *length = (size_t)json_number(json_get(view, "byteLength"), 0);
+    if (stride) *stride = (int)json_number(json_get(view, "byteStride"), 0);
+    if (offset + *length > g->bin_size) return 0;
+    *data = g->bin + offset;
+    return 1;
+}
+
+int gltfAccessor(const gltf_loader_t* g, long index, gltf_view_t* out) {
+    const json_value_t* accessor = json_at(json_get(g->json, "accessors"), index);
+    const json_value_t* type = json_get(accessor, "type");
+    if (!accessor || !type || type->type != JSON_STRING) return 0;
+    long view = (long)json_number(json_get(accessor, "bufferView"), -1);
+    const unsigned char* data;
+    size_t length;
+    int stride;
+    if (!gltfBufferView(g, view, &data, &length, &stride)) return 0;
+
+    out->component = (int)json_number(json_get(accessor, "componentType"), 0);
+    out->components = gltf_components(type->string);
+    out->count = (size_t)json_number(json_get(accessor, "count"), 0);
+    int element = gltf_component_size(out->component) * out->components;
+    out->stride = stride ? stride : element;
+    size_t offset = (size_t)json_number(json_get(accessor, "byteOffset"), 0);
+    if (out->components == 0 || (out->count > 0 && offset + (out->count - 1) * out->stride + element > length)) return 0;
+    out->data = data + offset;
+    return 1;
+}
+
+static int gltf_float_view(const gltf_view_t* v, int components) {
+    return v->component == GLTF_FLOAT && v->components == components;
+}
+
+static int gltf_zero_copy(const gltf_view_t* v, int components) {
+    return gltf_float_view(v, components) && v->stride == components * 4 && ((uintptr_t)v->data & 3) == 0;
+}
+
+static uint32_t gltf_index(const gltf_view_t* v, size_t i) {
+    const unsigned char* p = v->data + i * v->stride;
+    if (v->component == GLTF_UBYTE) return *p;
+    if (v->component == GLTF_USHORT) {
+        uint16_t x;
+        memcpy(&x, p, 2);
+        return x;
+    }
+    uint32_t x;
+    memcpy(&x, p, 4);
+    return x;
+}
+
+static void mat4_from_node(const json_value_t* node, float* m) {
+    const json_value_t* matrix = json_get(node, "matrix");
+    if (matrix && matrix->count == 16) {
+        for (int i = 0; i < 16; i++) m[i] = (float)json_number(&matrix->items[i], 0);
+        return;
+    }
+    float t[3] = {0, 0, 0}, r[4] = {0, 0, 0, 1}, s[3] = {1, 1, 1};
+    const json_value_t* tv = json_get(node, "translation");
+    const json_value_t* rv = json_get(node, "rotation");
+    const json_value_t* sv = json_get(node, "scale");
+    for (int i = 0; i < 3; i++) {
+        if (tv) t[i] = (float)json_number(json_at(tv, i), 0);
+        if (sv) s[i] = (float)json_number(json_at(sv, i), 1);
+    }
+    for (int i = 0; i < 4 && rv; i++) r[i] = (float)json_number(json_at(rv, i), i == 3);
+    float x = r[0], y = r[1], z = r[2], w = r[3];
+    float rot[9] = {1 - 2 * (y * y + z * z), 2 * (x * y + z * w), 2 * (x * z - y * w),
+                    2 * (x * y - z * w), 1 - 2 * (x * x + z * z), 2 * (y * z + x * w),
+                    2 * (x * z + y * w), 2 * (y * z - x * w), 1 - 2 * (x * x + y * y)};
+    for (int c = 0; c < 3; c++) {
+        for (int r2 = 0; r2 < 3; r2++) m[c * 4 + r2] = rot[c * 3 + r2] * s[c];
+        m[c * 4 + 3] = 0.0f;
+    }
+    m[12] = t[0]; m[13] = t[1]; m[14] = t[2]; m[15] = 1.0f;
+}
+
+void gltfAddPrimitive(gltf_loader_t* g, const json_value_t* primitive, const float* m) {
+    if (json_number(json_get(primitive, "mode"), 4) != 4) return;
+    const json_value_t* attributes = json_get(primitive, "attributes");
+    gltf_view_t pos, nrm, uv, idx;
+    if (!gltfAccessor(g, (long)json_number(json_get(attributes, "POSITION"), -1), &pos) || !gltf_float_view(&pos, 3)) return;
+    int has_normals = gltfAccessor(g, (long)json_number(json_get(attributes, "NORMAL"), -1), &nrm) &&
+                      gltf_float_view(&nrm, 3) && nrm.count == pos.count;
+    int has_uv = gltfAccessor(g, (long)json_number(json_get(attributes, "TEXCOORD_0"), -1), &uv) &&
+                 gltf_float_view(&uv, 2) && uv.count == pos.count;
+    int indexed = gltfAccessor(g, (long)json_number(json_get(primitive, "indices"), -1), &idx) && idx.components == 1 &&
+                  (idx.component == GLTF_UBYTE || idx.component == GLTF_USHORT || idx.component == GLTF_UINT);
+
+    size_t base = g_num_vertices;
+    int identity = 1;
+    for (int i = 0; i < 16; i++)
+        if (m[i] != (i % 5 == 0 ? 1.0f : 0.0f)) identity = 0;
+
+    // A primeira e unica instancia sem transformacao fica no mapeamento.
+    if (g->instances == 1 && identity && base == 0 && gltf_zero_copy(&pos, 3)) {
+        g_vertices_cap = g_normals_cap = g_texcoords_cap = 0;
+        g_vertices = (vec3f*)pos.data;
+        g_vertices_mapped = 1;
+        if (has_normals && gltf_zero_copy(&nrm, 3)) {
+            g_normals = (vec3f*)nrm.data;
+            g_normals_mapped = 1;
+        }
+        if (has_uv && gltf_zero_copy(&uv, 2)) {
+            g_texcoords = (vec2f*)uv.data;
+            g_texcoords_mapped = 1;
+        }
+    }
+    if (!g_vertices_mapped) {
+        g_vertices = (vec3f*)realloc(g_vertices, (base + pos.count) * sizeof(vec3f));
+        g_vertices_cap = 0;
+        for (size_t i = 0; i < pos.count; i++) {
+            float p[3];
+            memcpy(p, pos.data + i * pos.stride, 12);
+            g_vertices[base + i] = (vec3f){m[0] * p[0] + m[4] * p[1] + m[8] * p[2] + m[12],
+                                           m[1] * p[0] + m[5] * p[1] + m[9] * p[2] + m[13],
+                                           m[2] * p[0] + m[6] * p[1] + m[10] * p[2] + m[14]};
+        }
+    }
+    g_num_vertices = base + pos.count;
+
+    // Normais e texcoords ficam indexados como os vertices; sem o atributo, 0.
+    if (has_normals && !g_normals_mapped) {
+        g_normals = (vec3f*)realloc(g_normals, g_num_vertices * sizeof(vec3f));
+        g_normals_cap = 0;
+        for (size_t i = g_num_normals; i < base; i++) g_normals[i] = (vec3f){0.0f, 0.0f, 1.0f};
+        for (size_t i = 0; i < nrm.count; i++) {
+            float n[3];
+            memcpy(n, nrm.data + i * nrm.stride, 12);
+            float x = m[0] * n[0] + m[4] * n[1] + m[8] * n[2];
+            float y = m[1] * n[0] + m[5] * n[1] + m[9] * n[2];
+            float z = m[2] * n[0] + m[6] * n[1] + m[10] * n[2];
+            float len = sqrtf(x * x + y * y + z * z);
+            if (len > 0.0f) len = 1.0f / len;
+            g_normals[base + i] = (vec3f){x * len, y * len, z * len};
+        }
+    }
+    if (has_normals) g_num_normals = g_num_vertices;
+    if (has_uv && !g_texcoords_mapped) {
+        g_texcoords = (vec2f*)realloc(g_texcoords, g_num_vertices * sizeof(vec2f));
+        g_texcoords_cap = 0;
+        for (size_t i = g_num_texcoords; i < base; i++) g_texcoords[i] = (vec2f){0.0f, 0.0f};
+        for (size_t i = 0; i < uv.count; i++) memcpy(&g_texcoords[base + i], uv.data + i * uv.stride, 8);
+    }
+    if (has_uv) g_num_texcoords = g_num_vertices;
+
+    long material = (long)json_number(json_get(primitive, "material"), -1);
+    int material_id = material >= 0 && g->material_base + material < (long)g_num_materials ? g->material_base + (int)material : -1;
+    size_t tris = (indexed ? idx.count : pos.count) / 3;
+    g_faces = (face_t*)realloc(g_faces, (g_num_faces + tris) * sizeof(face_t));
+    g_faces_cap = 0;
+    for (size_t t = 0; t < tris; t++) {
+        face_t* f = &g_faces[g_num_faces];
+        int valid = 1;
+        for (int k = 0; k < 3; k++) {
+            uint32_t i = indexed ? gltf_index(&idx, t * 3 + k) : (uint32_t)(t * 3 + k);
+            if (i >= pos.count) valid = 0;
+            int v = (int)(base + i) + 1;
+            f->v[k] = (face_vertex_t){v, has_normals ? v : 0, has_uv ? v : 0};
+        }
+        f->material_id = material_id;
+        if (valid) g_num_faces++;
+    }
+}
+
+void gltfVisitNode(gltf_loader_t* g, long index, const float* parent, int depth, int count_only) {
+    const json_value_t* node = json_at(json_get(g->json, "nodes"), index);
+    if (!node || depth > 64) return;
+    float local[16], world[16];
+    mat4_from_node(node, local);
+    mat4_mul(world, parent, local);
+
+    const json_value_t* mesh = json_at(json_get(g->json, "meshes"), (long)json_number(json_get(node, "mesh"), -1));
+    const json_value_t* primitives = json_get(mesh, "primitives");
+    for (size_t i = 0; primitives && i < primitives->count; i++) {
+        if (count_only) g->instances++;
+        else gltfAddPrimitive(g, &primitives->items[i], world);
+    }
+    const json_value_t* children = json_get(node, "children");
+    for (size_t i = 0; children && i < children->count; i++)
+        gltfVisitNode(g, (long)json_number(&children->items[i], -1), world, depth + 1, count_only);
+}
+
+// Materiais com baseColorTexture; imagens embutidas no BIN passam pelo stb_image.
+void gltfLoadMaterials(gltf_loader_t* g) {
+    g->material_base = (int)g_num_materials;
+    const json_value_t* materials = json_get(g->json, "materials");
+    for (size_t i = 0; materials && i < materials->count; i++) {
+        const json_value_t* m = &materials->items[i];
+        const json_value_t* name = json_get(m, "name");
+        char fallback[32];
+        snprintf(fallback, sizeof(fallback), "gltf_%zu", i);
+        int id = add_material(name && name->type == JSON_STRING ? name->string : fallback);
+
+        const json_value_t* base = json_get(json_get(json_get(m, "pbrMetallicRoughness"), "baseColorTexture"), "index");
+        const json_value_t* texture = json_at(json_get(g->json, "textures"), (long)json_number(base, -1));
+        const json_value_t* image = json_at(json_get(g->json, "images"), (long)json_number(json_get(texture, "source"), -1));
+        const unsigned char* data;
+        size_t length;
+        if (!image || !gltfBufferView(g, (long)json_number(json_get(image, "bufferView"), -1), &data, &length, NULL)) continue;
+
+        // UV do glTF tem origem no topo: a imagem vai sem inverter.
+        int width, height, channels;
+        stbi_set_flip_vertically_on_load(0);
+        unsigned char* pixels = stbi_load_from_memory(data, (int)length, &width, &height, &channels, 0);
+        if (pixels) {
+            g_materials[id].texture_id = createTexture(pixels, width, height, channels, &g_materials[id].image);
+            printf("Textura embutida '%s': %dx%d\n", g_materials[id].name, width, height);
+        }
+    }
+}
+
+int loadGLB(const char* filename) {
+    size_t size = 0;
+    char* data = mapFile(filename, &size);
+    if (!data) {
+        printf("Nao foi possivel abrir %s\n", filename);
+        return 0;
+    }
+    double start = get_time_ms();
+    const unsigned char* bytes = (const unsigned char*)data;
+    uint32_t header[5];
+    if (size >= 20) memcpy(header, bytes, 20);
+    if (size < 20 || memcmp(bytes, "glTF", 4) != 0 || header[1] != 2 || header[4] != 0x4E4F534Au ||
+        20 + (size_t)header[3] > size) {
+        printf("%s: nao e um glTF binario 2.0\n", filename);
+        munmap(data, size);
+        return 0;
+    }
+
+    gltf_loader_t g;
+    memset(&g, 0, sizeof(g));
+    json_value_t json;
+    const char* json_text = data + 20;
+    if (!jsonParse(json_text, json_text + header[3], &json)) {
+        printf("%s: JSON invalido\n", filename);
+        jsonFree(&json);
+        munmap(data, size);
+        return 0;
+    }
+    g.json = &json;
+    size_t bin_chunk = 20 + ((header[3] + 3) & ~3u);
+    if (bin_chunk + 8 <= size) {
+        uint32_t chunk[2];
+        memcpy(chunk, bytes + bin_chunk, 8);
+        if (chunk[1] == 0x004E4942u && bin_chunk + 8 + chunk[0] <= size) {
+            g.bin = bytes + bin_chunk + 8;
+            g.bin_size = chunk[0];
+        }
+    }
+
+    gltfLoadMaterials(&g);
+    float identity[16] = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1};
+    const json_value_t* scene = json_at(json_get(&json, "scenes"), (long)json_number(json_get(&json, "scene"), 0));
+    const json_value_t* roots = json_get(scene, "nodes");
+    for (int pass = 1; pass >= 0; pass--) {
+        for (size_t i = 0; roots && i < roots->count; i++)
+            gltfVisitNode(&g, (long)json_number(&roots->items[i], -1), identity, 0, pass);
+    }
+    jsonFree(&json);
+
+    int mapped = g_vertices_mapped || g_normals_mapped || g_texcoords_mapped;
+    if (mapped) {
+        g_mesh_mapping = data;
+        g_mesh_mapping_size = size;
+    } else {
+        munmap(data, size);
+    }
+
+    float min_v[3] = {1e9f, 1e9f, 1e9f}, max_v[3] = {-1e9f, -1e9f, -1e9f};
+    for (size_t i = 0; i < g_num_vertices; i++) {
+        const float* v = &g_vertices[i].x;
+        for (int a = 0; a < 3; a++) {
+            if (v[a] < min_v[a]) min_v[a] = v[a];
+            if (v[a] > max_v[a]) max_v[a] = v[a];
+        }
+    }
+    for (int a = 0; a < 3; a++) g_center[a] = (min_v[a] + max_v[a]) / 2.0f;
+    g_size = fmax(fmax(fabs(max_v[0] - min_v[0]), fabs(max_v[1] - min_v[1])), fabs(max_v[2] - min_v[2]));
+    printf("%s: %zu instancias de primitiva, %zu vertices, %zu faces%s, %.1f ms\n", filename, g.instances, g_num_vertices,
+           g_num_faces, mapped ? " (atributos direto do mmap)" : "", get_time_ms() - start);
+    return 1;
+}
+
+// Cache binario (.mcache): cabecalho, os quatro arrays como estao na memoria
+// e os materiais com os pixels ja decodificados. Carrega por mmap sem copiar
+// vertices nem faces e sem decodificar imagens.
+#define MESH_CACHE_MAGIC "MSH1"
+
+typedef struct {
+    char magic[4];
+    uint32_t num_materials;
+    uint64_t num_vertices, num_normals, num_texcoords, num_faces;
+    float center[3];
+    float size;
+    uint32_t num_submeshes;
+    uint32_t reserved;
+} mesh_cache_header_t;
+
+typedef struct {
+    char name[128];
+    int32_t width, height, channels;
+    uint32_t reserved;
+} mesh_cache_material_t;
+
+typedef struct {
+    char name[128];
+    uint64_t first_face, num_faces;
+} mesh_cache_submesh_t;
+
+int saveMeshCache(const char* filename) {
+    FILE* file = fopen(filename, "wb");
+    if (!file) {
+        printf("Nao foi possivel gravar %s\n", filename);
+        return 0;
+    }
+    mesh_cache_header_t h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, MESH_CACHE_MAGIC, 4);
+    h.num_materials = (uint32_t)g_num_materials;
+    h.num_vertices = g_num_vertices;
+    h.num_normals = g_num_normals;
+    h.num_texcoords = g_num_texcoords;
+    h.num_faces = g_num_faces;
+    memcpy(h.center, g_center, sizeof(h.center));
+    h.size = g_size;
+    h.num_submeshes = (uint32_t)g_num_submeshes;
+    fwrite(&h, sizeof(h), 1, file);
+    fwrite(g_vertices, sizeof(vec3f), g_num_vertices, file);
+    fwrite(g_normals, sizeof(vec3f), g_num_normals, file);
+    fwrite(g_texcoords, sizeof(vec2f), g_num_texcoords, file);
+    fwrite(g_faces, sizeof(face_t), g_num_faces, file);
+    for (size_t i = 0; i < g_num_materials; i++) {
+        const image_t* img = &g_materials[i].image;
+        mesh_cache_material_t m;
+        memset(&m, 0, sizeof(m));
+        memcpy(m.name, g_materials[i].name, sizeof(m.name));
+        if (img->pixels) {
+            m.width = img->width;
+            m.height = img->height;
+            m.channels = img->channels;
+        }
+        fwrite(&m, sizeof(m), 1, file);
+        size_t bytes = (size_t)m.width * m.height * m.channels;
+        if (bytes) {
+            static const char pad[4] = {0};
+            fwrite(img->pixels, 1, bytes, file);
+            fwrite(pad, 1, (4 - bytes % 4) % 4, file);
+        }
+    }
+    for (size_t i = 0; i < g_num_submeshes; i++) {
+        mesh_cache_submesh_t m;
+        memset(&m, 0, sizeof(m));
+        memcpy(m.name, g_submeshes[i].name, sizeof(m.name));
+        m.first_face = g_submeshes[i].first_face;
+        m.num_faces = g_submeshes[i].num_faces;
+        fwrite(&m, sizeof(m), 1, file);
+    }
+    int ok = !ferror(file);
+    if (fclose(file) != 0) ok = 0;
+    if (!ok) printf("Erro ao gravar %s\n", filename);
+    return ok;
+}
+
+int loadMeshCache(const char* filename) {
+    size_t size = 0;
+    char* data = mapFile(filename, &size);
+    if (!data) {
+        printf("Nao foi possivel abrir %s\n", filename);
+        return 0;
+    }
+    double start = get_time_ms();
+    mesh_cache_header_t h;
+    size_t arrays = 0;
+    if (size >= sizeof(h)) {
+        memcpy(&h, data, sizeof(h));
+        arrays = sizeof(h) + (h.num_vertices + h.num_normals) * sizeof(vec3f) + h.num_texcoords * sizeof(vec2f) +
+                 h.num_faces * sizeof(face_t);
+    }
+    if (size < sizeof(h) || memcmp(h.magic, MESH_CACHE_MAGIC, 4) != 0 || arrays > size) {
+        printf("%s: cache de malha invalido\n", filename);
+        munmap(data, size);
+        return 0;
+    }
+
+    char* p = data + sizeof(h);
+    g_vertices = (vec3f*)p;
+    g_num_vertices = h.num_vertices;
+    p += h.num_vertices * sizeof(vec3f);
+    g_normals = (vec3f*)p;
+    g_num_normals = h.num_normals;
+    p += h.num_normals * sizeof(vec3f);
+    g_texcoords = (vec2f*)p;
+    g_num_texcoords = h.num_texcoords;
+    p += h.num_texcoords * sizeof(vec2f);
+    g_faces = (face_t*)p;
+    g_num_faces = h.num_faces;
+    p += h.num_faces * sizeof(face_t);
+    g_vertices_mapped = g_normals_mapped = g_texcoords_mapped = g_faces_mapped = 1;
+    g_vertices_cap = g_normals_cap = g_texcoords_cap = g_faces_cap = 0;
+    g_mesh_mapping = data;
+    g_mesh_mapping_size = size;
+
+    // Os pixels sao copiados: createTexture assume a posse do buffer.
+    for (uint32_t i = 0; i < h.num_materials && (size_t)(p - data) + sizeof(mesh_cache_material_t) <= size; i++) {
+        mesh_cache_material_t m;
+        memcpy(&m, p, sizeof(m));
+        p += sizeof(m);
+        m.name[sizeof(m.name) - 1] = '\0';
+        int id = add_material(m.name);
+        size_t bytes = (size_t)m.width * m.height * m.channels;
+        if (bytes && (size_t)(p - data) + bytes <= size) {
+            unsigned char* pixels = (unsigned char*)malloc(bytes);
+            memcpy(pixels, p, bytes);
+            g_materials[id].texture_id = createTexture(pixels, m.width, m.height, m.channels, &g_materials[id].image);
+        }
+        p += (bytes + 3) & ~(size_t)3;
+    }
+    for (uint32_t i = 0; i < h.num_submeshes && (size_t)(p - data) + sizeof(mesh_cache_submesh_t) <= size; i++) {
+        mesh_cache_submesh_t m;
+        memcpy(&m, p, sizeof(m));
+        p += sizeof(m);
+        if (m.first_face + m.num_faces > g_num_faces) break;
+        g_submeshes = (submesh_t*)realloc(g_submeshes, (g_num_submeshes + 1) * sizeof(submesh_t));
+        submesh_t* sub = &g_submeshes[g_num_submeshes++];
+        memset(sub, 0, sizeof(*sub));
+        memcpy(sub->name, m.name, sizeof(sub->name) - 1);
+        sub->first_face = m.first_face;
+        sub->num_faces = m.num_faces;
+    }
+    updateSubmeshes();
+
+    memcpy(g_center, h.center, sizeof(g_center));
+    g_size = h.size;
+    printf("%s: %zu vertices, %zu faces, %zu materiais do cache, %.1f ms\n", filename, g_num_vertices, g_num_faces,
+           g_num_materials, get_time_ms() - start);
+    return 1;
+}
+
+int has_extension(const char* path, const char* ext) {
+    size_t n = strlen(path), e = strlen(ext);
+    return n >= e && strcasecmp(path + n - e, ext) == 0;
+}
+
+int writePNG(const char* filename, const unsigned char* rgb, int width, int height) {
+    size_t row = (size_t)width * 3 + 1;
+    size_t raw_size = row * height;
+    unsigned char* raw = (unsigned char*)malloc(raw_size);
+    for (int y = 0; y < height; y++) {
+        raw[y * row] = 0;
+        memcpy(&raw[y * row + 1], &rgb[(size_t)y * width * 3], (size_t)width * 3);
+    }
+    uLongf packed_size = compressBound(raw_size);
+    unsigned char* packed = (unsigned char*)malloc(packed_size);
+    compress2(packed, &packed_size, raw, raw_size, 6);
+    free(raw);
+
+    FILE* file = fopen(filename, "wb");
+    if (!file) {
+        free(packed);
+        return 0;
+    }
+    unsigned char header[13];
+    uint32_t dims[2] = {(uint32_t)width, (uint32_t)height};
+    for (int i = 0; i < 2; i++) {
+        header[i * 4] = dims[i] >> 24;
+        header[i * 4 + 1] = dims[i] >> 16;
+        header[i * 4 + 2] = dims[i] >> 8;
+        header[i * 4 + 3] = dims[i];
+    }
+    header[8] = 8;
+    header[9] = 2;
+    header[10] = header[11] = header[12] = 0;
+
+    const char* types[3] = {"IHDR", "IDAT", "IEND"};
+    const unsigned char* data[3] = {header, packed, NULL};
+    size_t sizes[3] = {sizeof(header), packed_size, 0};
+    fwrite("\x89PNG\r\n\x1a\n", 1, 8, file);
+    for (int c = 0; c < 3; c++) {
+        unsigned char len[4] = {sizes[c] >> 24, sizes[c] >> 16, sizes[c] >> 8, sizes[c]};
+        uLong crc = crc32(0, (const Bytef*)types[c], 4);
+        if (sizes[c]) crc = crc32(crc, data[c], sizes[c]);
+        unsigned char crc_bytes[4] = {crc >> 24, crc >> 16, crc >> 8, crc};
+        fwrite(len, 1, 4, file);
+        fwrite(types[c], 1, 4, file);
+        if (sizes[c]) fwrite(data[c], 1, sizes[c], file);
+        fwrite(crc_bytes, 1, 4, file);
+    }
+    fclose(file);
+    free(packed);
+    return 1;
+}
+
+// Escrita de OBJ sem printf: floats no menor decimal que volta ao mesmo
+// float (ate 9 digitos) e inteiros convertidos a mao, num buffer grande.
+static double g_pow10[128];
+
+static inline double pow10_of(int e) {
+    return g_pow10[e + 64];
+}
+
+static void init_pow10() {
+    if (g_pow10[64] != 0.0) return;
+    for (int e = -64; e < 64; e++) g_pow10[e + 64] = pow(10.0, e);
+}
+
+static inline int format_uint(uint64_t v, char* out) {
+    char tmp[20];
+    int n = 0;
+    do {
+        tmp[n++] = (char)('0' + v % 10);
+        v /= 10;
+    } while (v);
+    for (int i = 0; i < n; i++) out[i] = tmp[n - 1 - i];
+    return n;
+}
+
+static inline int format_int(long v, char* out) {
+    if (v < 0) {
+        *out = '-';
+        return 1 + format_uint((uint64_t)-v, out + 1);
+    }
+    return format_uint((uint64_t)v, out);
+}
+
+// c * 10^p volta a f se cai entre os meios ate os floats vizinhos. lo e hi
+// chegam na escala de 9 digitos, onde o candidato c * step e exato; a conta
+// em double so decide longe das pontas e, a menos de 1e-12 (relativo) de uma
+// delas, strtof confirma.
+static int float_candidate_ok(uint64_t c, double step, int p, float f, double lo, double hi) {
+    double v = c * step;
+    double margin = v * 1e-12;
+    if (v > lo + margin && v < hi - margin) return 1;
+    if (v < lo - margin || v > hi + margin) return 0;
+    char text[48];
+    snprintf(text, sizeof(text), "%llue%d", (unsigned long long)c, p);
+    return strtof(text, NULL) == f;
+}
+
+// Escala o float para um inteiro de 9 digitos e procura (busca binaria: se d
+// digitos servem, d+1 tambem) o menor numero de digitos em que um dos dois
+// inteiros em volta do valor escalado volta ao mesmo float.
+int format_float(float f, char* out) {
+    if (f != f) return (int)(memcpy(out, "nan", 3), 3);
+    int len = 0;
+    if (signbit(f)) {
+        out[len++] = '-';
+        f = -f;
+    }
+    if (f == 0.0f) {
+        out[len++] = '0';
+        return len;
+    }
+    if (isinf(f)) return len + (int)(memcpy(out + len, "inf", 3), 3);
+
+    uint32_t bits, down, up;
+    memcpy(&bits, &f, 4);
+    int e = (((int)(bits >> 23) - 127) * 78913) >> 18;
+    double x = f;
+    while (e < 38 && x >= pow10_of(e + 1)) e++;
+    while (e > -46 && x < pow10_of(e)) e--;
+    double scale = pow10_of(8 - e);
+    double X = x * scale;
+    float below, above;
+    down = bits - 1;
+    up = bits + 1;
+    memcpy(&below, &down, 4);
+    memcpy(&above, &up, 4);
+    double lo = (x + below) * 0.5 * scale;
+    double hi = (isinf(above) ? x + (x - below) * 0.5 : (x + above) * 0.5) * scale;
+
+    uint64_t m = (uint64_t)(X + 0.5);
+    int exp10 = e - 8;
+    int min_d = 1, max_d = 9;
+    while (min_d < max_d) {
+        int d = (min_d + max_d) / 2;
+        double y = X * pow10_of(d - 9);
+        uint64_t c = (uint64_t)y;
+        uint64_t near = y - c <= 0.5 ? c : c + 1, far = near == c ? c + 1 : c;
+        int p = e + 1 - d;
+        double step = pow10_of(9 - d);
+        uint64_t found = float_candidate_ok(near, step, p, f, lo, hi) ? near
+                       : float_candidate_ok(far, step, p, f, lo, hi)  ? far
+                                                                      : 0;
+        if (found) {
+            max_d = d;
+            m = found;
+            exp10 = p;
+        } else {
+            min_d = d + 1;
+        }
+    }
+    while (m % 10 == 0) {
+        m /= 10;
+        exp10++;
+    }
+
+    char digits[20];
+    int n = format_uint(m, digits);
+    int point = n + exp10;
+    if (point > 0 && point <= 12) {
+        if (exp10 >= 0) {
+            memcpy(out + len, digits, n);
+            len += n;
+            for (int i = 0; i < exp10; i++) out[len++] = '0';
+        } else {
+            memcpy(out + len, digits, point);
+            len += point;
+            out[len++] = '.';
+            memcpy(out + len, digits + point, n - point);
+            len += n - point;
+        }
+    } else if (point <= 0 && point > -5) {
+        out[len++] = '0';
+        out[len++] = '.';
+        for (int i = 0; i < -point; i++) out[len++] = '0';
+        memcpy(out + len, digits, n);
+        len += n;
+    } else {
+        out[len++] = digits[0];
+        if (n > 1) {
+            out[len++] = '.';
+            memcpy(out + len, digits + 1, n - 1);
+            len += n - 1;
+        }
+        out[len++] = 'e';
+        len += format_int(point - 1, out + len);
+    }
+    return len;
+}
+
+#define OBJ_WRITE_BUFFER (1 << 20)
+
+typedef struct {
+    FILE* file;
+    char* buffer;
+    size_t used;
+    size_t total;
+} obj_writer_t;
+
+static inline char* writer_reserve(obj_writer_t* w, size_t n) {
+    if (w->used + n > OBJ_WRITE_BUFFER) {
+        fwrite(w->buffer, 1, w->used, w->file);
+        w->total += w->used;
+        w->used = 0;
+    }
+    return w->buffer + w->used;
+}
+
+static void write_floats(obj_writer_t* w, const char* tag, const float* v, int count) {
+    char* p = writer_reserve(w, 4 + count * 16);
+    char* start = p;
+    while (*tag) *p++ = *tag++;
+    for (int i = 0; i < count; i++) {
+        *p++ = ' ';
+        p += format_float(v[i], p);
+    }
+    *p++ = '\n';
+    w->used += p - start;
+}
+
+static int face_vertex_text(const face_vertex_t* fv, char* p) {
+    char* start = p;
+    p += format_int(fv->v_idx, p);
+    if (fv->vt_idx || fv->vn_idx) {
+        *p++ = '/';
+        if (fv->vt_idx) p += format_int(fv->vt_idx, p);
+        if (fv->vn_idx) {
+            *p++ = '/';
+            p += format_int(fv->vn_idx, p);
+        }
+    }
+    return (int)(p - start);
+}
+
+// Grava o .mtl e as texturas em PNG ao lado do .obj; as imagens voltam a
+// ficar de cabeca para baixo porque loadTexture as inverte ao carregar.
+void writeMTL(const char* mtl_path, const char* stem) {
+    FILE* file = fopen(mtl_path, "w");
+    if (!file) return;
+    const char* dir_end = strrchr(mtl_path, '/');
+    for (size_t i = 0; i < g_num_materials; i++) {
+        const image_t* img = &g_materials[i].image;
+        fprintf(file, "newmtl %s\n", g_materials[i].name);
+        if (!img->pixels || img->channels < 1) continue;
+        char png_name[512], png_path[2048];
+        snprintf(png_name, sizeof(png_name), "%s_%zu.png", stem, i);
+        snprintf(png_path, sizeof(png_path), "%.*s%s", dir_end ? (int)(dir_end - mtl_path + 1) : 0, mtl_path, png_name);
+        unsigned char* rgb = (unsigned char*)malloc((size_t)img->width * img->height * 3);
+        for (int y = 0; y < img->height; y++) {
+            const unsigned char* src = img->pixels + (size_t)(img->height - 1 - y) * img->width * img->channels;
+            unsigned char* dst = rgb + (size_t)y * img->width * 3;
+            for (int x = 0; x < img->width; x++) {
+                for (int c = 0; c < 3; c++) dst[x * 3 + c] = src[x * img->channels + (img->channels >= 3 ? c : 0)];
+            }
+        }
+        if (writePNG(png_path, rgb, img->width, img->height)) fprintf(file, "map_Kd %s\n", png_name);
+        free(rgb);
+    }
+    fclose(file);
+}
+
+int writeOBJ(const char* filename) {
+    FILE* file = fopen(filename, "wb");
+    if (!file) {
+        printf("Nao foi possivel gravar %s\n", filename);
+        return 0;
+    }
+    init_pow10();
+    double start = get_time_ms();
+    obj_writer_t w = {file, (char*)malloc(OBJ_WRITE_BUFFER), 0, 0};
+
+    if (g_num_materials > 0) {
+        const char* base = strrchr(filename, '/');
+        base = base ? base + 1 : filename;
+        char stem[512], mtl_path[2048];
+        snprintf(stem, sizeof(stem), "%s", base);
+        char* dot = strrchr(stem, '.');
+        if (dot) *dot = '\0';
+        snprintf(mtl_path, sizeof(mtl_path), "%.*s%s.mtl", (int)(base - filename), filename, stem);
+        writeMTL(mtl_path, stem);
+        w.used += snprintf(w.buffer, OBJ_WRITE_BUFFER, "mtllib %s.mtl\n", stem);
+    }
+
+    for (size_t i = 0; i < g_num_vertices; i++) write_floats(&w, "v", &g_vertices[i].x, 3);
+    for (size_t i = 0; i < g_num_texcoords; i++) write_floats(&w, "vt", &g_texcoords[i].u, 2);
+    for (size_t i = 0; i < g_num_normals; i++) write_floats(&w, "vn", &g_normals[i].x, 3);
+
+    // Cada submesh vira um "g" com o nome completo ("objeto/grupo"), que a
+    // leitura devolve igual; usemtl continua valendo atraves do "g".
+    int material = -1;
+    size_t submesh = 0;
+    for (size_t i = 0; i < g_num_faces; i++) {
+        const face_t* f = &g_faces[i];
+        for (; submesh < g_num_submeshes && g_submeshes[submesh].first_face <= i; submesh++) {
+            if (g_submeshes[submesh].num_faces == 0) continue;
+            char* p = writer_reserve(&w, 160);
+            w.used += sprintf(p, "g %s\n", g_submeshes[submesh].name);
+        }
+        if (f->material_id != material && f->material_id >= 0) {
+            char* p = writer_reserve(&w, 160);
+            w.used += sprintf(p, "usemtl %s\n", g_materials[f->material_id].name);
+        }
+        material = f->material_id;
+        char* p = writer_reserve(&w, 112);
+        char* line = p;
+        *p++ = 'f';
+        for (int k = 0; k < 3; k++) {
+            *p++ = ' ';
+            p += face_vertex_text(&f->v[k], p);
+        }
+        *p++ = '\n';
+        w.used += p - line;
+    }
+    fwrite(w.buffer, 1, w.used, file);
+    w.total += w.used;
+    free(w.buffer);
+    int ok = !ferror(file);
+    if (fclose(file) != 0) ok = 0;
+    double ms = get_time_ms() - start;
+    if (ok) {
+        printf("%s: %.1f MB em %.1f ms (%.0f MB/s)\n", filename, w.total / 1048576.0, ms,
+               w.total / 1048576.0 / (ms / 1000.0));
+    } else {
+        printf("Erro ao gravar %s\n", filename);
+    }
+    return ok;
+}
+
+// Renumera cada lista de atributos na ordem do primeiro uso pelas faces e
+// descarta o que nenhuma face referencia. Retorna quantos vertices sairam.
+static void compact_stream(void** data, size_t* count, size_t elem, int* mapped, size_t index_offset) {
+    size_t n = *count;
+    if (n == 0) return;
+    int* remap = (int*)malloc(n * sizeof(int));
+    memset(remap, 0, n * sizeof(int));
+    char* src = (char*)*data;
+    char* dst = (char*)malloc(n * elem);
+    size_t used = 0;
+    for (size_t i = 0; i < g_num_faces; i++) {
+        for (int k = 0; k < 3; k++) {
+            int* idx = (int*)((char*)&g_faces[i].v[k] + index_offset);
+            if (*idx <= 0 || (size_t)*idx > n) continue;
+            int* r = &remap[*idx - 1];
+            if (*r == 0) {
+                memcpy(dst + used * elem, src + (size_t)(*idx - 1) * elem, elem);
+                *r = (int)++used;
+            }
+            *idx = *r;
+        }
+    }
+    if (!*mapped) free(src);
+    *mapped = 0;
+    *data = dst;
+    *count = used;
+    free(remap);
+}
+
+size_t compactVertexStreams() {
+    size_t before = g_num_vertices + g_num_normals + g_num_texcoords;
+    compact_stream((void**)&g_vertices, &g_num_vertices, sizeof(vec3f), &g_vertices_mapped,
+                   offsetof(face_vertex_t, v_idx));
+    compact_stream((void**)&g_normals, &g_num_normals, sizeof(vec3f), &g_normals_mapped,
+                   offsetof(face_vertex_t, vn_idx));
+    compact_stream((void**)&g_texcoords, &g_num_texcoords, sizeof(vec2f), &g_texcoords_mapped,
+                   offsetof(face_vertex_t, vt_idx));
+    g_vertices_cap = g_normals_cap = g_texcoords_cap = 0;
+    return before - (g_num_vertices + g_num_normals + g_num_texcoords);
+}
+
+// Soldagem de posicoes por grade espacial: celulas de WELD_CELL_SCALE *
+// g_weld_epsilon numa tabela hash preenchida em paralelo (CAS), cada celula
+// com uma lista de vertices. Pares a ate g_weld_epsilon sao unidos numa
+// union-find sem trava, procurando nas celulas vizinhas so quando o vertice
+// esta a menos de epsilon da borda; com epsilon 0 solda so posicoes
+// identicas. So v_idx e remapeado, entao vt e vn (e as costuras) ficam como estao.
+#define WELD_CELL_SCALE 4.0f
+#define WELD_CHUNK 4096
+#define WELD_PREFETCH 32
+
+int g_weld_positions = 0;
+
+// Dono da celula (vertice + 1 cuja chave a define) e cabeca da lista lado a lado.
+typedef struct {
+    uint32_t owner, head;
+} weld_cell_t;
+
+typedef struct {
+    size_t num_vertices;
+    float cell, epsilon;
+    uint32_t (*keys)[3];
+    weld_cell_t* table;
+    size_t table_mask;
+    uint32_t* next;
+    uint32_t* parent;
+    int* remap;
+    size_t cursor;
+} position_welder_t;
+
+static size_t weld_find_cell(const position_welder_t* w, const uint32_t* key) {
+    size_t slot = weld_hash(key) & w->table_mask;
+    for (;;) {
+        uint32_t owner = w->table[slot].owner;
+        if (owner == 0) return (size_t)-1;
+        const uint32_t* other = w->keys[owner - 1];
+        if (other[0] == key[0] && other[1] == key[1] && other[2] == key[2]) return slot;
+        slot = (slot + 1) & w->table_mask;
+    }
+}
+
+// Os trabalhos pegam blocos de WELD_CHUNK vertices de um contador atomico.
+static int weld_next_chunk(position_welder_t* w, size_t* begin, size_t* end) {
+    *begin = __atomic_fetch_add(&w->cursor, WELD_CHUNK, __ATOMIC_RELAXED);
+    if (*begin >= w->num_vertices) return 0;
+    *end = *begin + WELD_CHUNK < w->num_vertices ? *begin + WELD_CHUNK : w->num_vertices;
+    return 1;
+}
+
+// As raizes so apontam para indices menores, entao a raiz de cada grupo e o
+// seu menor indice, qualquer que seja a ordem das unioes entre threads.
+static uint32_t weld_find(uint32_t* parent, uint32_t x) {
+    for (;;) {
+        uint32_t p = __atomic_load_n(&parent[x], __ATOMIC_RELAXED);
+        if (p == x) return x;
+        uint32_t gp = __atomic_load_n(&parent[p], __ATOMIC_RELAXED);
+        if (gp != p) __atomic_store_n(&parent[x], gp, __ATOMIC_RELAXED);
+        x = p;
+    }
+}
+
+static void weld_union(uint32_t* parent, uint32_t a, uint32_t b) {
+    for (;;) {
+        a = weld_find(parent, a);
+        b = weld_find(parent, b);
+        if (a == b) return;
+        if (a < b) {
+            uint32_t t = a;
+            a = b;
+            b = t;
+        }
+        uint32_t expected = a;
+        if (__atomic_compare_exchange_n(&parent[a], &expected, b, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) return;
+    }
+}
+
+// Insere cada vertice na sua celula; as celulas de um lote sao pedidas a
+// memoria antes do primeiro acesso. Com epsilon 0 a celula ja e a posicao
+// exata, entao o vertice e unido ao dono na hora e a busca nao e necessaria.
+void weldInsertJob(void* ctx, int thread_index) {
+    position_welder_t* w = (position_welder_t*)ctx;
+    size_t begin, end, slots[WELD_PREFETCH];
+    (void)thread_index;
+    while (weld_next_chunk(w, &begin, &end)) {
+        for (size_t batch = begin; batch < end; batch += WELD_PREFETCH) {
+            size_t count = end - batch < WELD_PREFETCH ? end - batch : WELD_PREFETCH;
+            for (size_t b = 0; b < count; b++) {
+                weld_key(&g_vertices[batch + b], w->cell, w->keys[batch + b]);
+                slots[b] = weld_hash(w->keys[batch + b]) & w->table_mask;
+                __builtin_prefetch(&w->table[slots[b]], 1);
+            }
+            for (size_t b = 0; b < count; b++) {
+                size_t i = batch + b, slot = slots[b];
+                const uint32_t* key = w->keys[i];
+                uint32_t owner;
+                for (;;) {
+                    owner = __atomic_load_n(&w->table[slot].owner, __ATOMIC_ACQUIRE);
+                    if (owner == 0) {
+                        uint32_t expected = 0;
+                        if (__atomic_compare_exchange_n(&w->table[slot].owner, &expected, (uint32_t)i + 1, 0,
+                                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                            owner = (uint32_t)i + 1;
+                            break;
+                        }
+                        owner = expected;
+                    }
+                    const uint32_t* other = w->keys[owner - 1];
+                    if (other[0] == key[0] && other[1] == key[1] && other[2] == key[2]) break;
+                    slot = (slot + 1) & w->table_mask;
+                }
+                if (w->epsilon == 0.0f) {
+                    if (owner != i + 1) weld_union(w->parent, (uint32_t)i, owner - 1);
+                    continue;
+                }
+                uint32_t head = __atomic_load_n(&w->table[slot].head, __ATOMIC_RELAXED);
+                do {
+                    w->next[i] = head;
+                } while (!__atomic_compare_exchange_n(&w->table[slot].head, &head, (uint32_t)i + 1, 1, __ATOMIC_RELEASE,
+                                                      __ATOMIC_RELAXED));
+            }
+        }
+    }
+}
+
+void weldSearchJob(void* ctx, int thread_index) {
+    position_welder_t* w = (position_welder_t*)ctx;
+    size_t begin, end;
+    float eps2 = w->epsilon * w->epsilon;
+    (void)thread_index;
+    while (weld_next_chunk(w, &begin, &end)) {
+        for (size_t i = begin; i < end; i++) {
+            const float* p = &g_vertices[i].x;
+            int lo[3] = {0, 0, 0}, hi[3] = {0, 0, 0};
+            if (w->epsilon > 0.0f) {
+                for (int a = 0; a < 3; a++) {
+                    float local = p[a] - floorf(p[a] / w->cell) * w->cell;
+                    lo[a] = local < w->epsilon ? -1 : 0;
+                    hi[a] = w->cell - local <= w->epsilon ? 1 : 0;
+                }
+            }
+            for (int dx = lo[0]; dx <= hi[0]; dx++) {
+                for (int dy = lo[1]; dy <= hi[1]; dy++) {
+                    for (int dz = lo[2]; dz <= hi[2]; dz++) {
+                        uint32_t key[3] = {w->keys[i][0], w->keys[i][1], w->keys[i][2]};
+                        if (w->epsilon > 0.0f) {
+                            key[0] += (uint32_t)dx;
+                            key[1] += (uint32_t)dy;
+                            key[2] += (uint32_t)dz;
+                        }
+                        size_t slot = weld_find_cell(w, key);
+                        if (slot == (size_t)-1) continue;
+                        for (uint32_t j = w->table[slot].head; j; j = w->next[j - 1]) {
+                            if (j - 1 >= i) continue;
+                            const float* q = &g_vertices[j - 1].x;
+                            float ex = p[0] - q[0], ey = p[1] - q[1], ez = p[2] - q[2];
+                            if (ex * ex + ey * ey + ez * ez <= eps2) weld_union(w->parent, (uint32_t)i, j - 1);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+void weldRemapJob(void* ctx, int thread_index) {
+    position_welder_t* w = (position_welder_t*)ctx;
+    int threads = numThreads();
+    size_t begin = g_num_faces * thread_index / threads;
+    size_t end = g_num_faces * (thread_index + 1) / threads;
+    for (size_t f = begin; f < end; f++) {
+        for (int k = 0; k < 3; k++) {
+            int v = g_faces[f].v[k].v_idx;
+            if (v > 0 && (size_t)v <= w->num_vertices) g_faces[f].v[k].v_idx = w->remap[v - 1];
+        }
+    }
+}
+
+size_t weldPositions() {
+    size_t n = g_num_vertices;
+    if (n == 0) return 0;
+    position_welder_t w;
+    memset(&w, 0, sizeof(w));
+    w.num_vertices = n;
+    w.epsilon = g_weld_epsilon > 0.0f ? g_weld_epsilon : 0.0f;
+    w.cell = w.epsilon * WELD_CELL_SCALE;
+    size_t table_size = 1024;
+    while (table_size < n * 2) table_size *= 2;
+    w.table_mask = table_size - 1;
+    w.table = (weld_cell_t*)calloc(table_size, sizeof(weld_cell_t));
+    w.keys = (uint32_t (*)[3])malloc(n * sizeof(*w.keys));
+    w.next = w.epsilon > 0.0f ? (uint32_t*)malloc(n * sizeof(uint32_t)) : NULL;
+    w.parent = (uint32_t*)malloc(n * sizeof(uint32_t));
+    for (size_t i = 0; i < n; i++) w.parent[i] = (uint32_t)i;
+    w.remap = (int*)malloc(n * sizeof(int));
+
+    runParallel(weldInsertJob, &w);
+    if (w.epsilon > 0.0f) {
+        w.cursor = 0;
+        runParallel(weldSearchJob, &w);
+    }
+
+    // parent[i] <= i: uma passada em ordem achata as arvores.
+    for (size_t i = 0; i < n; i++) w.remap[i] = w.parent[i] == i ? (int)i + 1 : w.remap[w.parent[i]];
+    runParallel(weldRemapJob, &w);
+
+    free(w.table);
+    free(w.keys);
+    free(w.next);
+    free(w.parent);
+    free(w.remap);
+    size_t before = g_num_vertices;
+    compactVertexStreams();
+    return before - g_num_vertices;
+}
+
+void weldMesh() {
+    double start = get_time_ms();
+    size_t before = g_num_vertices;
+    size_t removed = weldPositions();
+    printf("Soldagem (epsilon %g): %zu -> %zu posicoes (-%zu, %.2fx), %.1f ms (%d threads)\n", g_weld_epsilon, before,
+           g_num_vertices, removed, g_num_vertices ? (double)before / g_num_vertices : 0.0, get_time_ms() - start,
+           numThreads());
+}
+
+void generateBenchmarkMesh(size_t triangles) {
+    size_t rows = (size_t)sqrt(triangles / 4.0);
+    if (rows < 2) rows = 2;
+    size_t cols = rows * 2;
+
+    free(g_vertices);
+    free(g_faces);
+    g_num_vertices = (rows + 1) * (cols + 1);
+    g_num_faces = rows * cols * 2;
+    g_vertices = (vec3f*)malloc(g_num_vertices * sizeof(vec3f));
+    g_faces = (face_t*)malloc(g_num_faces * sizeof(face_t));
+    g_vertices_cap = g_faces_cap = 0;
+
+    for (size_t j = 0; j <= rows; j++) {
+        for (size_t i = 0; i <= cols; i++) {
+            float theta = (float)M_PI * j / rows;
+            float phi = 2.0f * (float)M_PI * i / cols;
+            float r = 1.0f + 0.05f * sinf(phi * 37.0f) * sinf(theta * 23.0f) + 0.02f * sinf(phi * 211.0f + theta * 97.0f);
+            g_vertices[j * (cols + 1) + i] = (vec3f){r * sinf(theta) * cosf(phi), r * cosf(theta), r * sinf(theta) * sinf(phi)};
+        }
+    }
+    size_t f = 0;
+    for (size_t j = 0; j < rows; j++) {
+        for (size_t i = 0; i < cols; i++) {
+            int a = (int)(j * (cols + 1) + i) + 1;
+            int b = a + 1;
+            int c = a + (int)cols + 2;
+            int d = a + (int)cols + 1;
+            g_faces[f++] = (face_t){{{a, 0, 0}, {b, 0, 0}, {c, 0, 0}}, -1};
+            g_faces[f++] = (face_t){{{a, 0, 0}, {c, 0, 0}, {d, 0, 0}}, -1};
+        }
+    }
+    g_center[0] = g_center[1] = g_center[2] = 0.0f;
+    g_size = 2.0f;
+}
+
+// Separa os vertices da malha de teste (um por canto, como exportadores que
+// nao compartilham posicoes), com ruido abaixo de epsilon, e mede a soldagem.
+void benchmarkWeld(double millions) {
+    generateBenchmarkMesh((size_t)(millions * 1000000.0 / 3.0));
+    vec3f* split = (vec3f*)malloc(g_num_faces * 3 * sizeof(vec3f));
+    uint64_t rng = 1;
+    float jitter = g_weld_epsilon * 0.25f;
+    for (size_t f = 0; f < g_num_faces; f++) {
+        for (int k = 0; k < 3; k++) {
+            vec3f p = g_vertices[g_faces[f].v[k].v_idx - 1];
+            p.x += (pcgFloat(&rng) * 2.0f - 1.0f) * jitter;
+            p.y += (pcgFloat(&rng) * 2.0f - 1.0f) * jitter;
+            p.z += (pcgFloat(&rng) * 2.0f - 1.0f) * jitter;
+            split[f * 3 + k] = p;
+            g_faces[f].v[k].v_idx = (int)(f * 3 + k) + 1;
+        }
+    }
+    printf("Malha de teste: %zu triangulos, %zu vertices compartilhados, %zu separados\n", g_num_faces, g_num_vertices,
+           g_num_faces * 3);
+    free(g_vertices);
+    g_vertices = split;
+    g_num_vertices = g_num_faces * 3;
+    g_vertices_cap = 0;
+    weldMesh();
+}
+
+// STL binario: 80 bytes de cabecalho, contagem uint32 e registros de 50 bytes
+// (normal, 3 vertices, atributo). Os vertices repetidos sao soldados por uma
+// tabela hash aberta preenchida em paralelo com CAS; com g_weld_epsilon > 0,
+// weldPositions une em seguida as posicoes a ate epsilon, como -weld-positions.
+#define STL_RECORD 50
+#define STL_CREASE_COS 0.5f
+
+typedef struct {
+    const unsigned char* records;
+    size_t num_tris, num_corners;
+    uint32_t (*keys)[3];
+    vec3f* positions;
+    uint32_t* table;
+    size_t table_mask;
+    uint32_t* rep;
+} stl_welder_t;
+
+void stlKeyJob(void* ctx, int thread_index) {
+    stl_welder_t* w = (stl_welder_t*)ctx;
+    int threads = numThreads();
+    size_t begin = w->num_tris * thread_index / threads;
+    size_t end = w->num_tris * (thread_index + 1) / threads;
+    for (size_t t = begin; t < end; t++) {
+        const unsigned char* r = w->records + t * STL_RECORD;
+        for (int k = 0; k < 3; k++) {
+            size_t c = t * 3 + k;
+            memcpy(&w->positions[c], r + 12 + k * 12, 12);
+            weld_key(&w->positions[c], 0.0f, w->keys[c]);
+        }
+    }
+}
+
+void stlInsertJob(void* ctx, int thread_index) {
+    stl_welder_t* w = (stl_welder_t*)ctx;
+    int threads = numThreads();
+    size_t begin = w->num_corners * thread_index / threads;
+    size_t end = w->num_corners * (thread_index + 1) / threads;
+    for (size_t c = begin; c < end; c++) {
+        const uint32_t* key = w->keys[c];
+        size_t slot = weld_hash(key) & w->table_mask;
+        for (;;) {
+            uint32_t current = __atomic_load_n(&w->table[slot], __ATOMIC_ACQUIRE);
+            if (current == 0) {
+                uint32_t expected = 0;
+                if (__atomic_compare_exchange_n(&w->table[slot], &expected, (uint32_t)c + 1, 0, __ATOMIC_ACQ_REL,
+                                                __ATOMIC_ACQUIRE)) {
+                    w->rep[c] = (uint32_t)c;
+                    break;
+                }
+                current = expected;
+            }
+            const uint32_t* other = w->keys[current - 1];
+            if (other[0] == key[0] && other[1] == key[1] && other[2] == key[2]) {
+                w->rep[c] = current - 1;
+                break;
+            }
+            slot = (slot + 1) & w->table_mask;
+        }
+    }
+}
+
+int loadSTL(const char* filename) {
+    size_t size = 0;
+    char* data = mapFile(filename, &size);
+    if (!data) {
+        printf("Nao foi possivel abrir %s\n", filename);
+        return 0;
+    }
+    uint32_t count = 0;
+    if (size >= 84) memcpy(&count, data + 80, 4);
+    if (size < 84 || size != 84 + (size_t)count * STL_RECORD) {
+        printf("%s: so STL binario e suportado\n", filename);
+        munmap(data, size);
+        return 0;
+    }
+
+    double start = get_time_ms();
+    stl_welder_t w;
+    memset(&w, 0, sizeof(w));
+    w.records = (const unsigned char*)data + 84;
+    w.num_tris = count;
+    w.num_corners = (size_t)count * 3;
+    w.keys = (uint32_t (*)[3])malloc(w.num_corners * sizeof(*w.keys));
+    w.positions = (vec3f*)malloc(w.num_corners * sizeof(vec3f));
+    w.rep = (uint32_t*)malloc(w.num_corners * sizeof(uint32_t));
+    size_t table_size = 1024;
+    while (table_size < w.num_corners * 2) table_size *= 2;
+    w.table = (uint32_t*)calloc(table_size, sizeof(uint32_t));
+    w.table_mask = table_size - 1;
+
+    runParallel(stlKeyJob, &w);
+    runParallel(stlInsertJob, &w);
+
+    // Numera os vertices na ordem da primeira ocorrencia (independe das
+    // threads); a tabela, ja sem uso, tem espaco para um id por canto.
+    uint32_t* ids = w.table;
+    memset(ids, 0xff, w.num_corners * sizeof(uint32_t));
+    size_t nv = 0;
+    for (size_t c = 0; c < w.num_corners; c++) {
+        uint32_t r = w.rep[c];
+        if (ids[r] == 0xffffffffu) ids[r] = (uint32_t)nv++;
+        w.rep[c] = ids[r];
+    }
+
+    g_vertices = (vec3f*)malloc(nv * sizeof(vec3f));
+    for (size_t c = 0; c < w.num_corners; c++) g_vertices[w.rep[c]] = w.positions[c];
+    g_num_vertices = nv;
+    g_vertices_cap = 0;
+    g_faces = (face_t*)malloc(w.num_tris * sizeof(face_t));
+    g_faces_cap = 0;
+    for (size_t t = 0; t < w.num_tris; t++) {
+        for (int k = 0; k < 3; k++) g_faces[t].v[k] = (face_vertex_t){(int)w.rep[t * 3 + k] + 1, 0, 0};
+        g_faces[t].material_id = -1;
+    }
+    g_num_faces = w.num_tris;
+    if (g_weld_epsilon > 0.0f) weldPositions();
+    nv = g_num_vertices;
+
+    // Normais geradas: media ponderada por area por vertice soldado; cantos
+    // cuja face se afasta mais que STL_CREASE_COS usam a normal da face.
+    // Faces que a soldagem degenerou saem aqui.
+    vec3f* face_n = (vec3f*)malloc(g_num_faces * sizeof(vec3f));
+    g_normals = (vec3f*)calloc(nv + g_num_faces, sizeof(vec3f));
+    g_normals_cap = 0;
+    size_t kept = 0;
+    for (size_t t = 0; t < g_num_faces; t++) {
+        face_t f = g_faces[t];
+        if (f.v[0].v_idx == f.v[1].v_idx || f.v[1].v_idx == f.v[2].v_idx || f.v[0].v_idx == f.v[2].v_idx) continue;
+        vec3f n = face_normal(&g_vertices[f.v[0].v_idx - 1], &g_vertices[f.v[1].v_idx - 1], &g_vertices[f.v[2].v_idx - 1]);
+        face_n[kept] = n;
+        for (int k = 0; k < 3; k++) {
+            vec3f* dst = &g_normals[f.v[k].v_idx - 1];
+            dst->x += n.x; dst->y += n.y; dst->z += n.z;
+        }
+        g_faces[kept++] = f;
+    }
+    g_num_faces = kept;
+    for (size_t v = 0; v < nv; v++) {
+        vec3f* n = &g_normals[v];
+        float len = sqrtf(n->x * n->x + n->y * n->y + n->z * n->z);
+        if (len > 0.0f) *n = (vec3f){n->x / len, n->y / len, n->z / len};
+    }
+    g_num_normals = nv;
+
+    size_t creases = 0;
+    for (size_t t = 0; t < g_num_faces; t++) {
+        vec3f n = face_n[t];
+        float len = sqrtf(n.x * n.x + n.y * n.y + n.z * n.z);
+        if (len > 0.0f) n = (vec3f){n.x / len, n.y / len, n.z / len};
+        int flat = 0;
+        face_t* f = &g_faces[t];
+        for (int k = 0; k < 3; k++) {
+            const vec3f* vn = &g_normals[f->v[k].v_idx - 1];
+            f->v[k].vn_idx = f->v[k].v_idx;
+            if (len > 0.0f && vn->x * n.x + vn->y * n.y + vn->z * n.z < STL_CREASE_COS) {
+                if (!flat) {
+                    g_normals[g_num_normals++] = n;
+                    flat = (int)g_num_normals;
+                    creases++;
+                }
+                f->v[k].vn_idx = flat;
+            }
+        }
+    }
+
+    float min_v[3] = {1e9f, 1e9f, 1e9f}, max_v[3] = {-1e9f, -1e9f, -1e9f};
+    for (size_t i = 0; i < nv; i++) {
+        const float* v = &g_vertices[i].x;
+        for (int a = 0; a < 3; a++) {
+            if (v[a] < min_v[a]) min_v[a] = v[a];
+            if (v[a] > max_v[a]) max_v[a] = v[a];
+        }
+    }
+    for (int a = 0; a < 3; a++) g_center[a] = (min_v[a] + max_v[a]) / 2.0f;
+    g_size = fmax(fmax(fabs(max_v[0] - min_v[0]), fabs(max_v[1] - min_v[1])), fabs(max_v[2] - min_v[2]));
+
+    printf("%s: %u triangulos, %zu vertices -> %zu soldados (%.2fx), %zu faces com aresta viva, %.1f ms (%d threads)\n",
+           filename, count, w.num_corners, nv, nv ? (double)w.num_corners / nv : 0.0, creases,
+           get_time_ms() - start, numThreads());
+
+    free(face_n);
+    free(w.keys);
+    free(w.positions);
+    free(w.rep);
+    free(w.table);
+    munmap(data, size);
+    return 1;
+}
+
+// Limpeza de faces: indice de posicao repetido, area abaixo de
+// g_degenerate_epsilon * g_size^2 e duplicatas exatas (mesmas tres posicoes
+// na mesma orientacao, em qualquer rotacao; faces de costas sao mantidas).
+int g_clean_faces = 0;
+float g_degenerate_epsilon = 1e-10f;
+
+typedef struct {
+    size_t repeated, zero_area, duplicates, vertices;
+} cleanup_stats_t;
+
+static inline uint64_t face_key_hash(const int* k) {
+    uint32_t key[3] = {(uint32_t)k[0], (uint32_t)k[1], (uint32_t)k[2]};
+    return weld_hash(key);
+}
+
+size_t removeDegenerateFaces(cleanup_stats_t* stats) {
+    memset(stats, 0, sizeof(*stats));
+    size_t table_size = 1024;
+    while (table_size < g_num_faces * 2) table_size *= 2;
+    uint32_t* table = (uint32_t*)calloc(table_size, sizeof(uint32_t));
+    int (*keys)[3] = (int (*)[3])malloc(g_num_faces * sizeof(*keys));
+    float min_cross = g_degenerate_epsilon * g_size * g_size;
+
+    size_t kept = 0, submesh = 0;
+    for (size_t i = 0; i < g_num_faces; i++) {
+        // Os submeshes cobrem as faces em ordem: o inicio de cada um anda junto com a compactacao.
+        while (submesh < g_num_submeshes && g_submeshes[submesh].first_face == i) g_submeshes[submesh++].first_face = kept;
+        const face_t* f = &g_faces[i];
+        int a = f->v[0].v_idx, b = f->v[1].v_idx, c = f->v[2].v_idx;
+        if (a == b || b == c || a == c || a < 1 || b < 1 || c < 1 || (size_t)a > g_num_vertices ||
+            (size_t)b > g_num_vertices || (size_t)c > g_num_vertices) {
+            stats->repeated++;
+            continue;
+        }
+        vec3f n = face_normal(&g_vertices[a - 1], &g_vertices[b - 1], &g_vertices[c - 1]);
+        if (sqrtf(n.x * n.x + n.y * n.y + n.z * n.z) <= min_cross) {
+            stats->zero_area++;
+            continue;
+        }
+
+        // Rotaciona para o menor indice primeiro, preservando a orientacao.
+        int* key = keys[kept];
+        if (a < b && a < c) key[0] = a, key[1] = b, key[2] = c;
+        else if (b < c) key[0] = b, key[1] = c, key[2] = a;
+        else key[0] = c, key[1] = a, key[2] = b;
+        size_t slot = face_key_hash(key) & (table_size - 1);
+        int duplicate = 0;
+        while (table[slot]) {
+            const int* other = keys[table[slot] - 1];
+            if (other[0] == key[0] && other[1] == key[1] && other[2] == key[2]) {
+                duplicate = 1;
+                break;
+            }
+            slot = (slot + 1) & (table_size - 1);
+        }
+        if (duplicate) {
+            stats->duplicates++;
+            continue;
+        }
+        table[slot] = (uint32_t)kept + 1;
+        g_faces[kept++] = *f;
+    }
+    free(table);
+    free(keys);
+
+    size_t removed = g_num_faces - kept;
+    g_num_faces = kept;
+    while (submesh < g_num_submeshes) g_submeshes[submesh++].first_face = kept;
+    for (size_t i = 0; i < g_num_submeshes; i++) {
+        size_t end = i + 1 < g_num_submeshes ? g_submeshes[i + 1].first_face : kept;
+        g_submeshes[i].num_faces = end - g_submeshes[i].first_face;
+    }
+    if (removed) stats->vertices = compactVertexStreams();
+    updateSubmeshes();
+    return removed;
+}
+
+void cleanupMesh() {
+    double start = get_time_ms();
+    size_t before = g_num_faces;
+    cleanup_stats_t stats;
+    size_t removed = removeDegenerateFaces(&stats);
+    printf("Limpeza: %zu de %zu faces removidas (%.1f%%): %zu com indice repetido, %zu de area nula, %zu duplicadas; "
+           "%zu atributos sem uso descartados, %.1f ms\n",
+           removed, before, before ? 100.0 * removed / before : 0.0, stats.repeated, stats.zero_area, stats.duplicates,
+           stats.vertices, get_time_ms() - start);
+}
+
+// Falhas por triangulo numa cache FIFO de VCACHE_FIFO posicoes (ACMR).
+#define VCACHE_FIFO 16
+#define VCACHE_SIZE 32
+
+double vertexCacheACMR(const face_t* faces, size_t num_faces) {
+    int fifo[VCACHE_FIFO];
+    int head = 0;
+    size_t misses = 0;
+    for (int i = 0; i < VCACHE_FIFO; i++) fifo[i] = 0;
+    for (size_t i = 0; i < num_faces; i++) {
+        for (int k = 0; k < 3; k++) {
+            int v = faces[i].v[k].v_idx, hit = 0;
+            for (int j = 0; j < VCACHE_FIFO; j++) hit |= fifo[j] == v;
+            if (!hit) {
+                fifo[head] = v;
+                head = (head + 1) % VCACHE_FIFO;
+                misses++;
+            }
+        }
+    }
+    return num_faces ? (double)misses / num_faces : 0.0;
+}
+
+// Pontuacao de Forsyth: vertices recentes na cache LRU e com poucas faces
+// restantes puxam seus triangulos para frente.
+static float g_vcache_position_score[VCACHE_SIZE];
+static float g_vcache_valence_score[64];
+
+static inline float vertex_cache_score(int cache_pos, int valence) {
+    if (valence == 0) return -1.0f;
+    float score = cache_pos >= 0 ? g_vcache_position_score[cache_pos] : 0.0f;
+    return score + (valence < 64 ? g_vcache_valence_score[valence] : 2.0f / sqrtf((float)valence));
+}
+
+void optimizeVertexCache() {
+    size_t nf = g_num_faces, nv = g_num_vertices;
+    if (nf == 0 || nv == 0) return;
+    for (size_t t = 0; t < nf; t++) {
+        for (int k = 0; k < 3; k++) {
+            if (g_faces[t].v[k].v_idx < 1 || (size_t)g_faces[t].v[k].v_idx > nv) return;
+        }
+    }
+    for (int i = 0; i < VCACHE_SIZE; i++)
+        g_vcache_position_score[i] = i < 3 ? 0.75f : powf(1.0f - (i - 3) / (float)(VCACHE_SIZE - 3), 1.5f);
+    for (int i = 1; i < 64; i++) g_vcache_valence_score[i] = 2.0f / sqrtf((float)i);
+
+    // Listas de adjacencia vertice -> triangulos em formato compacto.
+    int* valence = (int*)calloc(nv, sizeof(int));
+    size_t* offsets = (size_t*)malloc((nv + 1) * sizeof(size_t));
+    uint32_t* adjacency = (uint32_t*)malloc(nf * 3 * sizeof(uint32_t));
+    for (size_t t = 0; t < nf; t++)
+        for (int k = 0; k < 3; k++) valence[g_faces[t].v[k].v_idx - 1]++;
+    offsets[0] = 0;
+    for (size_t v = 0; v < nv; v++) offsets[v + 1] = offsets[v] + valence[v];
+    memset(valence, 0, nv * sizeof(int));
+    for (size_t t = 0; t < nf; t++) {
+        for (int k = 0; k < 3; k++) {
+            int v = g_faces[t].v[k].v_idx - 1;
+            adjacency[offsets[v] + valence[v]++] = (uint32_t)t;
+        }
+    }
+
+    int* cache_pos = (int*)malloc(nv * sizeof(int));
+    float* vscore = (float*)malloc(nv * sizeof(float));
+    for (size_t v = 0; v < nv; v++) {
+        cache_pos[v] = -1;
+        vscore[v] = vertex_cache_score(-1, valence[v]);
+    }
+    float* tscore = (float*)malloc(nf * sizeof(float));
+    unsigned char* emitted = (unsigned char*)calloc(nf, 1);
+
+    // Trechos de mesmo material dentro de cada submesh nao se misturam: a
+    // troca de textura e as faixas dos submeshes continuam valendo.
+    uint32_t* segment = (uint32_t*)malloc(nf * sizeof(uint32_t));
+    size_t next_submesh = 0;
+    for (size_t t = 0; t < nf; t++) {
+        int boundary = t > 0 && g_faces[t].material_id != g_faces[t - 1].material_id;
+        while (next_submesh < g_num_submeshes && g_submeshes[next_submesh].first_face <= t) {
+            boundary |= t > 0;
+            next_submesh++;
+        }
+        segment[t] = t == 0 ? 0 : segment[t - 1] + boundary;
+    }
+    for (size_t t = 0; t < nf; t++) {
+        tscore[t] = 0.0f;
+        for (int k = 0; k < 3; k++) tscore[t] += vscore[g_faces[t].v[k].v_idx - 1];
+    }
+
+    face_t* out = (face_t*)malloc(nf * sizeof(face_t));
+    int cache[VCACHE_SIZE + 3], cache_size = 0;
+    size_t scan = 0;
+    long best = -1;
+    for (size_t i = 0; i < nf; i++) {
+        if (best < 0) {
+            // Nada pontuou na cache: segue com o proximo triangulo na ordem original.
+            while (emitted[scan]) scan++;
+            best = (long)scan;
+        }
+        const face_t* f = &g_faces[best];
+        out[i] = *f;
+        emitted[best] = 1;
+        uint32_t current = segment[best];
+
+        int next[VCACHE_SIZE + 3], next_size = 0;
+        for (int k = 0; k < 3; k++) {
+            int v = f->v[k].v_idx - 1;
+            uint32_t* list = adjacency + offsets[v];
+            for (int j = 0; j < valence[v]; j++) {
+                if (list[j] == (uint32_t)best) {
+                    list[j] = list[--valence[v]];
+                    break;
+                }
+            }
+            int present = 0;
+            for (int j = 0; j < next_size; j++) present |= next[j] == v;
+            if (!present) next[next_size++] = v;
+        }
+        for (int j = 0; j < cache_size; j++) {
+            int present = 0;
+            for (int k = 0; k < 3; k++) present |= cache[j] == f->v[k].v_idx - 1;
+            if (!present) next[next_size++] = cache[j];
+        }
+
+        best = -1;
+        float best_score = -1.0f;
+        for (int j = 0; j < next_size; j++) {
+            int v = next[j];
+            cache_pos[v] = j < VCACHE_SIZE ? j : -1;
+            float score = vertex_cache_score(cache_pos[v], valence[v]);
+            float delta = score - vscore[v];
+            vscore[v] = score;
+            const uint32_t* list = adjacency + offsets[v];
+            for (int a = 0; a < valence[v]; a++) {
+                uint32_t t = list[a];
+                tscore[t] += delta;
+                if (tscore[t] > best_score && segment[t] == current) {
+                    best_score = tscore[t];
+                    best = (long)t;
+                }
+            }
+        }
+        cache_size = next_size < VCACHE_SIZE ? next_size : VCACHE_SIZE;
+        memcpy(cache, next, cache_size * sizeof(int));
+    }
+
+    // Entradas que ja chegam bem ordenadas (grades varridas por linha) podem
+    // sair piores na FIFO medida; nesse caso fica a ordem original.
+    if (vertexCacheACMR(out, nf) < vertexCacheACMR(g_faces, nf)) memcpy(g_faces, out, nf * sizeof(face_t));
+    free(out);
+    free(valence);
+    free(offsets);
+    free(adjacency);
+    free(cache_pos);
+    free(vscore);
+    free(tscore);
+    free(emitted);
+    free(segment);
+    compactVertexStreams();
+}
+
+// -part: fica so com os submeshes de nome igual a name ou dentro do objeto
+// name ("name/..."), e reenquadra a camera neles.
+const char* g_part_filter = NULL;
+
+static int part_matches(const char* part, const char* name) {
+    size_t n = strlen(name);
+    return strncmp(part, name, n) == 0 && (part[n] == '\0' || part[n] == '/');
+}
+
+void selectPart(const char* name) {
+    size_t kept = 0, parts = 0;
+    float bmin[3] = {1e30f, 1e30f, 1e30f}, bmax[3] = {-1e30f, -1e30f, -1e30f};
+    for (size_t i = 0; i < g_num_submeshes; i++) {
+        submesh_t s = g_submeshes[i];
+        if (!part_matches(s.name, name)) continue;
+        memmove(&g_faces[kept], &g_faces[s.first_face], s.num_faces * sizeof(face_t));
+        s.first_face = kept;
+        kept += s.num_faces;
+        for (int a = 0; a < 3; a++) {
+            if (s.bmin[a] < bmin[a]) bmin[a] = s.bmin[a];
+            if (s.bmax[a] > bmax[a]) bmax[a] = s.bmax[a];
+        }
+        g_submeshes[parts++] = s;
+    }
+    if (parts == 0) {
+        printf("Parte '%s' nao encontrada; o modelo inteiro sera usado\n", name);
+        return;
+    }
+    printf("Parte '%s': %zu submeshes, %zu de %zu faces\n", name, parts, kept, g_num_faces);
+    g_num_submeshes = parts;
+    g_num_faces = kept;
+    compactVertexStreams();
+    updateSubmeshes();
+    for (int a = 0; a < 3; a++) g_center[a] = (bmin[a] + bmax[a]) / 2.0f;
+    g_size = fmax(fmax(fabs(bmax[0] - bmin[0]), fabs(bmax[1] - bmin[1])), fabs(bmax[2] - bmin[2]));
+}
+
+void listParts() {
+    if (g_num_submeshes == 0) {
+        printf("Sem grupos ou objetos (\"o\"/\"g\"): %zu faces\n", g_num_faces);
+        return;
+    }
+    for (size_t i = 0; i < g_num_submeshes; i++) {
+        const submesh_t* s = &g_submeshes[i];
+        printf("%-40s %9zu faces  [%g %g %g] - [%g %g %g]", s->name, s->num_faces, s->bmin[0], s->bmin[1], s->bmin[2],
+               s->bmax[0], s->bmax[1], s->bmax[2]);
+        for (size_t r = s->first_range; r < s->first_range + s->num_ranges; r++) {
+            const material_range_t* m = &g_material_ranges[r];
+            printf(" %s:%zu", m->material_id >= 0 ? g_materials[m->material_id].name : "-", m->num_faces);
+        }
+        printf("\n");
+    }
+    printf("%zu submeshes, %zu faixas de material, %zu faces\n", g_num_submeshes, g_num_material_ranges, g_num_faces);
+}
+
+// Indice de bytes do OBJ (<obj>.idx): secoes "o"/"g" com o material ativo e
+// quantos v/vt/vn vieram antes, e blocos de INDEX_BLOCK_LINES linhas de cada
+// tipo de vertice. Com ele -part le so as secoes pedidas e so os blocos de
+// vertices que as faces delas referenciam.
+#define OBJ_INDEX_MAGIC "OIX1"
+#define INDEX_BLOCK_LINES 4096
+
+typedef struct {
+    char name[128];
+    char material[128];
+    uint64_t begin, end;
+    uint64_t base[3];
+    uint64_t faces;
+} obj_section_t;
+
+typedef struct {
+    uint64_t offset;
+    uint64_t first;
+    uint32_t kind;
+    uint32_t count;
+} obj_block_t;
+
+typedef struct {
+    char magic[4];
+    uint32_t reserved;
+    uint64_t file_size;
+    int64_t mtime;
+    uint64_t num_sections, num_blocks, num_mtllibs;
+    uint64_t totals[3];
+} obj_index_header_t;
+
+typedef struct {
+    obj_index_header_t h;
+    obj_section_t* sections;
+    obj_block_t* blocks;
+    uint64_t* mtllibs;
+} obj_index_t;
+
+void freeOBJIndex(obj_index_t* idx) {
+    free(idx->sections);
+    free(idx->blocks);
+    free(idx->mtllibs);
+    memset(idx, 0, sizeof(*idx));
+}
+
+static int vertex_kind(int line_kind) {
+    return line_kind == LINE_V ? 0 : line_kind == LINE_VT ? 1 : line_kind == LINE_VN ? 2 : -1;
+}
+
+// Uma passada do separador de linhas; so o primeiro caractere de cada linha e
+// olhado, exceto nas raras linhas "o", "g" e "usemtl".
+void buildOBJIndex(const char* data, size_t size, obj_index_t* idx) {
+    size_t ends[LINE_BATCH];
+    size_t pos = 0, line_start = 0;
+    size_t section_cap = 16, block_cap = 64, mtllib_cap = 4;
+    long open_block[3] = {-1, -1, -1};
+    char material[128] = "", object_name[128] = "";
+    idx->sections = (obj_section_t*)calloc(section_cap, sizeof(obj_section_t));
+    idx->blocks = (obj_block_t*)malloc(block_cap * sizeof(obj_block_t));
+    idx->mtllibs = (uint64_t*)malloc(mtllib_cap * sizeof(uint64_t));
+    obj_section_t* section = &idx->sections[0];
+    strcpy(section->name, "default");
+    idx->h.num_sections = 1;
+
+    for (;;) {
+        size_t n = scanLines(data, size, &pos, ends, LINE_BATCH);
+        if (n == 0) break;
+        for (size_t i = 0; i < n; i++) {
+            const char* line = data + line_start;
+            int kind = classifyLine(line);
+            int k = vertex_kind(kind);
+            if (k >= 0) {
+                if (open_block[k] < 0 || idx->blocks[open_block[k]].count == INDEX_BLOCK_LINES) {
+                    if (idx->h.num_blocks == block_cap) {
+                        block_cap *= 2;
+                        idx->blocks = (obj_block_t*)realloc(idx->blocks, block_cap * sizeof(obj_block_t));
+                    }
+                    open_block[k] = (long)idx->h.num_blocks++;
+                    idx->blocks[open_block[k]] = (obj_block_t){line_start, idx->h.totals[k], (uint32_t)k, 0};
+                }
+                idx->blocks[open_block[k]].count++;
+                idx->h.totals[k]++;
+            } else if (kind == LINE_F) {
+                section->faces++;
+            } else if (kind == LINE_GROUP) {
+                section->end = line_start;
+                if (idx->h.num_sections == section_cap) {
+                    section_cap *= 2;
+                    idx->sections = (obj_section_t*)realloc(idx->sections, section_cap * sizeof(obj_section_t));
+                }
+                section = &idx->sections[idx->h.num_sections++];
+                memset(section, 0, sizeof(*section));
+                obj_group_name(line, ends[i] - line_start, object_name, section->name, sizeof(section->name));
+                memcpy(section->material, material, sizeof(material));
+                section->begin = line_start;
+                memcpy(section->base, idx->h.totals, sizeof(section->base));
+            } else if (kind == LINE_USEMTL) {
+                const char* name = line + 7;
+                int len = 0;
+                while (name + len < data + ends[i] && len < 127 && name[len] != ' ' && name[len] != '\t' &&
+                       name[len] != '\r')
+                    len++;
+                memcpy(material, name, len);
+                material[len] = '\0';
+            } else if (kind == LINE_MTLLIB) {
+                if (idx->h.num_mtllibs == mtllib_cap) {
+                    mtllib_cap *= 2;
+                    idx->mtllibs = (uint64_t*)realloc(idx->mtllibs, mtllib_cap * sizeof(uint64_t));
+                }
+                idx->mtllibs[idx->h.num_mtllibs++] = line_start;
+            }
+            line_start = ends[i] + 1;
+        }
+    }
+    section->end = size;
+
+    // Secoes sem faces (o trecho antes do primeiro grupo costuma ter so vertices) saem do indice.
+    size_t kept = 0;
+    for (size_t i = 0; i < idx->h.num_sections; i++) {
+        if (idx->sections[i].faces > 0) idx->sections[kept++] = idx->sections[i];
+    }
+    idx->h.num_sections = kept;
+}
+
+int saveOBJIndex(const char* path, const obj_index_t* idx) {
+    FILE* file = fopen(path, "wb");
+    if (!file) return 0;
+    fwrite(&idx->h, sizeof(idx->h), 1, file);
+    fwrite(idx->sections, sizeof(obj_section_t), idx->h.num_sections, file);
+    fwrite(idx->blocks, sizeof(obj_block_t), idx->h.num_blocks, file);
+    fwrite(idx->mtllibs, sizeof(uint64_t), idx->h.num_mtllibs, file);
+    int ok = !ferror(file);
+    if (fclose(file) != 0) ok = 0;
+    return ok;
+}
+
+int loadOBJIndex(const char* path, const struct stat* st, obj_index_t* idx) {
+    FILE* file = fopen(path, "rb");
+    if (!file) return 0;
+    memset(idx, 0, sizeof(*idx));
+    int ok = fread(&idx->h, sizeof(idx->h), 1, file) == 1 && memcmp(idx->h.magic, OBJ_INDEX_MAGIC, 4) == 0 &&
+             idx->h.file_size == (uint64_t)st->st_size && idx->h.mtime == (int64_t)st->st_mtime &&
+             idx->h.num_sections < (1u << 30) && idx->h.num_blocks < (1u << 30) && idx->h.num_mtllibs < (1u << 20);
+    if (ok) {
+        idx->sections = (obj_section_t*)malloc(idx->h.num_sections * sizeof(obj_section_t) + 1);
+        idx->blocks = (obj_block_t*)malloc(idx->h.num_blocks * sizeof(obj_block_t) + 1);
+        idx->mtllibs = (uint64_t*)malloc(idx->h.num_mtllibs * sizeof(uint64_t) + 1);
+        ok = fread(idx->sections, sizeof(obj_section_t), idx->h.num_sections, file) == idx->h.num_sections &&
+             fread(idx->blocks, sizeof(obj_block_t), idx->h.num_blocks, file) == idx->h.num_blocks &&
+             fread(idx->mtllibs, sizeof(uint64_t), idx->h.num_mtllibs, file) == idx->h.num_mtllibs;
+    }
+    fclose(file);
+    if (!ok) freeOBJIndex(idx);
+    return ok;
+}
+
+// Usa <obj>.idx se ainda corresponde ao arquivo (tamanho e mtime); senao
+// indexa e tenta gravar. force refaz sempre.
+int openOBJIndex(const char* filename, const char* data, size_t size, const struct stat* st, obj_index_t* idx, int force) {
+    char path[2048];
+    snprintf(path, sizeof(path), "%s.idx", filename);
+    if (!force && loadOBJIndex(path, st, idx)) return 1;
+
+    double start = get_time_ms();
+    memset(idx, 0, sizeof(*idx));
+    memcpy(idx->h.magic, OBJ_INDEX_MAGIC, 4);
+    idx->h.file_size = st->st_size;
+    idx->h.mtime = st->st_mtime;
+    buildOBJIndex(data, size, idx);
+    double ms = get_time_ms() - start;
+    int saved = saveOBJIndex(path, idx);
+    printf("%s: indice com %zu secoes e %zu blocos de vertices em %.1f ms (%.2f GB/s)%s\n", filename,
+           (size_t)idx->h.num_sections, (size_t)idx->h.num_blocks, ms, size / 1e6 / ms,
+           saved ? "" : ", sem permissao para gravar o .idx");
+    return 1;
+}
+
+// Percorre as linhas de [begin, end) chamando fn; o '\n' e trocado por '\0'
+// durante a chamada e restaurado depois, para o separador continuar valendo
+// em outras passadas sobre o mesmo trecho.
+typedef int (*obj_line_fn)(void* ctx, char* line, int kind);
+
+static void for_each_line(char* data, size_t begin, size_t end, obj_line_fn fn, void* ctx) {
+    size_t ends[LINE_BATCH];
+    size_t pos = 0, line_start = 0;
+    char* base = data + begin;
+    for (;;) {
+        size_t n = scanLines(base, end - begin, &pos, ends, LINE_BATCH);
+        if (n == 0) return;
+        for (size_t i = 0; i < n; i++) {
+            char* line = base + line_start;
+            int kind = classifyLine(line);
+            base[ends[i]] = '\0';
+            int more = fn(ctx, line, kind);
+            base[ends[i]] = '\n';
+            if (!more) return;
+            line_start = ends[i] + 1;
+        }
+    }
+}
+
+typedef struct {
+    size_t counts[3];
+    int material_id;
+    face_vertex_t* corners;
+    size_t num_corners, corners_cap;
+    int* polys;
+    size_t num_polys, polys_cap;
+    unsigned char* used[3];
+} lazy_sections_t;
+
+static void lazy_add_poly(lazy_sections_t* l, const face_vertex_t* poly, int n) {
+    if (l->num_corners + n > l->corners_cap) {
+        l->corners_cap = (l->corners_cap + n) * 2;
+        l->corners = (face_vertex_t*)realloc(l->corners, l->corners_cap * sizeof(face_vertex_t));
+    }
+    if (l->num_polys + 2 > l->polys_cap) {
+        l->polys_cap = (l->polys_cap + 2) * 2;
+        l->polys = (int*)realloc(l->polys, l->polys_cap * sizeof(int));
+    }
+    memcpy(l->corners + l->num_corners, poly, n * sizeof(face_vertex_t));
+    l->num_corners += n;
+    l->polys[l->num_polys++] = n;
+    l->polys[l->num_polys++] = l->material_id;
+    for (int i = 0; i < n; i++) {
+        l->used[0][poly[i].v_idx - 1] = 1;
+        if (poly[i].vt_idx) l->used[1][poly[i].vt_idx - 1] = 1;
+        if (poly[i].vn_idx) l->used[2][poly[i].vn_idx - 1] = 1;
+    }
+}
+
+// Faces de uma secao, ainda com indices globais; v/vt/vn soltos dentro da
+// secao so avancam os contadores dos indices relativos.
+static int lazy_section_line(void* ctx, char* line, int kind) {
+    lazy_sections_t* l = (lazy_sections_t*)ctx;
+    int k = vertex_kind(kind);
+    if (k >= 0) {
+        l->counts[k]++;
+    } else if (kind == LINE_USEMTL) {
+        char name[128];
+        sscanf(line, "usemtl %127s", name);
+        l->material_id = find_material(name);
+    } else if (kind == LINE_F) {
+        face_vertex_t poly[MAX_POLY_VERTICES], fv;
+        int n = 0;
+        char* cursor = line + 2;
+        while (parse_face_vertex_counts(&cursor, &fv, l->counts)) {
+            if (n == MAX_POLY_VERTICES) {
+                lazy_add_poly(l, poly, n);
+                poly[1] = poly[n - 1];
+                n = 2;
+            }
+            poly[n++] = fv;
+        }
+        if (n >= 3) lazy_add_poly(l, poly, n);
+    }
+    return 1;
+}
+
+typedef struct {
+    int kind;
+    size_t next, remaining;
+    const unsigned char* used;
+    int* remap;
+} lazy_block_t;
+
+static int lazy_block_line(void* ctx, char* line, int kind) {
+    lazy_block_t* b = (lazy_block_t*)ctx;
+    if (vertex_kind(kind) != b->kind) return 1;
+    size_t i = b->next++;
+    if (b->used[i]) {
+        float x = 0.0f, y = 0.0f, z = 0.0f;
+        if (b->kind == 0) {
+            sscanf(line, "v %f %f %f", &x, &y, &z);
+            add_vertex(x, y, z);
+            b->remap[i] = (int)g_num_vertices;
+        } else if (b->kind == 1) {
+            sscanf(line, "vt %f %f", &x, &y);
+            add_texcoord(x, y);
+            b->remap[i] = (int)g_num_texcoords;
+        } else {
+            sscanf(line, "vn %f %f %f", &x, &y, &z);
+            add_normal(x, y, z);
+            b->remap[i] = (int)g_num_normals;
+        }
+    }
+    return --b->remaining > 0;
+}
+
+// -part sobre um .obj comum: carrega so as secoes cujo nome casa com name.
+// Retorna 0 quando o indice nao se aplica (nada casou, ultima linha sem
+// '\n'), e o chamador faz a carga completa.
+int loadOBJParts(const char* filename, const char* name) {
+    struct stat st;
+    if (stat(filename, &st) != 0) return 0;
+    size_t size = 0;
+    char* data = mapFile(filename, &size);
+    if (!data) return 0;
+    if (data[size - 1] != '\n') {
+        munmap(data, size);
+        return 0;
+    }
+    double start = get_time_ms();
+    obj_index_t idx;
+    openOBJIndex(filename, data, size, &st, &idx, 0);
+
+    size_t selected = 0;
+    for (size_t i = 0; i < idx.h.num_sections; i++) selected += part_matches(idx.sections[i].name, name);
+    if (selected == 0) {
+        freeOBJIndex(&idx);
+        munmap(data, size);
+        return 0;
+    }
+
+    obj_parser_t parser;
+    objParserInit(&parser, filename);
+    for (size_t i = 0; i < idx.h.num_mtllibs; i++) {
+        char mtl_filename[1024];
+        char* line = data + idx.mtllibs[i];
+        char* eol = memchr(line, '\n', size - idx.mtllibs[i]);
+        *eol = '\0';
+        if (sscanf(line, "mtllib %1023s", mtl_filename) == 1) loadMTL(mtl_filename, parser.base_dir);
+        *eol = '\n';
+    }
+
+    lazy_sections_t l;
+    memset(&l, 0, sizeof(l));
+    size_t* section_polys = (size_t*)malloc((idx.h.num_sections + 1) * sizeof(size_t));
+    for (int k = 0; k < 3; k++) l.used[k] = (unsigned char*)calloc(idx.h.totals[k] + 1, 1);
+    for (size_t i = 0; i < idx.h.num_sections; i++) {
+        const obj_section_t* s = &idx.sections[i];
+        section_polys[i] = l.num_polys;
+        if (!part_matches(s->name, name)) continue;
+        for (int k = 0; k < 3; k++) l.counts[k] = s->base[k];
+        l.material_id = s->material[0] ? find_material(s->material) : -1;
+        for_each_line(data, s->begin, s->end, lazy_section_line, &l);
+    }
+    section_polys[idx.h.num_sections] = l.num_polys;
+
+    // So os blocos com algum vertice referenciado sao lidos.
+    int* remap[3];
+    size_t blocks_read = 0;
+    for (int k = 0; k < 3; k++) remap[k] = (int*)calloc(idx.h.totals[k] + 1, sizeof(int));
+    for (size_t i = 0; i < idx.h.num_blocks; i++) {
+        const obj_block_t* blk = &idx.blocks[i];
+        const unsigned char* used = l.used[blk->kind];
+        int needed = 0;
+        for (uint32_t j = 0; j < blk->count && !needed; j++) needed = used[blk->first + j];
+        if (!needed) continue;
+        lazy_block_t b = {(int)blk->kind, blk->first, blk->count, used, remap[blk->kind]};
+        for_each_line(data, blk->offset, size, lazy_block_line, &b);
+        blocks_read++;
+    }
+
+    size_t corner = 0;
+    for (size_t i = 0; i < idx.h.num_sections; i++) {
+        if (section_polys[i] == section_polys[i + 1]) continue;
+        begin_submesh(idx.sections[i].name);
+        for (size_t p = section_polys[i]; p < section_polys[i + 1]; p += 2) {
+            int n = l.polys[p];
+            face_vertex_t poly[MAX_POLY_VERTICES];
+            for (int c = 0; c < n; c++) {
+                const face_vertex_t* fv = &l.corners[corner + c];
+                poly[c].v_idx = remap[0][fv->v_idx - 1];
+                poly[c].vt_idx = fv->vt_idx ? remap[1][fv->vt_idx - 1] : 0;
+                poly[c].vn_idx = fv->vn_idx ? remap[2][fv->vn_idx - 1] : 0;
+            }
+            triangulatePolygon(poly, n, l.polys[p + 1]);
+            corner += n;
+        }
+    }
+    updateSubmeshes();
+
+    for (size_t i = 0; i < g_num_vertices; i++) {
+        const float* v = &g_vertices[i].x;
+        for (int a = 0; a < 3; a++) {
+            if (v[a] < parser.min_v[a]) parser.min_v[a] = v[a];
+            if (v[a] > parser.max_v[a]) parser.max_v[a] = v[a];
+        }
+    }
+    for (int a = 0; a < 3; a++) g_center[a] = (parser.min_v[a] + parser.max_v[a]) / 2.0f;
+    g_size = fmax(fmax(fabs(parser.max_v[0] - parser.min_v[0]), fabs(parser.max_v[1] - parser.min_v[1])),
+                  fabs(parser.max_v[2] - parser.min_v[2]));
+
+    printf("Parte '%s': %zu de %zu secoes, %zu faces, %zu de %zu vertices, %zu de %zu blocos lidos, %.1f ms\n", name,
+           selected, (size_t)idx.h.num_sections, g_num_faces, g_num_vertices, (size_t)idx.h.totals[0], blocks_read,
+           (size_t)idx.h.num_blocks, get_time_ms() - start);
+
+    for (int k = 0; k < 3; k++) {
+        free(l.used[k]);
+        free(remap[k]);
+    }
+    free(l.corners);
+    free(l.polys);
+    free(section_polys);
+    freeOBJIndex(&idx);
+    munmap(data, size);
+    return 1;
+}
+
+// -index: refaz o indice e lista as secoes.
+void indexOBJ(const char* filename) {
+    struct stat st;
+    size_t size = 0;
+    char* data = stat(filename, &st) == 0 ? mapFile(filename, &size) : NULL;
+    if (!data) {
+        printf("Nao foi possivel abrir %s\n", filename);
+        return;
+    }
+    obj_index_t idx;
+    openOBJIndex(filename, data, size, &st, &idx, 1);
+    for (size_t i = 0; i < idx.h.num_sections; i++) {
+        const obj_section_t* s = &idx.sections[i];
+        printf("%-40s %9zu faces  bytes %zu-%zu\n", s->name, (size_t)s->faces, (size_t)s->begin, (size_t)s->end);
+    }
+    printf("%zu v, %zu vt, %zu vn em %zu blocos de ate %d linhas\n", (size_t)idx.h.totals[0], (size_t)idx.h.totals[1],
+           (size_t)idx.h.totals[2], (size_t)idx.h.num_blocks, INDEX_BLOCK_LINES);
+    freeOBJIndex(&idx);
+    munmap(data, size);
+}
+
+// Aplica as passadas de uma lista separada por virgulas ("weld,degen,cache").
+void applyMeshPasses(const char* passes) {
+    char list[256];
+    snprintf(list, sizeof(list), "%s", passes);
+    for (char* name = strtok(list, ","); name; name = strtok(NULL, ",")) {
+        if (strcmp(name, "weld") == 0) {
+            weldMesh();
+        } else if (strcmp(name, "degen") == 0) {
+            cleanupMesh();
+        } else if (strcmp(name, "cache") == 0) {
+            double start = get_time_ms();
+            double before = vertexCacheACMR(g_faces, g_num_faces);
+            optimizeVertexCache();
+            printf("Passada cache: ACMR %.3f -> %.3f (FIFO de %d), %.1f ms\n", before,
+                   vertexCacheACMR(g_faces, g_num_faces), VCACHE_FIFO, get_time_ms() - start);
+        } else {
+            printf("Passada desconhecida: %s (use weld, degen, cache)\n", name);
+        }
+    }
+}
+
+// Escolhe o carregador pela extensao; o resto vai para loadOBJ (texto, comprimido ou stdin).
+// -weld-positions, -clean e -part rodam logo apos a carga, nessa ordem; num
+// .obj descomprimido, -part le so as secoes pedidas pelo indice (<obj>.idx).
+void loadMesh(const char* filename) {
+    int lazy = g_part_filter && has_extension(filename, ".obj") && loadOBJParts(filename, g_part_filter);
+    if (!lazy) {
+        if (has_extension(filename, ".ply")) loadPLY(filename);
+        else if (has_extension(filename, ".stl")) loadSTL(filename);
+        else if (has_extension(filename, ".glb")) loadGLB(filename);
+        else if (has_extension(filename, ".mcache")) loadMeshCache(filename);
+        else loadOBJ(filename);
+    }
+    if (g_weld_positions) weldMesh();
+    if (g_clean_faces) cleanupMesh();
+    if (g_part_filter && !lazy) selectPart(g_part_filter);
+}
+
+// -convert: carrega, aplica as passadas e grava em .obj ou .mcache.
+int convertMesh(const char* input, const char* output, const char* passes) {
+    loadMesh(input);
+    if (g_num_faces == 0) {
+        printf("%s: nenhuma face carregada\n", input);
+        return 0;
+    }
+    if (passes) applyMeshPasses(passes);
+    if (has_extension(output, ".mcache")) {
+        double start = get_time_ms();
+        if (!saveMeshCache(output)) return 0;
+        printf("%s: cache gravado em %.1f ms\n", output, get_time_ms() - start);
+        return 1;
+    }
+    return writeOBJ(output);
+}
+
+// Mede so a etapa de separacao de linhas sobre o arquivo inteiro em memoria.
+void benchmarkLineSplit(const char* filename) {
+    size_t size = 0;
+    char* data = mapFile(filename, &size);
+    if (!data) {
+        printf("Nao foi possivel abrir %s\n", filename);
+        return;
+    }
+    size_t ends[LINE_BATCH];
+    const char* names[2] = {"escalar", "SIMD"};
+    for (int variant = 0; variant < 2; variant++) {
+        size_t lines = 0;
+        int repeats = 0;
+        double start = get_time_ms(), elapsed = 0.0;
+        while (repeats < 3 || elapsed < 500.0) {
+            size_t pos = 0, n;
+            lines = 0;
+            while ((n = variant == 0 ? scanLinesScalar(data, size, &pos, ends, LINE_BATCH)
+                                     : scanLines(data, size, &pos, ends, LINE_BATCH)) > 0) lines += n;
+            repeats++;
+            elapsed = get_time_ms() - start;
+        }
+        printf("Separacao de linhas (%s): %zu linhas, %.1f MB, %.2f GB/s\n", names[variant], lines, size / 1048576.0,
+               (double)size * repeats / (elapsed / 1000.0) / 1e9);
+    }
+    munmap(data, size);
+}
+
+void quadric_add_plane(quadric_t* q, double a, double b, double c, double d, double w) {
+    q->a2 += w * a * a; q->ab += w * a * b; q->ac += w * a * c; q->ad += w * a * d;
+    q->b2 += w * b * b; q->bc += w * b * c; q->bd += w * b * d;
+    q->c2 += w * c * c; q->cd += w * c * d;
+    q->d2 += w * d * d;
+    q->w += w;
+}
+
+void quadric_add(quadric_t* q, const quadric_t* o) {
+    q->a2 += o->a2; q->ab += o->ab; q->ac += o->ac; q->ad += o->ad;
+    q->b2 += o->b2; q->bc += o->bc; q->bd += o->bd;
+    q->c2 += o->c2; q->cd += o->cd;
+    q->d2 += o->d2;
+    q->w += o->w;
+}
+
+double quadric_error(const quadric_t* q, const vec3f* p) {
+    double x = p->x, y = p->y, z = p->z;
+    double e = q->a2 * x * x + 2 * q->ab * x * y + 2 * q->ac * x * z + 2 * q->ad * x
+             + q->b2 * y * y + 2 * q->bc * y * z + 2 * q->bd * y
+             + q->c2 * z * z + 2 * q->cd * z
+             + q->d2;
+    return e > 0.0 ? e : 0.0;
+}
+
+int same_texcoord(int a, int b) {
+    if (a == b) return 1;
+    if (a <= 0 || b <= 0 || a > (int)g_num_texcoords || b > (int)g_num_texcoords) return 0;
+    return fabsf(g_texcoords[a - 1].u - g_texcoords[b - 1].u) < 1e-6f &&
+           fabsf(g_texcoords[a - 1].v - g_texcoords[b - 1].v) < 1e-6f;
+}
+
+int same_normal(int a, int b) {
+    if (a == b) return 1;
+    if (a <= 0 || b <= 0 || a > (int)g_num_normals || b > (int)g_num_normals) return 0;
+    vec3f* na = &g_normals[a - 1];
+    vec3f* nb = &g_normals[b - 1];
+    float la = sqrtf(na->x * na->x + na->y * na->y + na->z * na->z);
+    float lb = sqrtf(nb->x * nb->x + nb->y * nb->y + nb->z * nb->z);
+    if (la == 0.0f || lb == 0.0f) return 0;
+    return (na->x * nb->x + na->y * nb->y + na->z * nb->z) / (la * lb) > 0.999f;
+}
+
+typedef struct {
+    size_t num_vertices;
+    quadric_t* quadrics;
+    unsigned char* locked;
+    unsigned char* touched;
+    int* remap;
+    int* wedge_vt;
+    int* wedge_vn;
+} simplifier_t;
+
+// Uma passada de colapsos de meia-aresta (v -> vizinho) em ordem de custo.
+// Cada colapso trava o anel de vizinhos ate o fim da passada, entao a
+// adjacencia calculada no inicio continua valida para os testes de inversao.
+size_t collapseEdges(simplifier_t* s, face_t* faces, size_t num_faces, size_t target, float* max_error) {
+    size_t nv = s->num_vertices;
+    int* adj_offset = (int*)calloc(nv + 1, sizeof(int));
+    int* adj_faces = (int*)malloc(num_faces * 3 * sizeof(int));
+
+    for (size_t i = 0; i < num_faces; i++)
+        for (int k = 0; k < 3; k++) adj_offset[faces[i].v[k].v_idx - 1]++;
+    for (size_t v = 1; v <= nv; v++) adj_offset[v] += adj_offset[v - 1];
+    for (size_t i = num_faces; i-- > 0;)
+        for (int k = 0; k < 3; k++) adj_faces[--adj_offset[faces[i].v[k].v_idx - 1]] = (int)i;
+
+    uint64_t* keys = (uint64_t*)malloc(num_faces * 3 * sizeof(uint64_t));
+    uint64_t* tmp = (uint64_t*)malloc(num_faces * 3 * sizeof(uint64_t));
+    size_t num_edges = 0;
+    for (size_t i = 0; i < num_faces; i++) {
+        for (int k = 0; k < 3; k++) {
+            uint64_t a = faces[i].v[k].v_idx - 1;
+            uint64_t b = faces[i].v[(k + 1) % 3].v_idx - 1;
+            keys[num_edges++] = a < b ? (a << 32) | b : (b << 32) | a;
+        }
+    }
+    radix_sort_u64(keys, tmp, num_edges);
+
+    int* cand_from = (int*)malloc(num_edges * sizeof(int));
+    int* cand_to = (int*)malloc(num_edges * sizeof(int));
+    float* cand_cost = (float*)malloc(num_edges * sizeof(float));
+    size_t num_cand = 0;
+    for (size_t i = 0; i < num_edges; i++) {
+        if (i > 0 && keys[i] == keys[i - 1]) continue;
+        int a = (int)(keys[i] >> 32);
+        int b = (int)(keys[i] & 0xFFFFFFFFu);
+        quadric_t q = s->quadrics[a];
+        quadric_add(&q, &s->quadrics[b]);
+        double cost_ab = s->locked[a] ? INFINITY : quadric_error(&q, &g_vertices[b]);
+        double cost_ba = s->locked[b] ? INFINITY : quadric_error(&q, &g_vertices[a]);
+        if (isinf(cost_ab) && isinf(cost_ba)) continue;
+
+        int from = cost_ab <= cost_ba ? a : b;
+        double cost = cost_ab <= cost_ba ? cost_ab : cost_ba;
+        cand_from[num_cand] = from;
+        cand_to[num_cand] = from == a ? b : a;
+        cand_cost[num_cand] = (float)(q.w > 0.0 ? cost / q.w : cost);
+        num_cand++;
+    }
+
+    for (size_t i = 0; i < num_cand; i++) {
+        uint32_t bits;
+        memcpy(&bits, &cand_cost[i], sizeof(bits));
+        keys[i] = ((uint64_t)bits << 32) | i;
+    }
+    radix_sort_u64(keys, tmp, num_cand);
+
+    float threshold = num_cand > 0 ? cand_cost[keys[num_cand / 4] & 0xFFFFFFFFu] : 0.0f;
+    size_t remaining = num_faces;
+    size_t collapsed = 0;
+
+    for (size_t c = 0; c < num_cand && remaining > target; c++) {
+        size_t idx = keys[c] & 0xFFFFFFFFu;
+        int from = cand_from[idx];
+        int to = cand_to[idx];
+        float cost = cand_cost[idx];
+        if (c > 0 && cost > threshold) break;
+        if (s->touched[from] || s->touched[to]) continue;
+
+        int ok = 1;
+        int wedge = -1;
+        int wedge_corner = 0;
+        size_t removed = 0;
+        for (int j = adj_offset[from]; j < adj_offset[from + 1] && ok; j++) {
+            face_t* f = &faces[adj_faces[j]];
+            int corner_from = -1, corner_to = -1;
+            for (int k = 0; k < 3; k++) {
+                if (f->v[k].v_idx - 1 == from) corner_from = k;
+                if (f->v[k].v_idx - 1 == to) corner_to = k;
+            }
+            if (corner_to >= 0) {
+                if (wedge < 0) {
+                    wedge = adj_faces[j];
+                    wedge_corner = corner_to;
+                }
+                removed++;
+                continue;
+            }
+
+            vec3f* p[3];
+            for (int k = 0; k < 3; k++) p[k] = &g_vertices[f->v[k].v_idx - 1];
+            vec3f before = face_normal(p[0], p[1], p[2]);
+            p[corner_from] = &g_vertices[to];
+            vec3f after = face_normal(p[0], p[1], p[2]);
+            if (before.x * after.x + before.y * after.y + before.z * after.z <= 0.0f) ok = 0;
+        }
+        if (!ok || wedge < 0) continue;
+
+        s->remap[from] = to;
+        s->wedge_vt[from] = faces[wedge].v[wedge_corner].vt_idx;
+        s->wedge_vn[from] = faces[wedge].v[wedge_corner].vn_idx;
+        quadric_add(&s->quadrics[to], &s->quadrics[from]);
+        for (int j = adj_offset[from]; j < adj_offset[from + 1]; j++) {
+            face_t* f = &faces[adj_faces[j]];
+            for (int k = 0; k < 3; k++) s->touched[f->v[k].v_idx - 1] = 1;
+        }
+        s->touched[to] = 1;
+
+        float error = sqrtf(cost);
+        if (error > *max_error) *max_error = error;
+        remaining -= removed;
+        collapsed++;
+    }
+
+    size_t out = 0;
+    if (collapsed > 0) {
+        for (size_t i = 0; i < num_faces; i++) {
+            face_t f = faces[i];
+            for (int k = 0; k < 3; k++) {
+                int v = f.v[k].v_idx - 1;
+                if (s->remap[v] != v) {
+                    f.v[k].v_idx = s->remap[v] + 1;
+                    f.v[k].vt_idx = s->wedge_vt[v];
+                    f.v[k].vn_idx = s->wedge_vn[v];
+                }
+            }
+            if (f.v[0].v_idx == f.v[1].v_idx || f.v[1].v_idx == f.v[2].v_idx || f.v[0].v_idx == f.v[2].v_idx) continue;
+            faces[out++] = f;
+        }
+        for (size_t v = 0; v < nv; v++) s->remap[v] = (int)v;
+    } else {
+        out = num_faces;
+    }
+    memset(s->touched, 0, nv);
+
+    free(adj_offset);
+    free(adj_faces);
+    free(keys);
+    free(tmp);
+    free(cand_from);
+    free(cand_to);
+    free(cand_cost);
+    return out;
+}
+
+void buildLODs(int levels) {
+    size_t nv = g_num_vertices;
+    size_t nf = g_num_faces;
+
+    g_lods[0] = (lod_t){g_faces, nf, 0.0f};
+    g_num_lods = 1;
+    if (levels > MAX_LODS) levels = MAX_LODS;
+    if (levels < 2 || nf == 0) return;
+
+    double start = get_time_ms();
+    simplifier_t s;
+    s.num_vertices = nv;
+    s.quadrics = (quadric_t*)calloc(nv, sizeof(quadric_t));
+    s.locked = (unsigned char*)calloc(nv, 1);
+    s.touched = (unsigned char*)calloc(nv, 1);
+    s.remap = (int*)malloc(nv * sizeof(int));
+    s.wedge_vt = (int*)malloc(nv * sizeof(int));
+    s.wedge_vn = (int*)malloc(nv * sizeof(int));
+    for (size_t v = 0; v < nv; v++) {
+        s.remap[v] = (int)v;
+        s.wedge_vt[v] = -1;
+        s.wedge_vn[v] = -1;
+    }
+
+    face_t* faces = (face_t*)malloc(nf * sizeof(face_t));
+    memcpy(faces, g_faces, nf * sizeof(face_t));
+
+    // Quadricas de plano ponderadas pela area; costuras de UV e quinas de
+    // normal (mesma posicao com vt/vn diferentes) ficam travadas.
+    for (size_t i = 0; i < nf; i++) {
+        face_t* f = &faces[i];
+        vec3f* p0 = &g_vertices[f->v[0].v_idx - 1];
+        vec3f n = face_normal(p0, &g_vertices[f->v[1].v_idx - 1], &g_vertices[f->v[2].v_idx - 1]);
+        double len = sqrt((double)n.x * n.x + (double)n.y * n.y + (double)n.z * n.z);
+        if (len > 0.0) {
+            double a = n.x / len, b = n.y / len, c = n.z / len;
+            double d = -(a * p0->x + b * p0->y + c * p0->z);
+            for (int k = 0; k < 3; k++) quadric_add_plane(&s.quadrics[f->v[k].v_idx - 1], a, b, c, d, len * 0.5);
+        }
+
+        for (int k = 0; k < 3; k++) {
+            int v = f->v[k].v_idx - 1;
+            if (s.wedge_vt[v] == -1 && s.wedge_vn[v] == -1) {
+                s.wedge_vt[v] = f->v[k].vt_idx;
+                s.wedge_vn[v] = f->v[k].vn_idx;
+            } else if (!same_texcoord(s.wedge_vt[v], f->v[k].vt_idx) || !same_normal(s.wedge_vn[v], f->v[k].vn_idx)) {
+                s.locked[v] = 1;
+            }
+        }
+    }
+
+    // Arestas de borda ou nao-manifold tambem travam os dois vertices.
+    uint64_t* keys = (uint64_t*)malloc(nf * 3 * sizeof(uint64_t));
+    uint64_t* tmp = (uint64_t*)malloc(nf * 3 * sizeof(uint64_t));
+    for (size_t i = 0; i < nf; i++) {
+        for (int k = 0; k < 3; k++) {
+            uint64_t a = faces[i].v[k].v_idx - 1;
+            uint64_t b = faces[i].v[(k + 1) % 3].v_idx - 1;
+            keys[i * 3 + k] = a < b ? (a << 32) | b : (b << 32) | a;
+        }
+    }
+    radix_sort_u64(keys, tmp, nf * 3);
+    for (size_t i = 0; i < nf * 3;) {
+        size_t j = i;
+        while (j < nf * 3 && keys[j] == keys[i]) j++;
+        if (j - i != 2) {
+            s.locked[keys[i] >> 32] = 1;
+            s.locked[keys[i] & 0xFFFFFFFFu] = 1;
+        }
+        i = j;
+    }
+    free(keys);
+    free(tmp);
+
+    size_t current = nf;
+    float max_error = 0.0f;
+    int stuck = 0;
+    for (int level = 1; level < levels; level++) {
+        size_t target = nf >> level;
+        while (current > target && !stuck) {
+            size_t next = collapseEdges(&s, faces, current, target, &max_error);
+            stuck = next == current;
+            current = next;
+        }
+
+        face_t* lod_faces = (face_t*)malloc(current * sizeof(face_t));
+        memcpy(lod_faces, faces, current * sizeof(face_t));
+        g_lods[level] = (lod_t){lod_faces, current, max_error};
+        g_num_lods++;
+
+        printf("LOD %d: %zu faces (%.1f%%), erro %.6g (%.4f%% do modelo), %.1f ms\n",
+               level, current, 100.0 * current / nf, max_error,
+               g_size > 0.0f ? 100.0 * max_error / g_size : 0.0, get_time_ms() - start);
+        if (stuck) break;
+    }
+
+    free(faces);
+    free(s.quadrics);
+    free(s.locked);
+    free(s.touched);
+    free(s.remap);
+    free(s.wedge_vt);
+    free(s.wedge_vn);
+}
+
+int selectLOD() {
+    if (g_num_lods <= 1) return 0;
+
+    float distance = g_size * 2.0f - g_size * 0.5f;
+    if (distance <= 0.0f) return 0;
+    float pixels_per_unit = (g_window_height * g_render_scale * 0.5f) / (distance * tanf(30.0f * (float)M_PI / 180.0f));
+
+    int lod = 0;
+    for (int i = 1; i < g_num_lods; i++) {
+        if (g_lods[i].error * pixels_per_unit <= g_lod_pixel_error) lod = i;
+    }
+    return lod;
+}
+
+void drawFaces(const face_t* faces, size_t num_faces, size_t stride, int textured) {
+    for (size_t i = 0; i < num_faces; i += stride) {
+        const face_t* f = &faces[i];
+        
+        if (textured) {
+            if (f->material_id >= 0) {
+                glBindTexture(GL_TEXTURE_2D, g_materials[f->material_id].texture_id);
+            } else {
+                glBindTexture(GL_TEXTURE_2D, g_default_texture);
+            }
+        }
+        
+        vec3f fn = {0.0f, 0.0f, 1.0f};
+        if (f->v[0].vn_idx <= 0 || f->v[1].vn_idx <= 0 || f->v[2].vn_idx <= 0) {
+            fn = face_normal(&g_vertices[f->v[0].v_idx - 1], &g_vertices[f->v[1].v_idx - 1], &g_vertices[f->v[2].v_idx - 1]);
+            float len = sqrtf(fn.x * fn.x + fn.y * fn.y + fn.z * fn.z);
+            if (len > 0.0f) fn = (vec3f){fn.x / len, fn.y / len, fn.z / len};
+        }
+
+        glBegin(GL_TRIANGLES);
+        for (int v = 0; v < 3; v++) {
+            const face_vertex_t* fv = &f->v[v];
+            
+            int vt_idx = fv->vt_idx - 1;
+            int vn_idx = fv->vn_idx - 1;
+            int v_idx = fv->v_idx - 1;
+
+            if (textured) {
+                if (vt_idx >= 0) glTexCoord2f(g_texcoords[vt_idx].u, g_texcoords[vt_idx].v);
+                else glTexCoord2f(0.0f, 0.0f);
+            }
+            if (g_vertex_colors) {
+                const vec3f* c = &g_vertex_colors[v_idx];
+                glColor3f(0.8f * c->x, 0.8f * c->y, 0.8f * c->z);
+            }
+            if (vn_idx >= 0) glNormal3f(g_normals[vn_idx].x, g_normals[vn_idx].y, g_normals[vn_idx].z);
+            else glNormal3f(fn.x, fn.y, fn.z);
+            glVertex3f(g_vertices[v_idx].x, g_vertices[v_idx].y, g_vertices[v_idx].z);
+        }
+        glEnd();
+    }
+}
+
+#define SW_TILE_SIZE 64
+#define SW_ATTRIBS 7
+
+typedef struct {
+    float edge_a[3], edge_b[3], edge_c[3];
+    float attr0[SW_ATTRIBS], attr_d1[SW_ATTRIBS], attr_d2[SW_ATTRIBS];
+    const image_t* image;
+    int min_x, min_y, max_x, max_y;
+} sw_triangle_t;
+
+typedef struct {
+    sw_triangle_t* tris;
+    size_t num_tris, cap_tris;
+    int** bins;
+    int* bin_count;
+    int* bin_cap;
+} sw_bin_set_t;
+
+typedef struct {
+    int head, tail;
+    pthread_mutex_t lock;
+} sw_tile_queue_t;
+
+typedef struct {
+    float clip[4];
+    float eye[3];
+} sw_vertex_t;
+
+typedef struct {
+    int width, height;
+    int tiles_x, tiles_y;
+    unsigned char* color;
+    float* depth;
+    sw_vertex_t* vertices;
+    size_t num_vertices;
+    sw_bin_set_t* bin_sets;
+    sw_tile_queue_t* queues;
+    int num_sets;
+
+    const face_t* faces;
+    size_t num_faces, stride;
+    int textured;
+    float mvp[16], mv[16];
+    float light[4];
+    double last_frame_ms;
+} sw_renderer_t;
+
+enum { BACKEND_GL, BACKEND_SW };
+int g_backend = BACKEND_GL;
+sw_renderer_t g_sw;
+
+void sampleImage(const image_t* image, float u, float v, float* rgb) {
+    float x = (u - floorf(u)) * image->width - 0.5f;
+    float y = (v - floorf(v)) * image->height - 0.5f;
+    int x0 = (int)floorf(x), y0 = (int)floorf(y);
+    float fx = x - x0, fy = y - y0;
+    int x1 = x0 + 1, y1 = y0 + 1;
+    x0 = (x0 % image->width + image->width) % image->width;
+    x1 = x1 % image->width;
+    y0 = (y0 % image->height + image->height) % image->height;
+    y1 = y1 % image->height;
+
+    int ch = image->channels;
+    const unsigned char* p00 = image->pixels + ((size_t)y0 * image->width + x0) * ch;
+    const unsigned char* p10 = image->pixels + ((size_t)y0 * image->width + x1) * ch;
+    const unsigned char* p01 = image->pixels + ((size_t)y1 * image->width + x0) * ch;
+    const unsigned char* p11 = image->pixels + ((size_t)y1 * image->width + x1) * ch;
+    for (int c = 0; c < 3; c++) {
+        int k = ch >= 3 ? c : 0;
+        float top = p00[k] + (p10[k] - p00[k]) * fx;
+        float bottom = p01[k] + (p11[k] - p01[k]) * fx;
+        rgb[c] = (top + (bottom - top) * fy) * (1.0f / 255.0f);
+    }
+}
+
+// Iluminacao por vertice equivalente ao pipeline fixo com a configuracao de
+// main: material padrao (ambiente 0.2, difuso 0.8, sem especular), modelo de
+// luz ambiente 0.2 e GL_LIGHT0 branca.
+float gouraudLight(const float* eye_pos, const float* eye_normal, const float* light) {
+    float l[3] = {light[0] - eye_pos[0], light[1] - eye_pos[1], light[2] - eye_pos[2]};
+    if (light[3] == 0.0f) {
+        l[0] = light[0]; l[1] = light[1]; l[2] = light[2];
+    }
+    float len = sqrtf(l[0] * l[0] + l[1] * l[1] + l[2] * l[2]);
+    float ndotl = len > 0.0f ? (eye_normal[0] * l[0] + eye_normal[1] * l[1] + eye_normal[2] * l[2]) / len : 0.0f;
+    float c = 0.2f * 0.2f + 0.2f * 1.0f + 0.8f * (ndotl > 0.0f ? ndotl : 0.0f);
+    return c > 1.0f ? 1.0f : c;
+}
+
+void swTransformJob(void* ctx, int thread_index) {
+    sw_renderer_t* sw = (sw_renderer_t*)ctx;
+    int threads = numThreads();
+    size_t begin = sw->num_vertices * thread_index / threads;
+    size_t end = sw->num_vertices * (thread_index + 1) / threads;
+    const float* m = sw->mvp;
+    const float* e = sw->mv;
+
+    for (size_t i = begin; i < end; i++) {
+        vec3f p = g_vertices[i];
+        sw_vertex_t* out = &sw->vertices[i];
+        for (int r = 0; r < 4; r++) out->clip[r] = m[r] * p.x + m[4 + r] * p.y + m[8 + r] * p.z + m[12 + r];
+        for (int r = 0; r < 3; r++) out->eye[r] = e[r] * p.x + e[4 + r] * p.y + e[8 + r] * p.z + e[12 + r];
+    }
+}
+
+void swBinTriangle(sw_renderer_t* sw, sw_bin_set_t* set, const face_t* f) {
+    const sw_vertex_t* v[3];
+    float sx[3], sy[3], attr[3][SW_ATTRIBS];
+
+    for (int k = 0; k < 3; k++) {
+        v[k] = &sw->vertices[f->v[k].v_idx - 1];
+        if (v[k]->clip[3] <= 1e-6f) return;
+    }
+    for (int c = 0; c < 3; c++) {
+        if (v[0]->clip[c] > v[0]->clip[3] && v[1]->clip[c] > v[1]->clip[3] && v[2]->clip[c] > v[2]->clip[3]) return;
+        if (v[0]->clip[c] < -v[0]->clip[3] && v[1]->clip[c] < -v[1]->clip[3] && v[2]->clip[c] < -v[2]->clip[3]) return;
+    }
+    // Sem recorte contra o plano near: triangulos que o cruzam sao descartados.
+    for (int k = 0; k < 3; k++)
+        if (v[k]->clip[2] < -v[k]->clip[3]) return;
+
+    float face_n[3] = {0.0f, 0.0f, 0.0f};
+    if (f->v[0].vn_idx <= 0 || f->v[1].vn_idx <= 0 || f->v[2].vn_idx <= 0) {
+        vec3f a = {v[0]->eye[0], v[0]->eye[1], v[0]->eye[2]};
+        vec3f b = {v[1]->eye[0], v[1]->eye[1], v[1]->eye[2]};
+        vec3f c = {v[2]->eye[0], v[2]->eye[1], v[2]->eye[2]};
+        vec3f n = face_normal(&a, &b, &c);
+        float len = sqrtf(n.x * n.x + n.y * n.y + n.z * n.z);
+        if (len > 0.0f) {
+            face_n[0] = n.x / len; face_n[1] = n.y / len; face_n[2] = n.z / len;
+        }
+    }
+
+    for (int k = 0; k < 3; k++) {
+        float inv_w = 1.0f / v[k]->clip[3];
+        sx[k] = (v[k]->clip[0] * inv_w * 0.5f + 0.5f) * sw->width;
+        sy[k] = (v[k]->clip[1] * inv_w * 0.5f + 0.5f) * sw->height;
+
+        float u = 0.0f, t = 0.0f;
+        int vt = f->v[k].vt_idx - 1;
+        if (sw->textured && vt >= 0 && vt < (int)g_num_texcoords) {
+            u = g_texcoords[vt].u;
+            t = g_texcoords[vt].v;
+        }
+
+        float n[3] = {face_n[0], face_n[1], face_n[2]};
+        int vn = f->v[k].vn_idx - 1;
+        if (vn >= 0 && vn < (int)g_num_normals) {
+            vec3f src = g_normals[vn];
+            for (int r = 0; r < 3; r++) n[r] = sw->mv[r] * src.x + sw->mv[4 + r] * src.y + sw->mv[8 + r] * src.z;
+        }
+        float light = gouraudLight(v[k]->eye, n, sw->light);
+
+        attr[k][0] = v[k]->clip[2] * inv_w * 0.5f + 0.5f;
+        attr[k][1] = inv_w;
+        attr[k][2] = u * inv_w;
+        attr[k][3] = t * inv_w;
+        float color[3] = {1.0f, 1.0f, 1.0f};
+        if (g_vertex_colors) {
+            const vec3f* c = &g_vertex_colors[f->v[k].v_idx - 1];
+            color[0] = c->x; color[1] = c->y; color[2] = c->z;
+        }
+        attr[k][4] = light * color[0] * inv_w;
+        attr[k][5] = light * color[1] * inv_w;
+        attr[k][6] = light * color[2] * inv_w;
+    }
+
+    float area = (sx[1] - sx[0]) * (sy[2] - sy[0]) - (sx[2] - sx[0]) * (sy[1] - sy[0]);
+    if (fabsf(area) < 1e-8f) return;
+
+    float min_xf = fminf(sx[0], fminf(sx[1], sx[2]));
+    float max_xf = fmaxf(sx[0], fmaxf(sx[1], sx[2]));
+    float min_yf = fminf(sy[0], fminf(sy[1], sy[2]));
+    float max_yf = fmaxf(sy[0], fmaxf(sy[1], sy[2]));
+    int min_x = (int)fmaxf(0.0f, floorf(min_xf));
+    int min_y = (int)fmaxf(0.0f, floorf(min_yf));
+    int max_x = (int)fminf((float)sw->width - 1, ceilf(max_xf));
+    int max_y = (int)fminf((float)sw->height - 1, ceilf(max_yf));
+    if (min_x > max_x || min_y > max_y) return;
+
+    if (set->num_tris == set->cap_tris) {
+        set->cap_tris = set->cap_tris ? set->cap_tris * 2 : 1024;
+        set->tris = (sw_triangle_t*)realloc(set->tris, set->cap_tris * sizeof(sw_triangle_t));
+    }
+    int tri_index = (int)set->num_tris++;
+    sw_triangle_t* t = &set->tris[tri_index];
+
+    // Funcoes de aresta normalizadas pela area: avaliadas no pixel dao
+    // diretamente as coordenadas baricentricas dos vertices 0, 1 e 2.
+    float inv_area = 1.0f / area;
+    for (int k = 0; k < 3; k++) {
+        int a = (k + 1) % 3, b = (k + 2) % 3;
+        t->edge_a[k] = -(sy[b] - sy[a]) * inv_area;
+        t->edge_b[k] = (sx[b] - sx[a]) * inv_area;
+        t->edge_c[k] = ((sy[b] - sy[a]) * sx[a] - (sx[b] - sx[a]) * sy[a]) * inv_area;
+    }
+    for (int i = 0; i < SW_ATTRIBS; i++) {
+        t->attr0[i] = attr[0][i];
+        t->attr_d1[i] = attr[1][i] - attr[0][i];
+        t->attr_d2[i] = attr[2][i] - attr[0][i];
+    }
+    t->image = NULL;
+    if (sw->textured) {
+        t->image = &g_default_image;
+        if (f->material_id >= 0 && g_materials[f->material_id].image.pixels) t->image = &g_materials[f->material_id].image;
+    }
+    t->min_x = min_x; t->min_y = min_y; t->max_x = max_x; t->max_y = max_y;
+
+    for (int ty = min_y / SW_TILE_SIZE; ty <= max_y / SW_TILE_SIZE; ty++) {
+        for (int tx = min_x / SW_TILE_SIZE; tx <= max_x / SW_TILE_SIZE; tx++) {
+            int tile = ty * sw->tiles_x + tx;
+            if (set->bin_count[tile] == set->bin_cap[tile]) {
+                set->bin_cap[tile] = set->bin_cap[tile] ? set->bin_cap[tile] * 2 : 64;
+                set->bins[tile] = (int*)realloc(set->bins[tile], set->bin_cap[tile] * sizeof(int));
+            }
+            set->bins[tile][set->bin_count[tile]++] = tri_index;
+        }
+    }
+}
+
+void swBinJob(void* ctx, int thread_index) {
+    sw_renderer_t* sw = (sw_renderer_t*)ctx;
+    sw_bin_set_t* set = &sw->bin_sets[thread_index];
+    int threads = numThreads();
+    size_t count = (sw->num_faces + sw->stride - 1) / sw->stride;
+    size_t begin = count * thread_index / threads;
+    size_t end = count * (thread_index + 1) / threads;
+
+    set->num_tris = 0;
+    memset(set->bin_count, 0, sw->tiles_x * sw->tiles_y * sizeof(int));
+    for (size_t i = begin; i < end; i++) swBinTriangle(sw, set, &sw->faces[i * sw->stride]);
+}
+
+void swRasterTriangle(sw_renderer_t* sw, const sw_triangle_t* t, int x0, int y0, int x1, int y1) {
+    if (t->min_x > x0) x0 = t->min_x;
+    if (t->min_y > y0) y0 = t->min_y;
+    if (t->max_x < x1) x1 = t->max_x;
+    if (t->max_y < y1) y1 = t->max_y;
+
+    for (int y = y0; y <= y1; y++) {
+        float py = y + 0.5f;
+        for (int x = x0; x <= x1; x += 4) {
+            float attr[SW_ATTRIBS][4];
+            int covered[4];
+#ifdef __SSE2__
+            __m128 px = _mm_add_ps(_mm_set1_ps(x + 0.5f), _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f));
+            __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+            __m128 bary[3];
+            for (int k = 0; k < 3; k++) {
+                bary[k] = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t->edge_a[k]), px),
+                                     _mm_set1_ps(t->edge_b[k] * py + t->edge_c[k]));
+                inside = _mm_and_ps(inside, _mm_cmpge_ps(bary[k], _mm_setzero_ps()));
+            }
+            int mask = _mm_movemask_ps(inside);
+            if (mask == 0) continue;
+
+            __m128 inv_w = _mm_add_ps(_mm_set1_ps(t->attr0[1]),
+                                      _mm_add_ps(_mm_mul_ps(bary[1], _mm_set1_ps(t->attr_d1[1])),
+                                                 _mm_mul_ps(bary[2], _mm_set1_ps(t->attr_d2[1]))));
+            __m128 w = _mm_div_ps(_mm_set1_ps(1.0f), inv_w);
+            for (int i = 0; i < SW_ATTRIBS; i++) {
+                __m128 a = _mm_add_ps(_mm_set1_ps(t->attr0[i]),
+                                      _mm_add_ps(_mm_mul_ps(bary[1], _mm_set1_ps(t->attr_d1[i])),
+                                                 _mm_mul_ps(bary[2], _mm_set1_ps(t->attr_d2[i]))));
+                if (i >= 2) a = _mm_mul_ps(a, w);
+                _mm_storeu_ps(attr[i], a);
+            }
+            for (int lane = 0; lane < 4; lane++) covered[lane] = (mask >> lane) & 1;
+#else
+            float b[3][4];
+            int any = 0;
+            for (int lane = 0; lane < 4; lane++) {
+                float px = x + lane + 0.5f;
+                for (int k = 0; k < 3; k++) b[k][lane] = t->edge_a[k] * px + t->edge_b[k] * py + t->edge_c[k];
+                covered[lane] = b[0][lane] >= 0.0f && b[1][lane] >= 0.0f && b[2][lane] >= 0.0f;
+                any |= covered[lane];
+                float w = 1.0f / (t->attr0[1] + b[1][lane] * t->attr_d1[1] + b[2][lane] * t->attr_d2[1]);
+                for (int i = 0; i < SW_ATTRIBS; i++) {
+                    attr[i][lane] = t->attr0[i] + b[1][lane] * t->attr_d1[i] + b[2][lane] * t->attr_d2[i];
+                    if (i >= 2) attr[i][lane] *= w;
+                }
+            }
+            if (!any) continue;
+#endif
+            for (int lane = 0; lane < 4 && x + lane <= x1; lane++) {
+                if (!covered[lane]) continue;
+                size_t pixel = (size_t)y * sw->width + x + lane;
+                float z = attr[0][lane];
+                if (z >= sw->depth[pixel]) continue;
+                sw->depth[pixel] = z;
+
+                float rgb[3] = {attr[4][lane], attr[5][lane], attr[6][lane]};
+                if (t->image) {
+                    float tex[3];
+                    sampleImage(t->image, attr[2][lane], attr[3][lane], tex);
+                    for (int c = 0; c < 3; c++) rgb[c] *= tex[c];
+                }
+                unsigned char* out = &sw->color[pixel * 4];
+                for (int c = 0; c < 3; c++) {
+                    float value = rgb[c] * 255.0f + 0.5f;
+                    out[c] = value >= 255.0f ? 255 : (value <= 0.0f ? 0 : (unsigned char)value);
+                }
+                out[3] = 255;
+            }
+        }
+    }
+}
+
+void swRasterTile(sw_renderer_t* sw, int tile) {
+    int x0 = (tile % sw->tiles_x) * SW_TILE_SIZE;
+    int y0 = (tile / sw->tiles_x) * SW_TILE_SIZE;
+    int x1 = x0 + SW_TILE_SIZE - 1;
+    int y1 = y0 + SW_TILE_SIZE - 1;
+    if (x1 >= sw->width) x1 = sw->width - 1;
+    if (y1 >= sw->height) y1 = sw->height - 1;
+
+    for (int y = y0; y <= y1; y++) {
+        for (int x = x0; x <= x1; x++) {
+            size_t pixel = (size_t)y * sw->width + x;
+            sw->depth[pixel] = 1.0f;
+            unsigned char* out = &sw->color[pixel * 4];
+            out[0] = out[1] = out[2] = 26;
+            out[3] = 255;
+        }
+    }
+
+    for (int s = 0; s < sw->num_sets; s++) {
+        sw_bin_set_t* set = &sw->bin_sets[s];
+        for (int i = 0; i < set->bin_count[tile]; i++) {
+            swRasterTriangle(sw, &set->tris[set->bins[tile][i]], x0, y0, x1, y1);
+        }
+    }
+}
+
+int swPopTile(sw_tile_queue_t* q, int steal) {
+    int tile = -1;
+    pthread_mutex_lock(&q->lock);
+    if (q->head < q->tail) tile = steal ? --q->tail : q->head++;
+    pthread_mutex_unlock(&q->lock);
+    return tile;
+}
+
+// Cada thread consome sua fila de tiles pela frente; quando esvazia, rouba
+// do fim da fila das outras.
+void swRasterJob(void* ctx, int thread_index) {
+    sw_renderer_t* sw = (sw_renderer_t*)ctx;
+    int tile;
+    while ((tile = swPopTile(&sw->queues[thread_index], 0)) >= 0) swRasterTile(sw, tile);
+
+    for (int i = 1; i < sw->num_sets; i++) {
+        sw_tile_queue_t* victim = &sw->queues[(thread_index + i) % sw->num_sets];
+        while ((tile = swPopTile(victim, 1)) >= 0) swRasterTile(sw, tile);
+    }
+}
+
+void swResize(sw_renderer_t* sw, int width, int height) {
+    int threads = numThreads();
+    if (sw->width == width && sw->height == height && sw->num_sets == threads) return;
+
+    for (int s = 0; s < sw->num_sets; s++) {
+        for (int t = 0; t < sw->tiles_x * sw->tiles_y; t++) free(sw->bin_sets[s].bins[t]);
+        free(sw->bin_sets[s].bins);
+        free(sw->bin_sets[s].bin_count);
+        free(sw->bin_sets[s].bin_cap);
+        free(sw->bin_sets[s].tris);
+        pthread_mutex_destroy(&sw->queues[s].lock);
+    }
+    free(sw->bin_sets);
+    free(sw->queues);
+
+    sw->width = width;
+    sw->height = height;
+    sw->tiles_x = (width + SW_TILE_SIZE - 1) / SW_TILE_SIZE;
+    sw->tiles_y = (height + SW_TILE_SIZE - 1) / SW_TILE_SIZE;
+    sw->color = (unsigned char*)realloc(sw->color, (size_t)width * height * 4);
+    sw->depth = (float*)realloc(sw->depth, (size_t)width * height * sizeof(float));
+
+    int tiles = sw->tiles_x * sw->tiles_y;
+    sw->num_sets = threads;
+    sw->bin_sets = (sw_bin_set_t*)calloc(threads, sizeof(sw_bin_set_t));
+    sw->queues = (sw_tile_queue_t*)calloc(threads, sizeof(sw_tile_queue_t));
+    for (int s = 0; s < threads; s++) {
+        sw->bin_sets[s].bins = (int**)calloc(tiles, sizeof(int*));
+        sw->bin_sets[s].bin_count = (int*)calloc(tiles, sizeof(int));
+        sw->bin_sets[s].bin_cap = (int*)calloc(tiles, sizeof(int));
+        pthread_mutex_init(&sw->queues[s].lock, NULL);
+    }
+}
+
+// Rasteriza com as matrizes e a luz atuais do GL (lidas com glGet), entao
+// LOD, rotacao e jitter do acumulo valem igualmente para os dois backends.
+void swRenderFaces(const face_t* faces, size_t num_faces, size_t stride, int textured, int width, int height) {
+    sw_renderer_t* sw = &g_sw;
+    double start = get_time_ms();
+    swResize(sw, width, height);
+
+    float projection[16];
+    glGetFloatv(GL_PROJECTION_MATRIX, projection);
+    glGetFloatv(GL_MODELVIEW_MATRIX, sw->mv);
+    glGetLightfv(GL_LIGHT0, GL_POSITION, sw->light);
+    mat4_mul(sw->mvp, projection, sw->mv);
+
+    if (sw->num_vertices != g_num_vertices) {
+        sw->num_vertices = g_num_vertices;
+        sw->vertices = (sw_vertex_t*)realloc(sw->vertices, g_num_vertices * sizeof(sw_vertex_t));
+    }
+    sw->faces = faces;
+    sw->num_faces = num_faces;
+    sw->stride = stride;
+    sw->textured = textured;
+
+    runParallel(swTransformJob, sw);
+    runParallel(swBinJob, sw);
+
+    int tiles = sw->tiles_x * sw->tiles_y;
+    for (int s = 0; s < sw->num_sets; s++) {
+        sw->queues[s].head = tiles * s / sw->num_sets;
+        sw->queues[s].tail = tiles * (s + 1) / sw->num_sets;
+    }
+    runParallel(swRasterJob, sw);
+
+    glPushAttrib(GL_ENABLE_BIT | GL_PIXEL_MODE_BIT);
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_LIGHTING);
+    glDisable(GL_TEXTURE_2D);
+    glWindowPos2i(0, 0);
+    glPixelZoom((float)g_window_width / width, (float)g_window_height / height);
+    glDrawPixels(width, height, GL_RGBA, GL_UNSIGNED_BYTE, sw->color);
+    glPopAttrib();
+
+    sw->last_frame_ms = get_time_ms() - start;
+}
+
+// Iluminacao pre-calculada (modo quiosque): a luz fica fixa no espaco do
+// modelo, entao o difuso de cada vertice unico (par v/vn) so muda quando a
+// luz muda. Cada canto de face aponta para seu vertice unico em lod_t.wedges.
+typedef struct {
+    size_t count, padded;
+    float* px; float* py; float* pz;
+    float* nx; float* ny; float* nz;
+    float* intensity;
+    int* vertex;
+    vec3f* colors;
+    float light[3];
+    int valid;
+} baked_lighting_t;
+
+baked_lighting_t g_baked;
+int g_kiosk = 0;
+float g_kiosk_light[3];
+
+static int wedge_lookup(const uint64_t* keys, size_t n, uint64_t key) {
+    size_t lo = 0, hi = n;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (keys[mid] < key) lo = mid + 1;
+        else hi = mid;
+    }
+    return (int)lo;
+}
+
+void buildWedges() {
+    baked_lighting_t* b = &g_baked;
+    if (g_num_lods == 0) {
+        g_lods[0] = (lod_t){g_faces, g_num_faces, 0.0f};
+        g_num_lods = 1;
+    }
+
+    size_t corners = 0;
+    for (int l = 0; l < g_num_lods; l++) corners += g_lods[l].num_faces * 3;
+    uint64_t* keys = (uint64_t*)malloc(corners * sizeof(uint64_t));
+    uint64_t* tmp = (uint64_t*)malloc(corners * sizeof(uint64_t));
+    size_t n = 0;
+    for (int l = 0; l < g_num_lods; l++) {
+        for (size_t i = 0; i < g_lods[l].num_faces; i++) {
+            const face_t* f = &g_lods[l].faces[i];
+            for (int k = 0; k < 3; k++) keys[n++] = (uint64_t)f->v[k].v_idx << 32 | (uint32_t)f->v[k].vn_idx;
+        }
+    }
+    radix_sort_u64(keys, tmp, n);
+    size_t unique = 0;
+    for (size_t i = 0; i < n; i++)
+        if (unique == 0 || keys[i] != keys[unique - 1]) keys[unique++] = keys[i];
+
+    for (int l = 0; l < g_num_lods; l++) {
+        lod_t* lod = &g_lods[l];
+        lod->wedges = (int*)realloc(lod->wedges, lod->num_faces * 3 * sizeof(int));
+        for (size_t i = 0; i < lod->num_faces; i++) {
+            const face_t* f = &lod->faces[i];
+            for (int k = 0; k < 3; k++)
+                lod->wedges[i * 3 + k] = wedge_lookup(keys, unique, (uint64_t)f->v[k].v_idx << 32 | (uint32_t)f->v[k].vn_idx);
+        }
+    }
+
+    // Normal suave do vertice para os cantos sem vn.
+    vec3f* smooth = (vec3f*)calloc(g_num_vertices + 1, sizeof(vec3f));
+    for (size_t i = 0; i < g_num_faces; i++) {
+        const face_t* f = &g_faces[i];
+        vec3f n = face_normal(&g_vertices[f->v[0].v_idx - 1], &g_vertices[f->v[1].v_idx - 1], &g_vertices[f->v[2].v_idx - 1]);
+        for (int k = 0; k < 3; k++) {
+            vec3f* dst = &smooth[f->v[k].v_idx - 1];
+            dst->x += n.x; dst->y += n.y; dst->z += n.z;
+        }
+    }
+
+    // Estrutura de arrays com preenchimento ate multiplo de 4 para o SSE.
+    b->count = unique;
+    b->padded = (unique + 3) & ~(size_t)3;
+    float** arrays[7] = {&b->px, &b->py, &b->pz, &b->nx, &b->ny, &b->nz, &b->intensity};
+    for (int a = 0; a < 7; a++) *arrays[a] = (float*)realloc(*arrays[a], b->padded * sizeof(float));
+    b->vertex = (int*)realloc(b->vertex, b->padded * sizeof(int));
+    b->colors = (vec3f*)realloc(b->colors, b->padded * sizeof(vec3f));
+    for (size_t w = 0; w < b->padded; w++) {
+        vec3f p = {0.0f, 0.0f, 0.0f}, nv = {0.0f, 0.0f, 0.0f};
+        int v = 0;
+        if (w < unique) {
+            v = (int)(keys[w] >> 32) - 1;
+            int vn = (int)(uint32_t)keys[w] - 1;
+            p = g_vertices[v];
+            nv = vn >= 0 && vn < (int)g_num_normals ? g_normals[vn] : smooth[v];
+        }
+        float len = sqrtf(nv.x * nv.x + nv.y * nv.y + nv.z * nv.z);
+        if (len > 0.0f) len = 1.0f / len;
+        b->px[w] = p.x; b->py[w] = p.y; b->pz[w] = p.z;
+        b->nx[w] = nv.x * len; b->ny[w] = nv.y * len; b->nz[w] = nv.z * len;
+        b->vertex[w] = v;
+    }
+    free(smooth);
+    free(keys);
+    free(tmp);
+    b->valid = 0;
+}
+
+// Mesmo modelo de gouraudLight (ambiente 0.24 + difuso 0.8), 4 vertices por vez.
+void bakeLightingJob(void* ctx, int thread_index) {
+    baked_lighting_t* b = (baked_lighting_t*)ctx;
+    int threads = numThreads();
+    size_t groups = b->padded / 4;
+    size_t begin = groups * thread_index / threads * 4;
+    size_t end = groups * (thread_index + 1) / threads * 4;
+
+#ifdef __SSE2__
+    __m128 lx = _mm_set1_ps(b->light[0]), ly = _mm_set1_ps(b->light[1]), lz = _mm_set1_ps(b->light[2]);
+    __m128 ambient = _mm_set1_ps(0.24f), diffuse = _mm_set1_ps(0.8f);
+    __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f), tiny = _mm_set1_ps(1e-30f);
+    for (size_t w = begin; w < end; w += 4) {
+        __m128 dx = _mm_sub_ps(lx, _mm_loadu_ps(b->px + w));
+        __m128 dy = _mm_sub_ps(ly, _mm_loadu_ps(b->py + w));
+        __m128 dz = _mm_sub_ps(lz, _mm_loadu_ps(b->pz + w));
+        __m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, _mm_loadu_ps(b->nx + w)), _mm_mul_ps(dy, _mm_loadu_ps(b->ny + w))),
+                                _mm_mul_ps(dz, _mm_loadu_ps(b->nz + w)));
+        __m128 len = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+        __m128 ndotl = _mm_max_ps(zero, _mm_div_ps(dot, _mm_max_ps(len, tiny)));
+        __m128 c = _mm_min_ps(one, _mm_add_ps(ambient, _mm_mul_ps(diffuse, ndotl)));
+        _mm_storeu_ps(b->intensity + w, c);
+    }
+#else
+    float light[4] = {b->light[0], b->light[1], b->light[2], 1.0f};
+    for (size_t w = begin; w < end; w++) {
+        float p[3] = {b->px[w], b->py[w], b->pz[w]};
+        float n[3] = {b->nx[w], b->ny[w], b->nz[w]};
+        b->intensity[w] = gouraudLight(p, n, light);
+    }
+#endif
+
+    for (size_t w = begin; w < end; w++) {
+        float c = b->intensity[w];
+        if (g_vertex_colors) {
+            const vec3f* vc = &g_vertex_colors[b->vertex[w]];
+            b->colors[w] = (vec3f){c * vc->x, c * vc->y, c * vc->z};
+        } else {
+            b->colors[w] = (vec3f){c, c, c};
+        }
+    }
+}
+
+void updateBakedLighting() {
+    baked_lighting_t* b = &g_baked;
+    if (!g_lods[0].wedges) buildWedges();
+    if (b->valid && memcmp(b->light, g_kiosk_light, sizeof(b->light)) == 0) return;
+
+    double start = get_time_ms();
+    memcpy(b->light, g_kiosk_light, sizeof(b->light));
+    runParallel(bakeLightingJob, b);
+    b->valid = 1;
+    printf("Iluminacao pre-calculada: %zu vertices unicos, %.2f ms\n", b->count, get_time_ms() - start);
+}
+
+// Desenha com GL_LIGHTING desligado: a cor pre-calculada ja inclui a luz.
+void drawBakedFaces(const face_t* faces, const int* wedges, size_t num_faces, size_t stride, int textured) {
+    for (size_t i = 0; i < num_faces; i += stride) {
+        const face_t* f = &faces[i];
+
+        if (textured) {
+            if (f->material_id >= 0) {
+                glBindTexture(GL_TEXTURE_2D, g_materials[f->material_id].texture_id);
+            } else {
+                glBindTexture(GL_TEXTURE_2D, g_default_texture);
+            }
+        }
+
+        glBegin(GL_TRIANGLES);
+        for (int v = 0; v < 3; v++) {
+            const face_vertex_t* fv = &f->v[v];
+            int vt_idx = fv->vt_idx - 1;
+            int v_idx = fv->v_idx - 1;
+
+            if (textured) {
+                if (vt_idx >= 0) glTexCoord2f(g_texcoords[vt_idx].u, g_texcoords[vt_idx].v);
+                else glTexCoord2f(0.0f, 0.0f);
+            }
+            glColor3fv(&g_baked.colors[wedges[i * 3 + v]].x);
+            glVertex3f(g_vertices[v_idx].x, g_vertices[v_idx].y, g_vertices[v_idx].z);
+        }
+        glEnd();
+    }
+}
+
+// Planos do frustum (Gribb/Hartmann) de projecao * modelview, em coordenadas do modelo.
+void extractFrustum(float planes[6][4]) {
+    double proj[16], mv[16], m[16];
+    glGetDoublev(GL_PROJECTION_MATRIX, proj);
+    glGetDoublev(GL_MODELVIEW_MATRIX, mv);
+    for (int c = 0; c < 4; c++)
+        for (int r = 0; r < 4; r++)
+            m[c * 4 + r] = proj[r] * mv[c * 4] + proj[4 + r] * mv[c * 4 + 1] + proj[8 + r] * mv[c * 4 + 2] + proj[12 + r] * mv[c * 4 + 3];
+    for (int i = 0; i < 6; i++) {
+        int row = i / 2;
+        float sign = (i % 2) ? -1.0f : 1.0f;
+        for (int c = 0; c < 4; c++) planes[i][c] = (float)(m[c * 4 + 3] + sign * m[c * 4 + row]);
+    }
+}
+
+int aabbInFrustum(const float planes[6][4], const float* bmin, const float* bmax) {
+    for (int i = 0; i < 6; i++) {
+        const float* p = planes[i];
+        float x = p[0] >= 0.0f ? bmax[0] : bmin[0];
+        float y = p[1] >= 0.0f ? bmax[1] : bmin[1];
+        float z = p[2] >= 0.0f ? bmax[2] : bmin[2];
+        if (p[0] * x + p[1] * y + p[2] * z + p[3] < 0.0f) return 0;
+    }
+    return 1;
+}
+
+// Desenha so os submeshes cuja caixa toca o frustum (wedges != NULL usa a
+// iluminacao pre-calculada) e retorna quantas faces foram enviadas.
+size_t drawSubmeshes(const int* wedges, size_t stride, int textured) {
+    float planes[6][4];
+    extractFrustum(planes);
+    size_t drawn = 0;
+    for (size_t i = 0; i < g_num_submeshes; i++) {
+        const submesh_t* s = &g_submeshes[i];
+        if (s->num_faces == 0 || !aabbInFrustum(planes, s->bmin, s->bmax)) continue;
+        if (wedges) drawBakedFaces(g_faces + s->first_face, wedges + s->first_face * 3, s->num_faces, stride, textured);
+        else drawFaces(g_faces + s->first_face, s->num_faces, stride, textured);
+        drawn += (s->num_faces + stride - 1) / stride;
+    }
+    return drawn;
+}
+
+// Renderizacao fora do nucleo (.ooc): octree em disco cujos nos guardam
+// triangulos soltos (posicao, normal, cor). Folhas tem ate OOC_LEAF_FACES
+// faces originais; cada no interno e a simplificacao por agrupamento em
+// grade dos filhos, com erro geometrico em unidades do modelo. Em tempo de
+// execucao so a tabela de nos fica na memoria; os blocos sao lidos por uma
+// thread com pread e descartados (LRU) acima do orcamento.
+#define OOC_MAGIC "OOC1"
+#define OOC_LEAF_FACES 16384
+#define OOC_MAX_DEPTH 16
+#define OOC_MAX_GRID 128
+#define OOC_ALIGN 4096
+#define OOC_MAX_REQUESTS 64
+
+typedef struct {
+    float p[3];
+    float n[3];
+    unsigned char c[4];
+} ooc_vertex_t;
+
+typedef struct {
+    float bmin[3], bmax[3];
+    float error;
+    int32_t children[8];
+    uint32_t num_vertices;
+    uint64_t offset;
+} ooc_node_t;
+
+typedef struct {
+    char magic[4];
+    uint32_t leaf_faces;
+    uint64_t num_nodes, root, node_table;
+    uint64_t total_faces;
+    float center[3], size;
+} ooc_header_t;
+
+typedef struct {
+    FILE* file;
+    const char* output;
+    ooc_node_t* nodes;
+    size_t num_nodes, nodes_cap;
+    size_t leaves;
+    int max_depth;
+    int spill_failed;
+} ooc_builder_t;
+
+typedef struct {
+    uint64_t key;
+    float p[3], n[3];
+    uint32_t c[3];
+    uint32_t count;
+} ooc_cell_t;
+
+typedef struct {
+    uint64_t key;
+    uint32_t corner;
+    uint32_t count;
+} ooc_edge_t;
+
+// Arquivo temporario ao lado da saida, apagado do diretorio assim que aberto.
+static FILE* ooc_spill_file(const char* output) {
+    char path[1100];
+    snprintf(path, sizeof(path), "%s.XXXXXX", output);
+    int fd = mkstemp(path);
+    if (fd < 0) return NULL;
+    unlink(path);
+    FILE* file = fdopen(fd, "w+b");
+    if (!file) close(fd);
+    return file;
+}
+
+// Cor do canto: cor por vertice, senao a textura amostrada na coordenada, senao cinza.
+static void ooc_corner_color(const face_t* f, int k, unsigned char* c) {
+    const face_vertex_t* fv = &f->v[k];
+    c[0] = c[1] = c[2] = 204;
+    c[3] = 255;
+    if (g_vertex_colors) {
+        const float* color = &g_vertex_colors[fv->v_idx - 1].x;
+        for (int a = 0; a < 3; a++) c[a] = (unsigned char)(fminf(fmaxf(color[a], 0.0f), 1.0f) * 255.0f + 0.5f);
+    } else if (f->material_id >= 0 && fv->vt_idx > 0 && g_materials[f->material_id].image.pixels) {
+        const image_t* img = &g_materials[f->material_id].image;
+        const vec2f* t = &g_texcoords[fv->vt_idx - 1];
+        float u = t->u - floorf(t->u), v = t->v - floorf(t->v);
+        int x = (int)(u * img->width), y = (int)(v * img->height);
+        if (x >= img->width) x = img->width - 1;
+        if (y >= img->height) y = img->height - 1;
+        const unsigned char* texel = img->pixels + ((size_t)y * img->width + x) * img->channels;
+        for (int a = 0; a < 3; a++) c[a] = texel[img->channels >= 3 ? a : 0];
+    }
+}
+
+// Os 3 cantos da face; 0 se algum indice de vertice ficou invalido.
+static int ooc_face_corners(const face_t* f, ooc_vertex_t* out) {
+    for (int k = 0; k < 3; k++)
+        if (f->v[k].v_idx < 1 || (size_t)f->v[k].v_idx > g_num_vertices) return 0;
+    vec3f fn = face_normal(&g_vertices[f->v[0].v_idx - 1], &g_vertices[f->v[1].v_idx - 1], &g_vertices[f->v[2].v_idx - 1]);
+    float len = sqrtf(fn.x * fn.x + fn.y * fn.y + fn.z * fn.z);
+    if (len > 0.0f) fn = (vec3f){fn.x / len, fn.y / len, fn.z / len};
+    for (int k = 0; k < 3; k++) {
+        ooc_vertex_t* v = &out[k];
+        const vec3f* p = &g_vertices[f->v[k].v_idx - 1];
+        const vec3f* nrm = f->v[k].vn_idx > 0 ? &g_normals[f->v[k].vn_idx - 1] : &fn;
+        v->p[0] = p->x, v->p[1] = p->y, v->p[2] = p->z;
+        v->n[0] = nrm->x, v->n[1] = nrm->y, v->n[2] = nrm->z;
+        ooc_corner_color(f, k, v->c);
+    }
+    return 1;
+}
+
+// Grava as faces como triangulos soltos em soup e amplia a caixa; retorna quantos foram gravados.
+static size_t ooc_write_faces(FILE* soup, const face_t* faces, size_t n, float* bmin, float* bmax) {
+    ooc_vertex_t batch[3 * 512];
+    size_t count = 0, written = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (!ooc_face_corners(&faces[i], batch + count)) continue;
+        for (int k = 0; k < 3; k++) {
+            for (int a = 0; a < 3; a++) {
+                if (batch[count + k].p[a] < bmin[a]) bmin[a] = batch[count + k].p[a];
+                if (batch[count + k].p[a] > bmax[a]) bmax[a] = batch[count + k].p[a];
+            }
+        }
+        count += 3;
+        if (count == 3 * 512) {
+            fwrite(batch, sizeof(ooc_vertex_t), count, soup);
+            written += count / 3;
+            count = 0;
+        }
+    }
+    if (count > 0) {
+        fwrite(batch, sizeof(ooc_vertex_t), count, soup);
+        written += count / 3;
+    }
+    return written;
+}
+
+static ooc_vertex_t* ooc_read_soup(FILE* soup, size_t n) {
+    ooc_vertex_t* vertices = (ooc_vertex_t*)malloc(n * 3 * sizeof(ooc_vertex_t) + 1);
+    rewind(soup);
+    size_t got = fread(vertices, sizeof(ooc_vertex_t) * 3, n, soup);
+    if (got < n) memset(vertices + got * 3, 0, (n - got) * 3 * sizeof(ooc_vertex_t));
+    return vertices;
+}
+
+// Agrupamento em grade ancorada no canto da celula da octree: cada canto vai
+// para sua celula, a celula vira a media dos cantos e sobram os triangulos
+// com tres celulas distintas. Retorna o numero de vertices de saida.
+static size_t ooc_cluster(const ooc_vertex_t* in, size_t n, const float* cmin, float cell, int grid,
+                          ooc_cell_t* table, size_t cap, uint32_t* slot_of, ooc_vertex_t* out) {
+    for (size_t i = 0; i < cap; i++) table[i].key = UINT64_MAX;
+    int shift = 64 - __builtin_ctzll(cap);
+    for (size_t i = 0; i < n; i++) {
+        uint64_t key = 0;
+        for (int a = 0; a < 3; a++) {
+            int q = (int)((in[i].p[a] - cmin[a]) / cell);
+            if (q < 0) q = 0;
+            if (q >= grid) q = grid - 1;
+            key |= (uint64_t)q << (16 * a);
+        }
+        size_t slot = (size_t)((key * 0x9E3779B97F4A7C15ull) >> shift);
+        while (table[slot].key != UINT64_MAX && table[slot].key != key) slot = (slot + 1) & (cap - 1);
+        ooc_cell_t* c = &table[slot];
+        if (c->key == UINT64_MAX) memset(c, 0, sizeof(*c)), c->key = key;
+        for (int a = 0; a < 3; a++) {
+            c->p[a] += in[i].p[a];
+            c->n[a] += in[i].n[a];
+            c->c[a] += in[i].c[a];
+        }
+        c->count++;
+        slot_of[i] = (uint32_t)slot;
+    }
+    for (size_t i = 0; i < cap; i++) {
+        ooc_cell_t* c = &table[i];
+        if (c->key == UINT64_MAX) continue;
+        float len = sqrtf(c->n[0] * c->n[0] + c->n[1] * c->n[1] + c->n[2] * c->n[2]);
+        for (int a = 0; a < 3; a++) {
+            c->p[a] /= c->count;
+            c->n[a] = len > 0.0f ? c->n[a] / len : (a == 2);
+            c->c[a] /= c->count;
+        }
+    }
+
+    size_t count = 0;
+    for (size_t i = 0; i + 2 < n; i += 3) {
+        uint32_t s0 = slot_of[i], s1 = slot_of[i + 1], s2 = slot_of[i + 2];
+        if (s0 == s1 || s1 == s2 || s0 == s2) continue;
+        uint32_t slots[3] = {s0, s1, s2};
+        for (int k = 0; k < 3; k++) {
+            const ooc_cell_t* c = &table[slots[k]];
+            ooc_vertex_t* v = &out[count++];
+            memcpy(v->p, c->p, sizeof(v->p));
+            memcpy(v->n, c->n, sizeof(v->n));
+            for (int a = 0; a < 3; a++) v->c[a] = (unsigned char)c->c[a];
+            v->c[3] = 255;
+        }
+    }
+    return count;
+}
+
+static uint32_t ooc_hash_position(const float* p) {
+    uint32_t h[3];
+    memcpy(h, p, sizeof(h));
+    return (h[0] * 73856093u) ^ (h[1] * 19349663u) ^ (h[2] * 83492791u);
+}
+
+// Saias: cada aresta usada por um so triangulo ganha um quad que desce depth
+// ao longo da normal e tapa a fresta ate um vizinho de outro nivel.
+static ooc_vertex_t* ooc_skirt(const ooc_vertex_t* in, size_t n, float depth, size_t* out_count) {
+    size_t cap = 16;
+    while (cap < n * 2) cap *= 2;
+    uint32_t* table = (uint32_t*)malloc(cap * sizeof(uint32_t));
+    uint32_t* id = (uint32_t*)malloc(n * sizeof(uint32_t) + 1);
+    memset(table, 0xff, cap * sizeof(uint32_t));
+    for (size_t i = 0; i < n; i++) {
+        size_t slot = ooc_hash_position(in[i].p) & (cap - 1);
+        while (table[slot] != UINT32_MAX && memcmp(in[table[slot]].p, in[i].p, sizeof(in[i].p)) != 0)
+            slot = (slot + 1) & (cap - 1);
+        if (table[slot] == UINT32_MAX) table[slot] = (uint32_t)i;
+        id[i] = table[slot];
+    }
+    free(table);
+
+    ooc_edge_t* edges = (ooc_edge_t*)malloc(cap * sizeof(ooc_edge_t));
+    for (size_t i = 0; i < cap; i++) edges[i].key = UINT64_MAX;
+    int shift = 64 - __builtin_ctzll(cap);
+    size_t boundary = 0;
+    for (size_t i = 0; i < n; i++) {
+        size_t next = i - i % 3 + (i % 3 + 1) % 3;
+        uint32_t a = id[i], b = id[next];
+        if (a == b) continue;
+        uint64_t key = a < b ? (uint64_t)a << 32 | b : (uint64_t)b << 32 | a;
+        size_t slot = (size_t)((key * 0x9E3779B97F4A7C15ull) >> shift);
+        while (edges[slot].key != UINT64_MAX && edges[slot].key != key) slot = (slot + 1) & (cap - 1);
+        if (edges[slot].key == UINT64_MAX) {
+            edges[slot].key = key;
+            edges[slot].corner = (uint32_t)i;
+            edges[slot].count = 0;
+        }
+        edges[slot].count++;
+        if (edges[slot].count == 1) boundary++;
+        else if (edges[slot].count == 2) boundary--;
+    }
+    free(id);
+
+    ooc_vertex_t* out = (ooc_vertex_t*)malloc((n + boundary * 6) * sizeof(ooc_vertex_t) + 1);
+    memcpy(out, in, n * sizeof(ooc_vertex_t));
+    size_t count = n;
+    for (size_t i = 0; i < cap; i++) {
+        if (edges[i].key == UINT64_MAX || edges[i].count != 1) continue;
+        size_t corner = edges[i].corner, next = corner - corner % 3 + (corner % 3 + 1) % 3;
+        ooc_vertex_t a = in[corner], b = in[next], a2 = a, b2 = b;
+        for (int k = 0; k < 3; k++) {
+            a2.p[k] -= a.n[k] * depth;
+            b2.p[k] -= b.n[k] * depth;
+        }
+        out[count++] = b, out[count++] = a, out[count++] = a2;
+        out[count++] = b, out[count++] = a2, out[count++] = b2;
+    }
+    free(edges);
+    *out_count = count;
+    return out;
+}
+
+// Grava o bloco do no alinhado a OOC_ALIGN, com saias de skirt (0 = sem saias).
+static void ooc_write_chunk(ooc_builder_t* b, int node, const ooc_vertex_t* vertices, size_t count, float skirt) {
+    ooc_vertex_t* skirted = skirt > 0.0f ? ooc_skirt(vertices, count, skirt, &count) : NULL;
+    long pos = ftell(b->file);
+    long aligned = (pos + OOC_ALIGN - 1) / OOC_ALIGN * OOC_ALIGN;
+    for (long i = pos; i < aligned; i++) fputc(0, b->file);
+    b->nodes[node].offset = (uint64_t)aligned;
+    b->nodes[node].num_vertices = (uint32_t)count;
+    fwrite(skirted ? skirted : vertices, sizeof(ooc_vertex_t), count, b->file);
+    free(skirted);
+}
+
+// Pos-ordem: os triangulos de soup (que o no fecha) sao distribuidos pelo
+// centroide em um arquivo por octante e cada filho recursa sobre o seu; o pai
+// e simplificado a partir dos filhos e grava os blocos deles, ja com saias.
+// Devolve o indice do no e os vertices do seu bloco, que quem chamou grava.
+static int oocBuildNode(ooc_builder_t* b, FILE* soup, size_t n, const float* cmin, const float* cmax, int depth,
+                        ooc_vertex_t** out_vertices, size_t* out_count) {
+    ooc_node_t node;
+    memset(&node, 0, sizeof(node));
+    for (int c = 0; c < 8; c++) node.children[c] = -1;
+    for (int a = 0; a < 3; a++) {
+        node.bmin[a] = INFINITY;
+        node.bmax[a] = -INFINITY;
+    }
+    if (depth > b->max_depth) b->max_depth = depth;
+
+    FILE* child_soup[8] = {NULL};
+    int split = n > OOC_LEAF_FACES && depth < OOC_MAX_DEPTH;
+    for (int c = 0; split && c < 8; c++) {
+        child_soup[c] = ooc_spill_file(b->output);
+        if (!child_soup[c]) {
+            for (int k = 0; k < c; k++) fclose(child_soup[k]);
+            if (!b->spill_failed) printf("Sem arquivos temporarios ao lado de %s: folhas maiores em memoria\n", b->output);
+            b->spill_failed = 1;
+            split = 0;
+        }
+    }
+
+    ooc_vertex_t* vertices;
+    size_t count;
+    if (!split) {
+        vertices = ooc_read_soup(soup, n);
+        fclose(soup);
+        count = n * 3;
+        for (size_t i = 0; i < count; i++) {
+            for (int a = 0; a < 3; a++) {
+                if (vertices[i].p[a] < node.bmin[a]) node.bmin[a] = vertices[i].p[a];
+                if (vertices[i].p[a] > node.bmax[a]) node.bmax[a] = vertices[i].p[a];
+            }
+        }
+        b->leaves++;
+    } else {
+        // Octante c: bit 4 = metade alta em x, bit 2 = em y, bit 1 = em z;
+        // a soma dos 3 vertices e comparada com 3 * mid.
+        float mid[3], mid3[3];
+        for (int a = 0; a < 3; a++) {
+            mid[a] = (cmin[a] + cmax[a]) * 0.5f;
+            mid3[a] = mid[a] * 3.0f;
+        }
+        size_t child_n[8] = {0}, got;
+        ooc_vertex_t* batch = (ooc_vertex_t*)malloc(3 * 4096 * sizeof(ooc_vertex_t));
+        rewind(soup);
+        while ((got = fread(batch, sizeof(ooc_vertex_t) * 3, 4096, soup)) > 0) {
+            for (size_t t = 0; t < got; t++) {
+                const ooc_vertex_t* v = batch + t * 3;
+                int c = 0;
+                for (int a = 0; a < 3; a++)
+                    if (v[0].p[a] + v[1].p[a] + v[2].p[a] >= mid3[a]) c |= 4 >> a;
+                fwrite(v, sizeof(ooc_vertex_t), 3, child_soup[c]);
+                child_n[c]++;
+            }
+        }
+        free(batch);
+        fclose(soup);
+
+        ooc_vertex_t* child_vertices[8] = {NULL};
+        size_t child_count[8] = {0}, total = 0;
+        for (int c = 0; c < 8; c++) {
+            if (child_n[c] == 0) {
+                fclose(child_soup[c]);
+                continue;
+            }
+            float child_min[3], child_max[3];
+            for (int a = 0; a < 3; a++) {
+                int high = (c >> (2 - a)) & 1;
+                child_min[a] = high ? mid[a] : cmin[a];
+                child_max[a] = high ? cmax[a] : mid[a];
+            }
+            int child = oocBuildNode(b, child_soup[c], child_n[c], child_min, child_max, depth + 1,
+                                     &child_vertices[c], &child_count[c]);
+            const ooc_node_t* cn = &b->nodes[child];
+            node.children[c] = child;
+            if (cn->error > node.error) node.error = cn->error;
+            for (int a = 0; a < 3; a++) {
+                if (cn->bmin[a] < node.bmin[a]) node.bmin[a] = cn->bmin[a];
+                if (cn->bmax[a] > node.bmax[a]) node.bmax[a] = cn->bmax[a];
+            }
+            total += child_count[c];
+        }
+
+        ooc_vertex_t* in = (ooc_vertex_t*)malloc(total * sizeof(ooc_vertex_t) + 1);
+        size_t at = 0;
+        for (int c = 0; c < 8; c++) {
+            if (child_count[c]) memcpy(in + at, child_vertices[c], child_count[c] * sizeof(ooc_vertex_t));
+            at += child_count[c];
+        }
+
+        // Grades em potencias de 2 ancoradas na celula: vizinhos do mesmo nivel
+        // com a mesma grade agrupam nas mesmas fronteiras e nao abrem frestas.
+        size_t cap = 16;
+        while (cap < total * 2) cap *= 2;
+        ooc_cell_t* table = (ooc_cell_t*)malloc(cap * sizeof(ooc_cell_t));
+        uint32_t* slot_of = (uint32_t*)malloc(total * sizeof(uint32_t) + 1);
+        vertices = (ooc_vertex_t*)malloc(total * sizeof(ooc_vertex_t) + 1);
+        float extent = cmax[0] - cmin[0];
+        int grid = OOC_MAX_GRID;
+        for (;;) {
+            count = ooc_cluster(in, total, cmin, extent / grid, grid, table, cap, slot_of, vertices);
+            if (count <= (size_t)OOC_LEAF_FACES * 3 * 2 || grid <= 2) break;
+            grid /= 2;
+        }
+        float error = extent / grid * sqrtf(3.0f);
+        if (error > node.error) node.error = error;
+        free(in);
+        free(table);
+        free(slot_of);
+
+        // Vizinhos no corte tem erro em pixels parecido, entao ficam quase sempre
+        // a um nivel de distancia: a fresta entre um filho e um vizinho do nivel
+        // do pai e no maximo a soma dos dois erros, que a saia cobre.
+        for (int c = 0; c < 8; c++) {
+            if (node.children[c] >= 0)
+                ooc_write_chunk(b, node.children[c], child_vertices[c], child_count[c], node.error * 2.0f);
+            free(child_vertices[c]);
+        }
+    }
+
+    if (b->num_nodes == b->nodes_cap) {
+        b->nodes_cap = b->nodes_cap ? b->nodes_cap * 2 : 256;
+        b->nodes = (ooc_node_t*)realloc(b->nodes, b->nodes_cap * sizeof(ooc_node_t));
+    }
+    b->nodes[b->num_nodes] = node;
+    *out_vertices = vertices;
+    *out_count = count;
+    return (int)b->num_nodes++;
+}
+
+typedef struct {
+    FILE* attributes[3];
+    size_t counts[3];
+    FILE* soup;
+    float bmin[3], bmax[3];
+    size_t total;
+} ooc_source_t;
+
+// 1a passada do .obj: v/vt/vn vao para arquivos temporarios; o mtllib ja
+// carrega os materiais.
+static void ooc_attribute_line(obj_parser_t* p, char* line, int kind) {
+    ooc_source_t* src = (ooc_source_t*)p->hook_ctx;
+    int a = vertex_kind(kind);
+    if (a < 0) {
+        if (kind == LINE_MTLLIB) objParseLine(p, line, kind);
+        return;
+    }
+    float value[3] = {0.0f, 0.0f, 0.0f};
+    if (a == 0) sscanf(line, "v %f %f %f", &value[0], &value[1], &value[2]);
+    else if (a == 1) sscanf(line, "vt %f %f", &value[0], &value[1]);
+    else sscanf(line, "vn %f %f %f", &value[0], &value[1], &value[2]);
+    fwrite(value, sizeof(float), a == 1 ? 2 : 3, src->attributes[a]);
+    src->counts[a]++;
+}
+
+// 2a passada: os atributos ja estao mapeados e so os contadores avancam (os
+// indices relativos resolvem contra eles); as faces saem em lotes para a sopa.
+static void ooc_face_line(obj_parser_t* p, char* line, int kind) {
+    ooc_source_t* src = (ooc_source_t*)p->hook_ctx;
+    if (kind == LINE_V) g_num_vertices++;
+    else if (kind == LINE_VT) g_num_texcoords++;
+    else if (kind == LINE_VN) g_num_normals++;
+    else if (kind == LINE_F || kind == LINE_USEMTL) objParseLine(p, line, kind);
+    if (g_num_faces >= 65536) {
+        src->total += ooc_write_faces(src->soup, g_faces, g_num_faces, src->bmin, src->bmax);
+        g_num_faces = 0;
+    }
+}
+
+static int ooc_stream_pass(const char* filename, obj_parser_t* p) {
+    int compression = detectCompression(filename);
+    obj_stream_t stream;
+    if (compression == COMPRESSION_NONE) {
+        int fd = open(filename, O_RDONLY);
+        if (fd < 0 || !streamOpenFd(&stream, fd)) {
+            if (fd >= 0) close(fd);
+            return 0;
+        }
+    } else if (!streamOpen(&stream, filename, compression)) {
+        return 0;
+    }
+    objParseStream(p, &stream);
+    int ok = !stream.error;
+    streamClose(&stream);
+    return ok;
+}
+
+// Le o .obj duas vezes sem guardar a malha: na memoria ficam so os materiais
+// e um lote de faces; os atributos sao mapeados dos arquivos temporarios.
+static int oocStreamOBJ(const char* input, const char* output, ooc_source_t* src) {
+    obj_parser_t parser;
+    objParserInit(&parser, input);
+    parser.line_hook = ooc_attribute_line;
+    parser.hook_ctx = src;
+    int ok = 1;
+    for (int a = 0; a < 3; a++) {
+        src->attributes[a] = ooc_spill_file(output);
+        if (!src->attributes[a]) ok = 0;
+    }
+    if (ok) ok = ooc_stream_pass(input, &parser);
+
+    void* maps[3] = {NULL, NULL, NULL};
+    size_t bytes[3] = {0, 0, 0};
+    for (int a = 0; a < 3 && ok; a++) {
+        bytes[a] = src->counts[a] * (a == 1 ? sizeof(vec2f) : sizeof(vec3f));
+        if (bytes[a] == 0) {
+            ok = a > 0;
+            continue;
+        }
+        maps[a] = fflush(src->attributes[a]) == 0 ? mmap(NULL, bytes[a], PROT_READ, MAP_SHARED, fileno(src->attributes[a]), 0)
+                                                   : MAP_FAILED;
+        if (maps[a] == MAP_FAILED) {
+            maps[a] = NULL;
+            ok = 0;
+        }
+    }
+    if (ok) {
+        g_vertices = (vec3f*)maps[0];
+        g_texcoords = (vec2f*)maps[1];
+        g_normals = (vec3f*)maps[2];
+        g_vertices_cap = g_texcoords_cap = g_normals_cap = 0;
+        objParserInit(&parser, input);
+        parser.line_hook = ooc_face_line;
+        parser.hook_ctx = src;
+        ok = ooc_stream_pass(input, &parser);
+        src->total += ooc_write_faces(src->soup, g_faces, g_num_faces, src->bmin, src->bmax);
+    }
+
+    for (int a = 0; a < 3; a++) {
+        if (maps[a]) munmap(maps[a], bytes[a]);
+        if (src->attributes[a]) fclose(src->attributes[a]);
+    }
+    g_vertices = g_normals = NULL;
+    g_texcoords = NULL;
+    g_num_vertices = g_num_texcoords = g_num_normals = 0;
+    return ok;
+}
+
+// -build-ooc: um .obj (ou qualquer entrada gzip/zstd) sem -part,
+// -weld-positions ou -clean e lido em streaming (duas passadas, arquivos
+// temporarios ao lado da saida), os demais formatos com loadMesh (um .mcache e mapeado). Os triangulos vao para uma sopa em
+// disco que a construcao divide por octante, entao a memoria fica limitada
+// aos blocos do caminho atual da recursao, nao ao tamanho do modelo.
+int buildOOC(const char* input, const char* output) {
+    ooc_source_t src;
+    memset(&src, 0, sizeof(src));
+    for (int a = 0; a < 3; a++) {
+        src.bmin[a] = INFINITY;
+        src.bmax[a] = -INFINITY;
+    }
+    FILE* file = fopen(output, "wb");
+    src.soup = file ? ooc_spill_file(output) : NULL;
+    if (!src.soup) {
+        printf("Nao foi possivel gravar %s\n", output);
+        if (file) fclose(file);
+        return 0;
+    }
+
+    double start = get_time_ms();
+    int is_obj = has_extension(input, ".obj") || has_extension(input, ".obj.gz") || has_extension(input, ".obj.zst") ||
+                 detectCompression(input) != COMPRESSION_NONE;
+    int streamed = is_obj && !g_part_filter && !g_weld_positions && !g_clean_faces;
+    int ok = 1;
+    if (streamed) {
+        ok = oocStreamOBJ(input, output, &src);
+    } else {
+        loadMesh(input);
+        src.total = ooc_write_faces(src.soup, g_faces, g_num_faces, src.bmin, src.bmax);
+    }
+    freeMesh();
+    if (!ok || src.total == 0) {
+        printf(ok ? "Nada para gravar em %s\n" : "Erro ao ler %s\n", ok ? output : input);
+        fclose(src.soup);
+        fclose(file);
+        remove(output);
+        return 0;
+    }
+    printf("%s: %zu faces %s em %.1f ms\n", input, src.total, streamed ? "lidas em streaming" : "carregadas",
+           get_time_ms() - start);
+
+    ooc_header_t h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, OOC_MAGIC, 4);
+    h.leaf_faces = OOC_LEAF_FACES;
+    h.total_faces = src.total;
+    h.size = 0.0f;
+    for (int a = 0; a < 3; a++) {
+        h.center[a] = (src.bmin[a] + src.bmax[a]) * 0.5f;
+        if (src.bmax[a] - src.bmin[a] > h.size) h.size = src.bmax[a] - src.bmin[a];
+    }
+    fwrite(&h, sizeof(h), 1, file);
+
+    float half = h.size * 0.5f * 1.001f, cmin[3], cmax[3];
+    for (int a = 0; a < 3; a++) {
+        cmin[a] = h.center[a] - half;
+        cmax[a] = h.center[a] + half;
+    }
+
+    ooc_builder_t b;
+    memset(&b, 0, sizeof(b));
+    b.file = file;
+    b.output = output;
+    ooc_vertex_t* root_vertices;
+    size_t root_count;
+    h.root = (uint64_t)oocBuildNode(&b, src.soup, src.total, cmin, cmax, 0, &root_vertices, &root_count);
+    ooc_write_chunk(&b, (int)h.root, root_vertices, root_count, 0.0f);
+    free(root_vertices);
+
+    h.num_nodes = b.num_nodes;
+    h.node_table = (uint64_t)ftell(file);
+    fwrite(b.nodes, sizeof(ooc_node_t), b.num_nodes, file);
+    long file_size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    fwrite(&h, sizeof(h), 1, file);
+    ok = !ferror(file);
+    if (fclose(file) != 0) ok = 0;
+
+    printf("%s: %zu nos (%zu folhas, profundidade %d), raiz com %zu faces e erro %.6g, %.1f MB, %.1f ms\n", output,
+           b.num_nodes, b.leaves, b.max_depth, root_count / 3, b.nodes[h.root].error, file_size / 1048576.0,
+           get_time_ms() - start);
+    free(b.nodes);
+    return ok;
+}
+
+enum { OOC_ABSENT, OOC_LOADING, OOC_RESIDENT };
+
+typedef struct {
+    float priority;
+    int node;
+} ooc_entry_t;
+
+typedef struct {
+    int fd;
+    ooc_header_t h;
+    ooc_node_t* nodes;
+    ooc_vertex_t** data;
+    int* state;
+    unsigned* last_used;
+    unsigned frame;
+    size_t budget;
+    size_t resident_bytes;
+    ooc_entry_t* heap;
+    ooc_entry_t* wanted;
+    pthread_t loader;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int requests[OOC_MAX_REQUESTS];
+    int num_requests;
+    int arrived;
+    size_t loads, evictions;
+} ooc_t;
+
+ooc_t g_ooc = {-1};
+size_t g_ooc_budget_mb = 512;
+
+static size_t ooc_bytes(int node) {
+    return (size_t)g_ooc.nodes[node].num_vertices * sizeof(ooc_vertex_t);
+}
+
+static ooc_vertex_t* ooc_read_chunk(int node) {
+    size_t bytes = ooc_bytes(node), done = 0;
+    char* data = (char*)malloc(bytes + 1);
+    while (done < bytes) {
+        ssize_t r = pread(g_ooc.fd, data + done, bytes - done, (off_t)(g_ooc.nodes[node].offset + done));
+        if (r <= 0) {
+            free(data);
+            return NULL;
+        }
+        done += (size_t)r;
+    }
+    return (ooc_vertex_t*)data;
+}
+
+// Atende sempre o pedido mais prioritario da lista, que o quadro seguinte
+// substitui inteira; pedidos que sairam da vista somem sem ser lidos.
+static void* oocLoader(void* arg) {
+    (void)arg;
+    for (;;) {
+        pthread_mutex_lock(&g_ooc.lock);
+        while (g_ooc.num_requests == 0) pthread_cond_wait(&g_ooc.cond, &g_ooc.lock);
+        int node = g_ooc.requests[0];
+        memmove(g_ooc.requests, g_ooc.requests + 1, --g_ooc.num_requests * sizeof(int));
+        pthread_mutex_unlock(&g_ooc.lock);
+        if (__atomic_load_n(&g_ooc.state[node], __ATOMIC_ACQUIRE) != OOC_ABSENT) continue;
+
+        __atomic_store_n(&g_ooc.state[node], OOC_LOADING, __ATOMIC_RELAXED);
+        ooc_vertex_t* data = ooc_read_chunk(node);
+        if (!data) {
+            __atomic_store_n(&g_ooc.state[node], OOC_ABSENT, __ATOMIC_RELEASE);
+            continue;
+        }
+        g_ooc.data[node] = data;
+        __atomic_add_fetch(&g_ooc.resident_bytes, ooc_bytes(node), __ATOMIC_RELAXED);
+        g_ooc.loads++;
+        __atomic_store_n(&g_ooc.state[node], OOC_RESIDENT, __ATOMIC_RELEASE);
+        __atomic_store_n(&g_ooc.arrived, 1, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+// A tabela vem do disco: cada filho tem indice menor que o pai (pos-ordem) e
+// um pai so, e cada bloco cabe no arquivo; assim a descida termina e as
+// filas de tamanho num_nodes nao transbordam.
+static int ooc_valid_nodes(const ooc_node_t* nodes, size_t num_nodes, size_t root, uint64_t file_size) {
+    unsigned char* has_parent = (unsigned char*)calloc(num_nodes, 1);
+    int ok = 1;
+    for (size_t i = 0; i < num_nodes && ok; i++) {
+        const ooc_node_t* n = &nodes[i];
+        uint64_t bytes = (uint64_t)n->num_vertices * sizeof(ooc_vertex_t);
+        if (n->num_vertices % 3 != 0 || n->offset > file_size || bytes > file_size - n->offset ||
+            !(n->error >= 0.0f && isfinite(n->error))) ok = 0;
+        for (int c = 0; c < 8 && ok; c++) {
+            int32_t child = n->children[c];
+            if (child == -1) continue;
+            if (child < 0 || (size_t)child >= i || has_parent[child]) ok = 0;
+            else has_parent[child] = 1;
+        }
+    }
+    if (ok && has_parent[root]) ok = 0;
+    free(has_parent);
+    return ok;
+}
+
+// Abre um .ooc para o visualizador: le o cabecalho e a tabela de nos,
+// carrega a raiz (fica sempre residente) e inicia a thread de leitura.
+int openOOC(const char* filename) {
+    int fd = open(filename, O_RDONLY);
+    ooc_header_t h;
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || pread(fd, &h, sizeof(h), 0) != (ssize_t)sizeof(h) ||
+        memcmp(h.magic, OOC_MAGIC, 4) != 0 || h.num_nodes == 0 || h.num_nodes > INT32_MAX || h.root >= h.num_nodes ||
+        h.node_table < sizeof(h) || h.node_table > (uint64_t)st.st_size ||
+        h.num_nodes > ((uint64_t)st.st_size - h.node_table) / sizeof(ooc_node_t)) {
+        printf("Arquivo .ooc invalido: %s\n", filename);
+        if (fd >= 0) close(fd);
+        return 0;
+    }
+
+    ooc_t* o = &g_ooc;
+    o->nodes = (ooc_node_t*)malloc(h.num_nodes * sizeof(ooc_node_t));
+    if (pread(fd, o->nodes, h.num_nodes * sizeof(ooc_node_t), (off_t)h.node_table) != (ssize_t)(h.num_nodes * sizeof(ooc_node_t)) ||
+        !ooc_valid_nodes(o->nodes, h.num_nodes, h.root, (uint64_t)st.st_size)) {
+        printf("Arquivo .ooc invalido ou corrompido: %s\n", filename);
+        free(o->nodes);
+        o->nodes = NULL;
+        close(fd);
+        return 0;
+    }
+    o->fd = fd;
+    o->h = h;
+    o->data = (ooc_vertex_t**)calloc(h.num_nodes, sizeof(ooc_vertex_t*));
+    o->state = (int*)calloc(h.num_nodes, sizeof(int));
+    o->last_used = (unsigned*)calloc(h.num_nodes, sizeof(unsigned));
+    o->heap = (ooc_entry_t*)malloc(h.num_nodes * sizeof(ooc_entry_t));
+    o->wanted = (ooc_entry_t*)malloc(h.num_nodes * sizeof(ooc_entry_t));
+    memcpy(g_center, h.center, sizeof(g_center));
+    g_size = h.size;
+
+    int root = (int)h.root;
+    o->data[root] = ooc_read_chunk(root);
+    if (!o->data[root]) {
+        printf("Arquivo .ooc invalido ou corrompido: %s\n", filename);
+        close(fd);
+        free(o->nodes);
+        free(o->data);
+        free(o->state);
+        free(o->last_used);
+        free(o->heap);
+        free(o->wanted);
+        memset(o, 0, sizeof(*o));
+        o->fd = -1;
+        return 0;
+    }
+    o->state[root] = OOC_RESIDENT;
+    o->resident_bytes = ooc_bytes(root);
+    o->budget = g_ooc_budget_mb * 1048576;
+    if (o->budget < ooc_bytes(root)) o->budget = ooc_bytes(root);
+
+    pthread_mutex_init(&o->lock, NULL);
+    pthread_cond_init(&o->cond, NULL);
+    pthread_create(&o->loader, NULL, oocLoader, NULL);
+    printf("%s: %zu faces em %zu nos, raiz com %u faces, orcamento %zu MB\n", filename, (size_t)h.total_faces,
+           (size_t)h.num_nodes, o->nodes[root].num_vertices / 3, o->budget / 1048576);
+    return 1;
+}
+
+static void ooc_heap_push(ooc_entry_t* heap, size_t* n, ooc_entry_t e) {
+    size_t i = (*n)++;
+    while (i > 0 && heap[(i - 1) / 2].priority < e.priority) {
+        heap[i] = heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    heap[i] = e;
+}
+
+static ooc_entry_t ooc_heap_pop(ooc_entry_t* heap, size_t* n) {
+    ooc_entry_t top = heap[0], last = heap[--*n];
+    size_t i = 0;
+    for (;;) {
+        size_t c = i * 2 + 1;
+        if (c >= *n) break;
+        if (c + 1 < *n && heap[c + 1].priority > heap[c].priority) c++;
+        if (heap[c].priority <= last.priority) break;
+        heap[i] = heap[c];
+        i = c;
+    }
+    heap[i] = last;
+    return top;
+}
+
+static int ooc_entry_desc(const void* a, const void* b) {
+    float pa = ((const ooc_entry_t*)a)->priority, pb = ((const ooc_entry_t*)b)->priority;
+    return (pa < pb) - (pa > pb);
+}
+
+static int ooc_entry_asc(const void* a, const void* b) {
+    return -ooc_entry_desc(a, b);
+}
+
+// Erro do no em pixels, pela distancia do olho ate a caixa.
+static float ooc_screen_error(const ooc_node_t* n, const float* eye, float pixels_per_unit) {
+    float d2 = 0.0f;
+    for (int a = 0; a < 3; a++) {
+        float d = eye[a] < n->bmin[a] ? n->bmin[a] - eye[a] : eye[a] > n->bmax[a] ? eye[a] - n->bmax[a] : 0.0f;
+        d2 += d * d;
+    }
+    float d = fmaxf(sqrtf(d2), g_size * 1e-4f);
+    return n->error * pixels_per_unit / d;
+}
+
+static void ooc_evict() {
+    ooc_t* o = &g_ooc;
+    size_t num = 0;
+    for (size_t i = 0; i < o->h.num_nodes; i++) {
+        if (i == o->h.root || o->last_used[i] == o->frame) continue;
+        if (__atomic_load_n(&o->state[i], __ATOMIC_ACQUIRE) != OOC_RESIDENT) continue;
+        o->wanted[num++] = (ooc_entry_t){(float)o->last_used[i], (int)i};
+    }
+    qsort(o->wanted, num, sizeof(ooc_entry_t), ooc_entry_asc);
+    for (size_t i = 0; i < num && __atomic_load_n(&o->resident_bytes, __ATOMIC_RELAXED) > o->budget; i++) {
+        int node = o->wanted[i].node;
+        free(o->data[node]);
+        o->data[node] = NULL;
+        __atomic_sub_fetch(&o->resident_bytes, ooc_bytes(node), __ATOMIC_RELAXED);
+        __atomic_store_n(&o->state[node], OOC_ABSENT, __ATOMIC_RELEASE);
+        o->evictions++;
+    }
+}
+
+// Corte da octree em ordem de erro na tela: um no so e trocado pelos filhos
+// visiveis quando o erro passa de -lod-pixel (multiplicado pelo nivel de
+// arraste), todos eles ja estao residentes e o conjunto cabe no orcamento;
+// senao o proprio no e desenhado e os filhos que faltam sao pedidos. Nada
+// aqui espera pelo disco. modelview: matriz do quadro, para achar o olho.
+size_t drawOOC(const double* modelview) {
+    ooc_t* o = &g_ooc;
+    o->frame++;
+    float planes[6][4];
+    extractFrustum(planes);
+    const double* mv = modelview;
+    float eye[3];
+    for (int c = 0; c < 3; c++) eye[c] = (float)-(mv[c * 4] * mv[12] + mv[c * 4 + 1] * mv[13] + mv[c * 4 + 2] * mv[14]);
+    float pixels_per_unit = (g_window_height * g_render_scale * 0.5f) / tanf(30.0f * (float)M_PI / 180.0f);
+    float threshold = g_lod_pixel_error * (g_isDragging ? (float)(1 << g_drag_level) : 1.0f);
+
+    glDisable(GL_TEXTURE_2D);
+    glColorMaterial(GL_FRONT_AND_BACK, GL_DIFFUSE);
+    glEnable(GL_COLOR_MATERIAL);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_NORMAL_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+
+    size_t heap_size = 0, num_wanted = 0, drawn = 0;
+    size_t touched = ooc_bytes((int)o->h.root);
+    const ooc_node_t* root = &o->nodes[o->h.root];
+    if (o->state[o->h.root] == OOC_RESIDENT && aabbInFrustum(planes, root->bmin, root->bmax))
+        ooc_heap_push(o->heap, &heap_size, (ooc_entry_t){ooc_screen_error(root, eye, pixels_per_unit), (int)o->h.root});
+
+    while (heap_size > 0) {
+        ooc_entry_t e = ooc_heap_pop(o->heap, &heap_size);
+        const ooc_node_t* n = &o->nodes[e.node];
+        o->last_used[e.node] = o->frame;
+
+        int visible[8], num_visible = 0, missing = 0, leaf = 1;
+        size_t extra = 0;
+        if (e.priority > threshold) {
+            for (int c = 0; c < 8; c++) {
+                int child = n->children[c];
+                if (child < 0) continue;
+                leaf = 0;
+                if (!aabbInFrustum(planes, o->nodes[child].bmin, o->nodes[child].bmax)) continue;
+                visible[num_visible++] = child;
+                extra += ooc_bytes(child);
+                if (__atomic_load_n(&o->state[child], __ATOMIC_ACQUIRE) != OOC_RESIDENT) missing++;
+            }
+        }
+        int refine = !leaf && touched + extra <= o->budget;
+        if (refine && missing) {
+            for (int c = 0; c < num_visible; c++) {
+                if (__atomic_load_n(&o->state[visible[c]], __ATOMIC_ACQUIRE) == OOC_ABSENT)
+                    o->wanted[num_wanted++] = (ooc_entry_t){e.priority, visible[c]};
+            }
+            refine = 0;
+        }
+        if (refine) {
+            touched += extra;
+            for (int c = 0; c < num_visible; c++)
+                ooc_heap_push(o->heap, &heap_size,
+                              (ooc_entry_t){ooc_screen_error(&o->nodes[visible[c]], eye, pixels_per_unit), visible[c]});
+            continue;
+        }
+
+        const ooc_vertex_t* v = o->data[e.node];
+        if (!v || n->num_vertices == 0) continue;
+        glVertexPointer(3, GL_FLOAT, sizeof(ooc_vertex_t), v->p);
+        glNormalPointer(GL_FLOAT, sizeof(ooc_vertex_t), v->n);
+        glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(ooc_vertex_t), v->c);
+        glDrawArrays(GL_TRIANGLES, 0, (GLsizei)n->num_vertices);
+        drawn += n->num_vertices / 3;
+    }
+
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glDisableClientState(GL_COLOR_ARRAY);
+    glDisable(GL_COLOR_MATERIAL);
+    glEnable(GL_TEXTURE_2D);
+
+    qsort(o->wanted, num_wanted, sizeof(ooc_entry_t), ooc_entry_desc);
+    if (num_wanted > OOC_MAX_REQUESTS) num_wanted = OOC_MAX_REQUESTS;
+    pthread_mutex_lock(&o->lock);
+    for (size_t i = 0; i < num_wanted; i++) o->requests[i] = o->wanted[i].node;
+    o->num_requests = (int)num_wanted;
+    if (num_wanted > 0) pthread_cond_signal(&o->cond);
+    pthread_mutex_unlock(&o->lock);
+
+    if (__atomic_load_n(&o->resident_bytes, __ATOMIC_RELAXED) > o->budget) ooc_evict();
+    return drawn;
+}
+
+// Chamado pelo timer: um bloco novo chegou desde o ultimo quadro.
+int oocArrived() {
+    return g_ooc.nodes && __atomic_exchange_n(&g_ooc.arrived, 0, __ATOMIC_ACQ_REL);
+}
+
+#define BVH_BINS 16
+#define BVH_MAX_LEAF 4
+// Abaixo de BVH_MAX_DEPTH niveis binarios o SAH da lugar a divisao pela
+// mediana, que termina em no maximo 31 niveis; cada nivel da BVH4 deixa ate
+// 3 entradas a mais na pilha do percurso.
+#define BVH_MAX_DEPTH 48
+#define BVH_STACK_SIZE (3 * (BVH_MAX_DEPTH + 32) + 1)
+#define BVH_PARALLEL_BINNING 262144
+
+typedef struct {
+    float bmin[3];
+    int first;
+    float bmax[3];
+    int count;
+} bvh_build_node_t;
+
+// No de 4 filhos com caixas em SoA (um eixo por vez para os 4 filhos), para
+// testar as 4 caixas com uma instrucao SIMD. Em uma folha, child e o
+// primeiro bloco de 4 triangulos e count o numero de blocos; em no interno
+// count e 0; slot vazio tem count -1.
+typedef struct {
+    float bmin[3][4];
+    float bmax[3][4];
+    int child[4];
+    int count[4];
+} bvh4_node_t;
+
+typedef struct {
+    float v0[3][4];
+    float e1[3][4];
+    float e2[3][4];
+    int prim[4];
+} bvh_tri4_t;
+
+typedef struct {
+    bvh4_node_t* nodes;
+    int num_nodes;
+    bvh_tri4_t* tris;
+    int num_tri4;
+    const face_t* faces;
+    size_t num_prims;
+    float bmin[3], bmax[3];
+    double build_ms;
+} bvh_t;
+
+typedef struct {
+    float t, u, v;
+    int prim;
+} hit_t;
+
+// Referencias sao particionadas no lugar junto com as caixas, para a
+// construcao andar na memoria em sequencia em vez de indexar por primitiva.
+typedef struct {
+    float bmin[3];
+    int prim;
+    float bmax[3];
+    float pad;
+} bvh_prim_ref_t;
+
+typedef struct {
+    const face_t* faces;
+    size_t num_prims;
+    bvh_build_node_t* nodes;
+    int num_nodes;
+    bvh_prim_ref_t* refs;
+} bvh_builder_t;
+
+typedef struct {
+    float node_min[3], node_max[3];
+    float cent_min[3], cent_max[3];
+} bvh_range_bounds_t;
+
+typedef struct {
+    int count[3][BVH_BINS];
+    float bmin[3][BVH_BINS][3];
+    float bmax[3][BVH_BINS][3];
+} bvh_bins_t;
+
+typedef struct {
+    const bvh_builder_t* builder;
+    int begin, end;
+    const float* cent_min;
+    const float* scale;
+    bvh_range_bounds_t* bounds;
+    bvh_bins_t* bins;
+} bvh_range_job_t;
+
+typedef struct {
+    int node, begin, end, depth;
+} bvh_task_t;
+
+typedef struct {
+    bvh_builder_t* builder;
+    bvh_task_t* tasks;
+    int num_tasks;
+    int next_task;
+} bvh_task_list_t;
+
+static inline float min_f(float a, float b) { return a < b ? a : b; }
+static inline float max_f(float a, float b) { return a > b ? a : b; }
+
+float bvhArea(const float* bmin, const float* bmax) {
+    float d[3] = {bmax[0] - bmin[0], bmax[1] - bmin[1], bmax[2] - bmin[2]};
+    if (d[0] < 0.0f || d[1] < 0.0f || d[2] < 0.0f) return 0.0f;
+    return 2.0f * (d[0] * d[1] + d[1] * d[2] + d[2] * d[0]);
+}
+
+void bvhRangeBounds(const bvh_builder_t* b, int begin, int end, bvh_range_bounds_t* r) {
+    for (int a = 0; a < 3; a++) {
+        r->node_min[a] = r->cent_min[a] = INFINITY;
+        r->node_max[a] = r->cent_max[a] = -INFINITY;
+    }
+    for (int i = begin; i < end; i++) {
+        const bvh_prim_ref_t* ref = &b->refs[i];
+        for (int a = 0; a < 3; a++) {
+            float c = (ref->bmin[a] + ref->bmax[a]) * 0.5f;
+            r->cent_min[a] = min_f(r->cent_min[a], c);
+            r->cent_max[a] = max_f(r->cent_max[a], c);
+            r->node_min[a] = min_f(r->node_min[a], ref->bmin[a]);
+            r->node_max[a] = max_f(r->node_max[a], ref->bmax[a]);
+        }
+    }
+}
+
+int bvhBinIndex(float c, float cent_min, float scale) {
+    int bin = (int)((c - cent_min) * scale);
+    return bin < 0 ? 0 : (bin >= BVH_BINS ? BVH_BINS - 1 : bin);
+}
+
+void bvhRangeBins(const bvh_builder_t* b, int begin, int end, const float* cent_min, const float* scale, bvh_bins_t* bins) {
+    for (int a = 0; a < 3; a++) {
+        for (int k = 0; k < BVH_BINS; k++) {
+            bins->count[a][k] = 0;
+            for (int c = 0; c < 3; c++) {
+                bins->bmin[a][k][c] = INFINITY;
+                bins->bmax[a][k][c] = -INFINITY;
+            }
+        }
+    }
+    for (int i = begin; i < end; i++) {
+        const bvh_prim_ref_t* ref = &b->refs[i];
+        for (int a = 0; a < 3; a++) {
+            if (scale[a] == 0.0f) continue;
+            int k = bvhBinIndex((ref->bmin[a] + ref->bmax[a]) * 0.5f, cent_min[a], scale[a]);
+            bins->count[a][k]++;
+            for (int c = 0; c < 3; c++) {
+                bins->bmin[a][k][c] = min_f(bins->bmin[a][k][c], ref->bmin[c]);
+                bins->bmax[a][k][c] = max_f(bins->bmax[a][k][c], ref->bmax[c]);
+            }
+        }
+    }
+}
+
+void bvhRangeJob(void* ctx, int thread_index) {
+    bvh_range_job_t* job = (bvh_range_job_t*)ctx;
+    int threads = numThreads();
+    int count = job->end - job->begin;
+    int begin = job->begin + (int)((int64_t)count * thread_index / threads);
+    int end = job->begin + (int)((int64_t)count * (thread_index + 1) / threads);
+    if (job->bins) {
+        bvhRangeBins(job->builder, begin, end, job->cent_min, job->scale, &job->bins[thread_index]);
+    } else {
+        bvhRangeBounds(job->builder, begin, end, &job->bounds[thread_index]);
+    }
+}
+
+// Divide o no em dois filhos por SAH binado em cada eixo. Em faixas grandes
+// (os niveis de cima, antes de haver subarvores para paralelizar) os limites
+// e os baldes sao acumulados em paralelo. Retorna o ponto de particao, ou
+// -1 quando virar folha for mais barato.
+int bvhSplit(bvh_builder_t* b, bvh_build_node_t* node, int begin, int end, int depth, int parallel) {
+    int threads = numThreads();
+    int use_threads = parallel && threads > 1 && end - begin >= BVH_PARALLEL_BINNING;
+    bvh_range_bounds_t r;
+    if (use_threads) {
+        bvh_range_bounds_t* partial = (bvh_range_bounds_t*)malloc(threads * sizeof(bvh_range_bounds_t));
+        bvh_range_job_t job = {b, begin, end, NULL, NULL, partial, NULL};
+        runParallel(bvhRangeJob, &job);
+        r = partial[0];
+        for (int t = 1; t < threads; t++) {
+            for (int a = 0; a < 3; a++) {
+                r.node_min[a] = min_f(r.node_min[a], partial[t].node_min[a]);
+                r.node_max[a] = max_f(r.node_max[a], partial[t].node_max[a]);
+                r.cent_min[a] = min_f(r.cent_min[a], partial[t].cent_min[a]);
+                r.cent_max[a] = max_f(r.cent_max[a], partial[t].cent_max[a]);
+            }
+        }
+        free(partial);
+    } else {
+        bvhRangeBounds(b, begin, end, &r);
+    }
+    memcpy(node->bmin, r.node_min, sizeof(node->bmin));
+    memcpy(node->bmax, r.node_max, sizeof(node->bmax));
+
+    int count = end - begin;
+    if (count <= BVH_MAX_LEAF) return -1;
+    if (depth >= BVH_MAX_DEPTH) return begin + count / 2;
+
+    float scale[3];
+    for (int a = 0; a < 3; a++) {
+        float extent = r.cent_max[a] - r.cent_min[a];
+        scale[a] = extent > 0.0f ? BVH_BINS / extent : 0.0f;
+    }
+
+    bvh_bins_t bins;
+    if (use_threads) {
+        bvh_bins_t* partial = (bvh_bins_t*)malloc(threads * sizeof(bvh_bins_t));
+        bvh_range_job_t job = {b, begin, end, r.cent_min, scale, NULL, partial};
+        runParallel(bvhRangeJob, &job);
+        bins = partial[0];
+        for (int t = 1; t < threads; t++) {
+            for (int a = 0; a < 3; a++) {
+                for (int k = 0; k < BVH_BINS; k++) {
+                    bins.count[a][k] += partial[t].count[a][k];
+                    for (int c = 0; c < 3; c++) {
+                        bins.bmin[a][k][c] = min_f(bins.bmin[a][k][c], partial[t].bmin[a][k][c]);
+                        bins.bmax[a][k][c] = max_f(bins.bmax[a][k][c], partial[t].bmax[a][k][c]);
+                    }
+                }
+            }
+        }
+        free(partial);
+    } else {
+        bvhRangeBins(b, begin, end, r.cent_min, scale, &bins);
+    }
+
+    float best_cost = INFINITY;
+    int best_axis = -1, best_bin = 0;
+    for (int a = 0; a < 3; a++) {
+        if (scale[a] == 0.0f) continue;
+
+        float right_area[BVH_BINS];
+        int right_count[BVH_BINS];
+        float rmin[3] = {INFINITY, INFINITY, INFINITY}, rmax[3] = {-INFINITY, -INFINITY, -INFINITY};
+        int rc = 0;
+        for (int k = BVH_BINS - 1; k > 0; k--) {
+            rc += bins.count[a][k];
+            for (int c = 0; c < 3; c++) {
+                rmin[c] = min_f(rmin[c], bins.bmin[a][k][c]);
+                rmax[c] = max_f(rmax[c], bins.bmax[a][k][c]);
+            }
+            right_area[k] = bvhArea(rmin, rmax);
+            right_count[k] = rc;
+        }
+
+        float lmin[3] = {INFINITY, INFINITY, INFINITY}, lmax[3] = {-INFINITY, -INFINITY, -INFINITY};
+        int lc = 0;
+        for (int k = 0; k < BVH_BINS - 1; k++) {
+            lc += bins.count[a][k];
+            for (int c = 0; c < 3; c++) {
+                lmin[c] = min_f(lmin[c], bins.bmin[a][k][c]);
+                lmax[c] = max_f(lmax[c], bins.bmax[a][k][c]);
+            }
+            if (lc == 0 || right_count[k + 1] == 0) continue;
+            float cost = bvhArea(lmin, lmax) * lc + right_area[k + 1] * right_count[k + 1];
+            if (cost < best_cost) {
+                best_cost = cost;
+                best_axis = a;
+                best_bin = k;
+            }
+        }
+    }
+
+    float leaf_cost = bvhArea(node->bmin, node->bmax) * count;
+    if (best_axis < 0 || best_cost >= leaf_cost) {
+        if (count <= 4 * BVH_MAX_LEAF) return -1;
+        if (best_axis < 0) return begin + count / 2;
+    }
+
+    int i = begin, j = end - 1;
+    while (i <= j) {
+        const bvh_prim_ref_t* ref = &b->refs[i];
+        float c = (ref->bmin[best_axis] + ref->bmax[best_axis]) * 0.5f;
+        if (bvhBinIndex(c, r.cent_min[best_axis], scale[best_axis]) <= best_bin) {
+            i++;
+        } else {
+            bvh_prim_ref_t t = b->refs[i];
+            b->refs[i] = b->refs[j];
+            b->refs[j--] = t;
+        }
+    }
+    return i;
+}
+
+int bvhAllocNodes(bvh_builder_t* b, int count) {
+    return __atomic_fetch_add(&b->num_nodes, count, __ATOMIC_RELAXED);
+}
+
+void bvhBuildRecursive(bvh_builder_t* b, int node_index, int begin, int end, int depth) {
+    bvh_build_node_t* node = &b->nodes[node_index];
+    int mid = bvhSplit(b, node, begin, end, depth, 0);
+    if (mid < 0) {
+        node->first = begin;
+        node->count = end - begin;
+        return;
+    }
+    int left = bvhAllocNodes(b, 2);
+    node->first = left;
+    node->count = 0;
+    bvhBuildRecursive(b, left, begin, mid, depth + 1);
+    bvhBuildRecursive(b, left + 1, mid, end, depth + 1);
+}
+
+void bvhTaskJob(void* ctx, int thread_index) {
+    bvh_task_list_t* list = (bvh_task_list_t*)ctx;
+    int task;
+    while ((task = __atomic_fetch_add(&list->next_task, 1, __ATOMIC_RELAXED)) < list->num_tasks) {
+        bvh_task_t* t = &list->tasks[task];
+        bvhBuildRecursive(list->builder, t->node, t->begin, t->end, t->depth);
+    }
+}
+
+void bvhPrepareJob(void* ctx, int thread_index) {
+    bvh_builder_t* b = (bvh_builder_t*)ctx;
+    int threads = numThreads();
+    size_t begin = b->num_prims * thread_index / threads;
+    size_t end = b->num_prims * (thread_index + 1) / threads;
+    for (size_t i = begin; i < end; i++) {
+        const face_t* f = &b->faces[i];
+        bvh_prim_ref_t* ref = &b->refs[i];
+        for (int a = 0; a < 3; a++) {
+            ref->bmin[a] = INFINITY;
+            ref->bmax[a] = -INFINITY;
+        }
+        for (int k = 0; k < 3; k++) {
+            const float* p = &g_vertices[f->v[k].v_idx - 1].x;
+            for (int a = 0; a < 3; a++) {
+                ref->bmin[a] = min_f(ref->bmin[a], p[a]);
+                ref->bmax[a] = max_f(ref->bmax[a], p[a]);
+            }
+        }
+        ref->prim = (int)i;
+        ref->pad = 0.0f;
+    }
+}
+
+int bvhPackLeaf(bvh_t* bvh, const bvh_builder_t* b, const bvh_build_node_t* leaf) {
+    int first = bvh->num_tri4;
+    for (int i = 0; i < leaf->count; i += 4) {
+        bvh_tri4_t* t = &bvh->tris[bvh->num_tri4++];
+        for (int lane = 0; lane < 4; lane++) {
+            int prim = i + lane < leaf->count ? b->refs[leaf->first + i + lane].prim : -1;
+            t->prim[lane] = prim;
+            const face_t* f = &b->faces[prim >= 0 ? prim : b->refs[leaf->first].prim];
+            const vec3f* p0 = &g_vertices[f->v[0].v_idx - 1];
+            const vec3f* p1 = &g_vertices[f->v[1].v_idx - 1];
+            const vec3f* p2 = &g_vertices[f->v[2].v_idx - 1];
+            t->v0[0][lane] = p0->x; t->v0[1][lane] = p0->y; t->v0[2][lane] = p0->z;
+            t->e1[0][lane] = p1->x - p0->x; t->e1[1][lane] = p1->y - p0->y; t->e1[2][lane] = p1->z - p0->z;
+            t->e2[0][lane] = p2->x - p0->x; t->e2[1][lane] = p2->y - p0->y; t->e2[2][lane] = p2->z - p0->z;
+        }
+    }
+    return first;
+}
+
+// Achata a arvore binaria em nos de 4 filhos: abre sempre o filho interno de
+// maior area ate ter 4 filhos.
+int bvhCollapse(bvh_t* bvh, const bvh_builder_t* b, int binary_index) {
+    int index = bvh->num_nodes++;
+    int children[4];
+    int num_children = 0;
+    const bvh_build_node_t* root = &b->nodes[binary_index];
+    if (root->count > 0) {
+        children[num_children++] = binary_index;
+    } else {
+        children[num_children++] = root->first;
+        children[num_children++] = root->first + 1;
+    }
+
+    while (num_children < 4) {
+        int best = -1;
+        float best_area = -1.0f;
+        for (int i = 0; i < num_children; i++) {
+            const bvh_build_node_t* c = &b->nodes[children[i]];
+            float area = bvhArea(c->bmin, c->bmax);
+            if (c->count == 0 && area > best_area) {
+                best_area = area;
+                best = i;
+            }
+        }
+        if (best < 0) break;
+        int expand = children[best];
+        children[best] = b->nodes[expand].first;
+        children[num_children++] = b->nodes[expand].first + 1;
+    }
+
+    bvh4_node_t node;
+    for (int i = 0; i < 4; i++) {
+        if (i >= num_children) {
+            for (int a = 0; a < 3; a++) {
+                node.bmin[a][i] = INFINITY;
+                node.bmax[a][i] = -INFINITY;
+            }
+            node.child[i] = 0;
+            node.count[i] = -1;
+            continue;
+        }
+        const bvh_build_node_t* c = &b->nodes[children[i]];
+        for (int a = 0; a < 3; a++) {
+            node.bmin[a][i] = c->bmin[a];
+            node.bmax[a][i] = c->bmax[a];
+        }
+        if (c->count > 0) {
+            node.child[i] = bvhPackLeaf(bvh, b, c);
+            node.count[i] = (c->count + 3) / 4;
+        } else {
+            node.child[i] = bvhCollapse(bvh, b, children[i]);
+            node.count[i] = 0;
+        }
+    }
+    bvh->nodes[index] = node;
+    return index;
+}
+
+void buildBVH(bvh_t* bvh, const face_t* faces, size_t num_faces) {
+    double start = get_time_ms();
+    memset(bvh, 0, sizeof(bvh_t));
+    bvh->faces = faces;
+    bvh->num_prims = num_faces;
+    if (num_faces == 0) return;
+
+    bvh_builder_t b;
+    b.faces = faces;
+    b.num_prims = num_faces;
+    b.num_nodes = 0;
+    b.refs = (bvh_prim_ref_t*)malloc(num_faces * sizeof(bvh_prim_ref_t));
+    b.nodes = (bvh_build_node_t*)malloc((2 * num_faces + 1) * sizeof(bvh_build_node_t));
+    runParallel(bvhPrepareJob, &b);
+
+    // Os niveis de cima sao divididos em serie (com baldes em paralelo) ate
+    // haver subarvores suficientes; cada subarvore vira uma tarefa.
+    bvh_task_list_t list = {&b, NULL, 0, 0};
+    int max_tasks = numThreads() > 1 ? numThreads() * 8 : 1;
+    list.tasks = (bvh_task_t*)malloc((max_tasks + 1) * sizeof(bvh_task_t));
+    list.tasks[list.num_tasks++] = (bvh_task_t){bvhAllocNodes(&b, 1), 0, (int)num_faces, 0};
+    while (list.num_tasks < max_tasks) {
+        int largest = 0;
+        for (int i = 1; i < list.num_tasks; i++) {
+            if (list.tasks[i].end - list.tasks[i].begin > list.tasks[largest].end - list.tasks[largest].begin) largest = i;
+        }
+        bvh_task_t t = list.tasks[largest];
+        if (t.end - t.begin < 4096) break;
+
+        bvh_build_node_t* node = &b.nodes[t.node];
+        int mid = bvhSplit(&b, node, t.begin, t.end, t.depth, 1);
+        if (mid < 0) break;
+        int left = bvhAllocNodes(&b, 2);
+        node->first = left;
+        node->count = 0;
+        list.tasks[largest] = (bvh_task_t){left, t.begin, mid, t.depth + 1};
+        list.tasks[list.num_tasks++] = (bvh_task_t){left + 1, mid, t.end, t.depth + 1};
+    }
+    runParallel(bvhTaskJob, &list);
+    free(list.tasks);
+
+    int blocks = 0, inner = 0;
+    for (int n = 0; n < b.num_nodes; n++) {
+        if (b.nodes[n].count > 0) blocks += (b.nodes[n].count + 3) / 4;
+        else inner++;
+    }
+    bvh->tris = (bvh_tri4_t*)malloc((size_t)blocks * sizeof(bvh_tri4_t));
+    bvh->nodes = (bvh4_node_t*)malloc((size_t)(inner + 1) * sizeof(bvh4_node_t));
+    memcpy(bvh->bmin, b.nodes[0].bmin, sizeof(bvh->bmin));
+    memcpy(bvh->bmax, b.nodes[0].bmax, sizeof(bvh->bmax));
+    bvhCollapse(bvh, &b, 0);
+
+    free(b.nodes);
+    free(b.refs);
+    bvh->build_ms = get_time_ms() - start;
+}
+
+void freeBVH(bvh_t* bvh) {
+    free(bvh->nodes);
+    free(bvh->tris);
+    memset(bvh, 0, sizeof(bvh_t));
+}
+
+size_t bvhMemory(const bvh_t* bvh) {
+    return (size_t)bvh->num_nodes * sizeof(bvh4_node_t) + (size_t)bvh->num_tri4 * sizeof(bvh_tri4_t);
+}
+
+// Custo SAH com custo 1 por no visitado e 1 por bloco de 4 triangulos.
+double bvhSAHCost(const bvh_t* bvh) {
+    double root_area = bvhArea(bvh->bmin, bvh->bmax);
+    if (bvh->num_nodes == 0 || root_area <= 0.0) return 0.0;
+
+    double cost = 1.0;
+    for (int n = 0; n < bvh->num_nodes; n++) {
+        const bvh4_node_t* node = &bvh->nodes[n];
+        for (int i = 0; i < 4; i++) {
+            if (node->count[i] < 0) continue;
+            float bmin[3] = {node->bmin[0][i], node->bmin[1][i], node->bmin[2][i]};
+            float bmax[3] = {node->bmax[0][i], node->bmax[1][i], node->bmax[2][i]};
+            cost += bvhArea(bmin, bmax) / root_area * (node->count[i] > 0 ? node->count[i] : 1);
+        }
+    }
+    return cost;
+}
+
+// Testa um raio contra as 4 caixas do no; devolve a mascara de acertos e a
+// distancia de entrada de cada filho.
+int bvhIntersectNode(const bvh4_node_t* node, const float* org, const float* inv_dir, float tmax, float* tnear) {
+#ifdef __SSE2__
+    __m128 t0x = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node->bmin[0]), _mm_set1_ps(org[0])), _mm_set1_ps(inv_dir[0]));
+    __m128 t1x = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node->bmax[0]), _mm_set1_ps(org[0])), _mm_set1_ps(inv_dir[0]));
+    __m128 t0y = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node->bmin[1]), _mm_set1_ps(org[1])), _mm_set1_ps(inv_dir[1]));
+    __m128 t1y = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node->bmax[1]), _mm_set1_ps(org[1])), _mm_set1_ps(inv_dir[1]));
+    __m128 t0z = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node->bmin[2]), _mm_set1_ps(org[2])), _mm_set1_ps(inv_dir[2]));
+    __m128 t1z = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node->bmax[2]), _mm_set1_ps(org[2])), _mm_set1_ps(inv_dir[2]));
+    __m128 tmin = _mm_max_ps(_mm_max_ps(_mm_min_ps(t0x, t1x), _mm_min_ps(t0y, t1y)),
+                             _mm_max_ps(_mm_min_ps(t0z, t1z), _mm_setzero_ps()));
+    __m128 tfar = _mm_min_ps(_mm_min_ps(_mm_max_ps(t0x, t1x), _mm_max_ps(t0y, t1y)),
+                             _mm_min_ps(_mm_max_ps(t0z, t1z), _mm_set1_ps(tmax)));
+    _mm_storeu_ps(tnear, tmin);
+    int mask = _mm_movemask_ps(_mm_cmple_ps(tmin, tfar));
+#else
+    int mask = 0;
+    for (int i = 0; i < 4; i++) {
+        float t0 = 0.0f, t1 = tmax;
+        for (int a = 0; a < 3; a++) {
+            float ta = (node->bmin[a][i] - org[a]) * inv_dir[a];
+            float tb = (node->bmax[a][i] - org[a]) * inv_dir[a];
+            t0 = max_f(t0, min_f(ta, tb));
+            t1 = min_f(t1, max_f(ta, tb));
+        }
+        tnear[i] = t0;
+        if (t0 <= t1) mask |= 1 << i;
+    }
+#endif
+    for (int i = 0; i < 4; i++)
+        if (node->count[i] < 0) mask &= ~(1 << i);
+    return mask;
+}
+
+// Moller-Trumbore de um raio contra 4 triangulos de uma vez.
+void bvhIntersectTri4(const bvh_tri4_t* t, const float* org, const float* dir, hit_t* hit) {
+#ifdef __SSE2__
+    __m128 dx = _mm_set1_ps(dir[0]), dy = _mm_set1_ps(dir[1]), dz = _mm_set1_ps(dir[2]);
+    __m128 e1x = _mm_loadu_ps(t->e1[0]), e1y = _mm_loadu_ps(t->e1[1]), e1z = _mm_loadu_ps(t->e1[2]);
+    __m128 e2x = _mm_loadu_ps(t->e2[0]), e2y = _mm_loadu_ps(t->e2[1]), e2z = _mm_loadu_ps(t->e2[2]);
+
+    __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+    __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+    __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+    __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+    __m128 inv_det = _mm_div_ps(_mm_set1_ps(1.0f), det);
+
+    __m128 tx = _mm_sub_ps(_mm_set1_ps(org[0]), _mm_loadu_ps(t->v0[0]));
+    __m128 ty = _mm_sub_ps(_mm_set1_ps(org[1]), _mm_loadu_ps(t->v0[1]));
+    __m128 tz = _mm_sub_ps(_mm_set1_ps(org[2]), _mm_loadu_ps(t->v0[2]));
+    __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, px), _mm_mul_ps(ty, py)), _mm_mul_ps(tz, pz)), inv_det);
+
+    __m128 qx = _mm_sub_ps(_mm_mul_ps(ty, e1z), _mm_mul_ps(tz, e1y));
+    __m128 qy = _mm_sub_ps(_mm_mul_ps(tz, e1x), _mm_mul_ps(tx, e1z));
+    __m128 qz = _mm_sub_ps(_mm_mul_ps(tx, e1y), _mm_mul_ps(ty, e1x));
+    __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), inv_det);
+    __m128 dist = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inv_det);
+
+    __m128 zero = _mm_setzero_ps();
+    __m128 abs_det = _mm_andnot_ps(_mm_set1_ps(-0.0f), det);
+    __m128 mask = _mm_cmpgt_ps(abs_det, _mm_set1_ps(1e-12f));
+    mask = _mm_and_ps(mask, _mm_cmpge_ps(u, zero));
+    mask = _mm_and_ps(mask, _mm_cmpge_ps(v, zero));
+    mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(u, v), _mm_set1_ps(1.0f)));
+    mask = _mm_and_ps(mask, _mm_cmpgt_ps(dist, _mm_set1_ps(1e-5f)));
+    mask = _mm_and_ps(mask, _mm_cmplt_ps(dist, _mm_set1_ps(hit->t)));
+    int bits = _mm_movemask_ps(mask);
+    if (!bits) return;
+
+    float ts[4], us[4], vs[4];
+    _mm_storeu_ps(ts, dist);
+    _mm_storeu_ps(us, u);
+    _mm_storeu_ps(vs, v);
+    for (int lane = 0; lane < 4; lane++) {
+        if ((bits >> lane & 1) && t->prim[lane] >= 0 && ts[lane] < hit->t) {
+            *hit = (hit_t){ts[lane], us[lane], vs[lane], t->prim[lane]};
+        }
+    }
+#else
+    for (int lane = 0; lane < 4; lane++) {
+        if (t->prim[lane] < 0) continue;
+        float e1[3] = {t->e1[0][lane], t->e1[1][lane], t->e1[2][lane]};
+        float e2[3] = {t->e2[0][lane], t->e2[1][lane], t->e2[2][lane]};
+        float p[3] = {dir[1] * e2[2] - dir[2] * e2[1], dir[2] * e2[0] - dir[0] * e2[2], dir[0] * e2[1] - dir[1] * e2[0]};
+        float det = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+        if (fabsf(det) <= 1e-12f) continue;
+        float inv_det = 1.0f / det;
+        float s[3] = {org[0] - t->v0[0][lane], org[1] - t->v0[1][lane], org[2] - t->v0[2][lane]};
+        float u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * inv_det;
+        if (u < 0.0f) continue;
+        float q[3] = {s[1] * e1[2] - s[2] * e1[1], s[2] * e1[0] - s[0] * e1[2], s[0] * e1[1] - s[1] * e1[0]};
+        float v = (dir[0] * q[0] + dir[1] * q[1] + dir[2] * q[2]) * inv_det;
+        if (v < 0.0f || u + v > 1.0f) continue;
+        float dist = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) * inv_det;
+        if (dist > 1e-5f && dist < hit->t) *hit = (hit_t){dist, u, v, t->prim[lane]};
+    }
+#endif
+}
+
+
+// Retorna 1 se achou intersecao antes de hit->t. Com any_hit, para no
+// primeiro triangulo encontrado (raios de sombra).
+int intersectBVH(const bvh_t* bvh, const float* org, const float* dir, hit_t* hit, int any_hit) {
+    if (bvh->num_nodes == 0) return 0;
+
+    float inv_dir[3];
+    for (int a = 0; a < 3; a++) inv_dir[a] = 1.0f / (dir[a] != 0.0f ? dir[a] : 1e-30f);
+
+    int stack_child[BVH_STACK_SIZE], stack_count[BVH_STACK_SIZE];
+    float stack_t[BVH_STACK_SIZE];
+    int sp = 0;
+    int found = 0;
+    stack_child[sp] = 0;
+    stack_count[sp] = 0;
+    stack_t[sp++] = 0.0f;
+
+    while (sp > 0) {
+        sp--;
+        if (stack_t[sp] > hit->t) continue;
+        int child = stack_child[sp];
+        int count = stack_count[sp];
+
+        if (count > 0) {
+            for (int i = 0; i < count; i++) {
+                int prim = hit->prim;
+                bvhIntersectTri4(&bvh->tris[child + i], org, dir, hit);
+                if (hit->prim != prim) {
+                    found = 1;
+                    if (any_hit) return 1;
+                }
+            }
+            continue;
+        }
+
+        const bvh4_node_t* node = &bvh->nodes[child];
+        float tnear[4];
+        int mask = bvhIntersectNode(node, org, inv_dir, hit->t, tnear);
+
+        // Empilha do mais distante para o mais proximo.
+        int order[4], num = 0;
+        for (int i = 0; i < 4; i++) {
+            if (!(mask >> i & 1)) continue;
+            int j = num++;
+            while (j > 0 && tnear[order[j - 1]] < tnear[i]) {
+                order[j] = order[j - 1];
+                j--;
+            }
+            order[j] = i;
+        }
+        for (int j = 0; j < num; j++) {
+            stack_child[sp] = node->child[order[j]];
+            stack_count[sp] = node->count[order[j]];
+            stack_t[sp++] = tnear[order[j]];
+        }
+    }
+    return found;
+}
+
+void benchmarkBVHOnce() {
+    bvh_t bvh;
+    buildBVH(&bvh, g_faces, g_num_faces);
+    printf("BVH4: %zu triangulos, construcao %.1f ms (%.2f Mtri/s, %d threads), custo SAH %.2f, %d nos, %d blocos, %.1f MB\n",
+           g_num_faces, bvh.build_ms, g_num_faces / bvh.build_ms / 1000.0, numThreads(), bvhSAHCost(&bvh),
+           bvh.num_nodes, bvh.num_tri4, bvhMemory(&bvh) / 1048576.0);
+    freeBVH(&bvh);
+}
+
+// Com um modelo carregado mede so ele; senao gera esferas deformadas com os
+// tamanhos pedidos, em milhoes de triangulos ("1,10,50").
+void benchmarkBVH(const char* sizes) {
+    if (g_num_faces > 0) {
+        benchmarkBVHOnce();
+        return;
+    }
+    const char* p = sizes;
+    while (*p) {
+        char* next;
+        double millions = strtod(p, &next);
+        if (next == p) break;
+        generateBenchmarkMesh((size_t)(millions * 1000000.0));
+        benchmarkBVHOnce();
+        p = *next == ',' ? next + 1 : next;
+    }
+}
+
+#define PT_TILE_SIZE 16
+#define PT_MAX_DEPTH 5
+
+typedef struct {
+    bvh_t bvh;
+    int width, height;
+    float* radiance;
+    int samples;
+    int next_tile;
+    uint64_t rays;
+    float rotation[9];
+    float eye[3];
+    float light[3];
+    float light_power;
+    float sky;
+} path_tracer_t;
+
+void ptSurface(const hit_t* hit, const float* dir, float* normal, float* albedo) {
+    const face_t* f = &g_faces[hit->prim];
+    float w0 = 1.0f - hit->u - hit->v;
+    const vec3f* p0 = &g_vertices[f->v[0].v_idx - 1];
+    vec3f gn = face_normal(p0, &g_vertices[f->v[1].v_idx - 1], &g_vertices[f->v[2].v_idx - 1]);
+    float n[3] = {gn.x, gn.y, gn.z};
+
+    int has_normals = 1;
+    for (int k = 0; k < 3; k++)
+        if (f->v[k].vn_idx <= 0 || f->v[k].vn_idx > (int)g_num_normals) has_normals = 0;
+    if (has_normals) {
+        const vec3f* n0 = &g_normals[f->v[0].vn_idx - 1];
+        const vec3f* n1 = &g_normals[f->v[1].vn_idx - 1];
+        const vec3f* n2 = &g_normals[f->v[2].vn_idx - 1];
+        n[0] = w0 * n0->x + hit->u * n1->x + hit->v * n2->x;
+        n[1] = w0 * n0->y + hit->u * n1->y + hit->v * n2->y;
+        n[2] = w0 * n0->z + hit->u * n1->z + hit->v * n2->z;
+    }
+    float len = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    if (len == 0.0f) len = 1.0f;
+    float facing = n[0] * dir[0] + n[1] * dir[1] + n[2] * dir[2] > 0.0f ? -1.0f : 1.0f;
+    for (int a = 0; a < 3; a++) normal[a] = n[a] / len * facing;
+
+    const image_t* image = &g_default_image;
+    if (f->material_id >= 0 && g_materials[f->material_id].image.pixels) image = &g_materials[f->material_id].image;
+    float uv[2] = {0.0f, 0.0f};
+    int has_uv = 1;
+    for (int k = 0; k < 3; k++)
+        if (f->v[k].vt_idx <= 0 || f->v[k].vt_idx > (int)g_num_texcoords) has_uv = 0;
+    if (has_uv) {
+        const vec2f* t0 = &g_texcoords[f->v[0].vt_idx - 1];
+        const vec2f* t1 = &g_texcoords[f->v[1].vt_idx - 1];
+        const vec2f* t2 = &g_texcoords[f->v[2].vt_idx - 1];
+        uv[0] = w0 * t0->u + hit->u * t1->u + hit->v * t2->u;
+        uv[1] = w0 * t0->v + hit->u * t1->v + hit->v * t2->v;
+    }
+    sampleImage(image, uv[0], uv[1], albedo);
+    for (int c = 0; c < 3; c++) albedo[c] *= 0.8f;
+}
+
+void ptTracePath(path_tracer_t* pt, float* org, float* dir, uint64_t* rng, float* out, uint64_t* rays) {
+    float throughput[3] = {1.0f, 1.0f, 1.0f};
+    out[0] = out[1] = out[2] = 0.0f;
+
+    for (int depth = 0; depth < PT_MAX_DEPTH; depth++) {
+        hit_t hit = {INFINITY, 0.0f, 0.0f, -1};
+        (*rays)++;
+        if (!intersectBVH(&pt->bvh, org, dir, &hit, 0)) {
+            for (int c = 0; c < 3; c++) out[c] += throughput[c] * pt->sky;
+            return;
+        }
+
+        float n[3], albedo[3];
+        ptSurface(&hit, dir, n, albedo);
+        float p[3];
+        for (int a = 0; a < 3; a++) p[a] = org[a] + dir[a] * hit.t + n[a] * g_size * 1e-5f;
+
+        float to_light[3] = {pt->light[0] - p[0], pt->light[1] - p[1], pt->light[2] - p[2]};
+        float dist2 = to_light[0] * to_light[0] + to_light[1] * to_light[1] + to_light[2] * to_light[2];
+        float dist = sqrtf(dist2);
+        for (int a = 0; a < 3; a++) to_light[a] /= dist;
+        float cos_l = n[0] * to_light[0] + n[1] * to_light[1] + n[2] * to_light[2];
+        if (cos_l > 0.0f) {
+            hit_t shadow = {dist, 0.0f, 0.0f, -1};
+            (*rays)++;
+            if (!intersectBVH(&pt->bvh, p, to_light, &shadow, 1)) {
+                float e = pt->light_power * cos_l / (dist2 * (float)M_PI);
+                for (int c = 0; c < 3; c++) out[c] += throughput[c] * albedo[c] * e;
+            }
+        }
+
+        // Amostragem do hemisferio por cosseno: o peso fica so o albedo.
+        float r1 = pcgFloat(rng), r2 = pcgFloat(rng);
+        float phi = 2.0f * (float)M_PI * r1;
+        float sr = sqrtf(r2);
+        float local[3] = {cosf(phi) * sr, sinf(phi) * sr, sqrtf(1.0f - r2)};
+        float t[3], b[3];
+        if (fabsf(n[0]) > 0.9f) {
+            t[0] = n[1]; t[1] = -n[0]; t[2] = 0.0f;
+        } else {
+            t[0] = 0.0f; t[1] = n[2]; t[2] = -n[1];
+        }
+        float tl = sqrtf(t[0] * t[0] + t[1] * t[1] + t[2] * t[2]);
+        for (int a = 0; a < 3; a++) t[a] /= tl;
+        b[0] = n[1] * t[2] - n[2] * t[1];
+        b[1] = n[2] * t[0] - n[0] * t[2];
+        b[2] = n[0] * t[1] - n[1] * t[0];
+        for (int a = 0; a < 3; a++) {
+            org[a] = p[a];
+            dir[a] = t[a] * local[0] + b[a] * local[1] + n[a] * local[2];
+        }
+        for (int c = 0; c < 3; c++) throughput[c] *= albedo[c];
+
+        if (depth >= 2) {
+            float survive = fmaxf(throughput[0], fmaxf(throughput[1], throughput[2]));
+            if (survive < 1.0f) {
+                if (pcgFloat(rng) >= survive) return;
+                for (int c = 0; c < 3; c++) throughput[c] /= survive;
+            }
+        }
+    }
+}
+
+void ptRenderJob(void* ctx, int thread_index) {
+    path_tracer_t* pt = (path_tracer_t*)ctx;
+    int tiles_x = (pt->width + PT_TILE_SIZE - 1) / PT_TILE_SIZE;
+    int tiles_y = (pt->height + PT_TILE_SIZE - 1) / PT_TILE_SIZE;
+    float tan_half = tanf(30.0f * (float)M_PI / 180.0f);
+    float aspect = (float)pt->width / pt->height;
+    uint64_t rays = 0;
+    int tile;
+
+    while ((tile = __atomic_fetch_add(&pt->next_tile, 1, __ATOMIC_RELAXED)) < tiles_x * tiles_y) {
+        int x0 = (tile % tiles_x) * PT_TILE_SIZE;
+        int y0 = (tile / tiles_x) * PT_TILE_SIZE;
+        for (int y = y0; y < y0 + PT_TILE_SIZE && y < pt->height; y++) {
+            for (int x = x0; x < x0 + PT_TILE_SIZE && x < pt->width; x++) {
+                uint64_t rng = ((uint64_t)(y * pt->width + x) << 20) ^ ((uint64_t)pt->samples * 0x9E3779B97F4A7C15ULL);
+                pcgNext(&rng);
+                float sx = ((x + pcgFloat(&rng)) / pt->width * 2.0f - 1.0f) * tan_half * aspect;
+                float sy = (1.0f - (y + pcgFloat(&rng)) / pt->height * 2.0f) * tan_half;
+                float cam[3] = {sx, sy, -1.0f};
+                float len = sqrtf(sx * sx + sy * sy + 1.0f);
+
+                // Camera do visualizador levada ao espaco do objeto: R^T aplicado
+                // a origem e a direcao, com R = Rx * Ry.
+                float org[3], dir[3];
+                const float* r = pt->rotation;
+                for (int a = 0; a < 3; a++) {
+                    org[a] = r[a] * pt->eye[0] + r[3 + a] * pt->eye[1] + r[6 + a] * pt->eye[2];
+                    dir[a] = (r[a] * cam[0] + r[3 + a] * cam[1] + r[6 + a] * cam[2]) / len;
+                }
+
+                float color[3];
+                ptTracePath(pt, org, dir, &rng, color, &rays);
+                float* acc = &pt->radiance[((size_t)y * pt->width + x) * 3];
+                for (int c = 0; c < 3; c++) acc[c] += color[c];
+            }
+        }
+    }
+    __atomic_fetch_add(&pt->rays, rays, __ATOMIC_RELAXED);
+}
+
+void ptWriteImage(path_tracer_t* pt, const char* filename) {
+    size_t pixels = (size_t)pt->width * pt->height;
+    unsigned char* rgb = (unsigned char*)malloc(pixels * 3);
+    for (size_t i = 0; i < pixels * 3; i++) {
+        float v = pt->radiance[i] / pt->samples;
+        v = powf(v > 1.0f ? 1.0f : v, 1.0f / 2.2f);
+        rgb[i] = (unsigned char)(v * 255.0f + 0.5f);
+    }
+    if (!writePNG(filename, rgb, pt->width, pt->height)) printf("Falha ao gravar %s\n", filename);
+    free(rgb);
+}
+
+void renderPathTraced(const char* filename, int width, int height, int samples, int progress_every) {
+    path_tracer_t pt;
+    memset(&pt, 0, sizeof(pt));
+    pt.width = width;
+    pt.height = height;
+    pt.radiance = (float*)calloc((size_t)width * height * 3, sizeof(float));
+    buildBVH(&pt.bvh, g_faces, g_num_faces);
+    printf("BVH: %zu triangulos, %.1f ms, custo SAH %.2f\n", g_num_faces, pt.bvh.build_ms, bvhSAHCost(&pt.bvh));
+
+    float rx = g_rotateX * (float)M_PI / 180.0f, ry = g_rotateY * (float)M_PI / 180.0f;
+    float cx = cosf(rx), sx = sinf(rx), cy = cosf(ry), sy = sinf(ry);
+    float rotation[9] = {cy, 0.0f, sy, sx * sy, cx, -sx * cy, -cx * sy, sx, cx * cy};
+    memcpy(pt.rotation, rotation, sizeof(rotation));
+    pt.eye[0] = g_center[0];
+    pt.eye[1] = g_center[1];
+    pt.eye[2] = g_center[2] + g_size * 2.0f;
+    float light_world[3] = {g_center[0], g_center[1] + g_size, g_center[2] + g_size};
+    for (int a = 0; a < 3; a++) {
+        pt.light[a] = rotation[a] * light_world[0] + rotation[3 + a] * light_world[1] + rotation[6 + a] * light_world[2];
+    }
+    pt.light_power = (float)M_PI * 2.0f * g_size * g_size;
+    pt.sky = 0.3f;
+
+    double start = get_time_ms();
+    for (int s = 0; s < samples; s++) {
+        pt.next_tile = 0;
+        runParallel(ptRenderJob, &pt);
+        pt.samples++;
+        if ((progress_every > 0 && pt.samples % progress_every == 0) || pt.samples == samples) {
+            double elapsed = (get_time_ms() - start) / 1000.0;
+            ptWriteImage(&pt, filename);
+            printf("%s: %d/%d amostras, %.1f s, %.2f Mraios/s\n", filename, pt.samples, samples, elapsed,
+                   pt.rays / elapsed / 1e6);
+        }
+    }
+
+    free(pt.radiance);
+    freeBVH(&pt.bvh);
+}
+
+#define AO_CHUNK 256
+#define AO_MAX_DISTANCE 0.5f
+
+typedef struct {
+    bvh_t bvh;
+    vec3f* normals;
+    float* ao;
+    int rays_per_vertex;
+    size_t next_vertex;
+    uint64_t rays;
+} ao_baker_t;
+
+void aoBakeJob(void* ctx, int thread_index) {
+    ao_baker_t* b = (ao_baker_t*)ctx;
+    float max_distance = g_size * AO_MAX_DISTANCE;
+    float offset = g_size * 1e-4f;
+    uint64_t rays = 0;
+    size_t begin;
+
+    while ((begin = __atomic_fetch_add(&b->next_vertex, AO_CHUNK, __ATOMIC_RELAXED)) < g_num_vertices) {
+        size_t end = begin + AO_CHUNK < g_num_vertices ? begin + AO_CHUNK : g_num_vertices;
+        for (size_t i = begin; i < end; i++) {
+            vec3f nv = b->normals[i];
+            float len = sqrtf(nv.x * nv.x + nv.y * nv.y + nv.z * nv.z);
+            if (len == 0.0f) {
+                b->ao[i] = 1.0f;
+                continue;
+            }
+            float n[3] = {nv.x / len, nv.y / len, nv.z / len};
+            float t[3], bt[3];
+            if (fabsf(n[0]) > 0.9f) {
+                t[0] = n[1]; t[1] = -n[0]; t[2] = 0.0f;
+            } else {
+                t[0] = 0.0f; t[1] = n[2]; t[2] = -n[1];
+            }
+            float tl = sqrtf(t[0] * t[0] + t[1] * t[1] + t[2] * t[2]);
+            for (int a = 0; a < 3; a++) t[a] /= tl;
+            bt[0] = n[1] * t[2] - n[2] * t[1];
+            bt[1] = n[2] * t[0] - n[0] * t[2];
+            bt[2] = n[0] * t[1] - n[1] * t[0];
+
+            const vec3f* p = &g_vertices[i];
+            float org[3] = {p->x + n[0] * offset, p->y + n[1] * offset, p->z + n[2] * offset};
+            // Semente por vertice: o resultado nao depende do numero de threads.
+            uint64_t rng = (uint64_t)i * 0x9E3779B97F4A7C15ULL + 1;
+            int open = 0;
+            for (int r = 0; r < b->rays_per_vertex; r++) {
+                float r1 = pcgFloat(&rng), r2 = pcgFloat(&rng);
+                float phi = 2.0f * (float)M_PI * r1;
+                float sr = sqrtf(r2);
+                float local[3] = {cosf(phi) * sr, sinf(phi) * sr, sqrtf(1.0f - r2)};
+                float dir[3];
+                for (int a = 0; a < 3; a++) dir[a] = t[a] * local[0] + bt[a] * local[1] + n[a] * local[2];
+                hit_t hit = {max_distance, 0.0f, 0.0f, -1};
+                if (!intersectBVH(&b->bvh, org, dir, &hit, 1)) open++;
+            }
+            rays += b->rays_per_vertex;
+            b->ao[i] = (float)open / b->rays_per_vertex;
+        }
+    }
+    __atomic_fetch_add(&b->rays, rays, __ATOMIC_RELAXED);
+}
+
+// Sidecar <obj>.ao: cabecalho com contagens, raios e mtime do .obj, seguido
+// de um float de oclusao por vertice.
+int loadAOCache(const char* path, time_t mtime, int rays_per_vertex, float* ao) {
+    FILE* file = fopen(path, "rb");
+    if (!file) return 0;
+    char magic[4];
+    uint64_t header[4];
+    int ok = fread(magic, 1, 4, file) == 4 && memcmp(magic, "AO01", 4) == 0 &&
+             fread(header, sizeof(header), 1, file) == 1 &&
+             header[0] == g_num_vertices && header[1] == g_num_faces &&
+             header[2] == (uint64_t)rays_per_vertex && header[3] == (uint64_t)mtime &&
+             fread(ao, sizeof(float), g_num_vertices, file) == g_num_vertices;
+    fclose(file);
+    return ok;
+}
+
+void saveAOCache(const char* path, time_t mtime, int rays_per_vertex, const float* ao) {
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        printf("Nao foi possivel gravar o cache de oclusao %s\n", path);
+        return;
+    }
+    uint64_t header[4] = {g_num_vertices, g_num_faces, (uint64_t)rays_per_vertex, (uint64_t)mtime};
+    fwrite("AO01", 1, 4, file);
+    fwrite(header, sizeof(header), 1, file);
+    fwrite(ao, sizeof(float), g_num_vertices, file);
+    fclose(file);
+}
+
+// Oclusao ambiente por vertice: raios com distribuicao de cosseno no
+// hemisferio da normal (media ponderada por area das faces vizinhas),
+// limitados a AO_MAX_DISTANCE do tamanho do modelo. O resultado vai para
+// g_vertex_colors e e reaproveitado do sidecar enquanto o .obj nao mudar.
+void bakeAO(const char* obj_path, int rays_per_vertex) {
+    if (g_num_vertices == 0 || rays_per_vertex <= 0) return;
+
+    char cache_path[1024];
+    snprintf(cache_path, sizeof(cache_path), "%s.ao", obj_path);
+    struct stat st;
+    int cacheable = stat(obj_path, &st) == 0 && S_ISREG(st.st_mode);
+    time_t mtime = cacheable ? st.st_mtime : 0;
+
+    float* ao = (float*)malloc(g_num_vertices * sizeof(float));
+    if (cacheable && loadAOCache(cache_path, mtime, rays_per_vertex, ao)) {
+        printf("Oclusao ambiente carregada de %s\n", cache_path);
+    } else {
+        ao_baker_t b;
+        memset(&b, 0, sizeof(b));
+        b.ao = ao;
+        b.rays_per_vertex = rays_per_vertex;
+        b.normals = (vec3f*)calloc(g_num_vertices, sizeof(vec3f));
+        for (size_t i = 0; i < g_num_faces; i++) {
+            const face_t* f = &g_faces[i];
+            vec3f n = face_normal(&g_vertices[f->v[0].v_idx - 1], &g_vertices[f->v[1].v_idx - 1], &g_vertices[f->v[2].v_idx - 1]);
+            for (int k = 0; k < 3; k++) {
+                vec3f* dst = &b.normals[f->v[k].v_idx - 1];
+                dst->x += n.x; dst->y += n.y; dst->z += n.z;
+            }
+        }
+
+        buildBVH(&b.bvh, g_faces, g_num_faces);
+        double start = get_time_ms();
+        runParallel(aoBakeJob, &b);
+        double elapsed = (get_time_ms() - start) / 1000.0;
+        printf("Oclusao ambiente: %zu vertices, %d raios/vertice, BVH %.1f ms, bake %.2f s, %.2f Mraios/s\n",
+               g_num_vertices, rays_per_vertex, b.bvh.build_ms, elapsed, b.rays / elapsed / 1e6);
+
+        if (cacheable) saveAOCache(cache_path, mtime, rays_per_vertex, ao);
+        freeBVH(&b.bvh);
+        free(b.normals);
+    }
+
+    g_vertex_colors = (vec3f*)realloc(g_vertex_colors, g_num_vertices * sizeof(vec3f));
+    for (size_t i = 0; i < g_num_vertices; i++) g_vertex_colors[i] = (vec3f){ao[i], ao[i], ao[i]};
+    free(ao);
+}
+
+bvh_t g_pick_bvh;
+int g_pick_bvh_ready = 0;
+GLdouble g_pick_modelview[16];
+
+// Degraus de qualidade durante o arraste: primeiro LODs mais grosseiros,
+// depois o LOD mais grosseiro sem textura e com faces amostradas (stride 2, 4, ...).
+int maxDragLevel() {
+    int steps = g_num_lods > 1 ? g_num_lods - 1 : 0;
+    int stride_steps = 0;
+    for (int stride = 1; stride < MAX_DRAG_STRIDE; stride *= 2) stride_steps++;
+    return steps + 1 + stride_steps;
+}
+
+void updateDragLevel(double frame_ms) {
+    if (frame_ms > g_frame_budget_ms && g_drag_level < maxDragLevel()) {
+        g_drag_level++;
+    } else if (frame_ms < g_frame_budget_ms * 0.5 && g_drag_level > 0) {
+        g_drag_level--;
+    }
+}
+
+void reportStats(double frame_ms, size_t faces_drawn, double latency_ms) {
+    double now = get_time_ms();
+    g_stats.frames++;
+    g_stats.frame_ms_sum += frame_ms;
+    if (frame_ms > g_stats.frame_ms_max) g_stats.frame_ms_max = frame_ms;
+    g_stats.faces_drawn += faces_drawn;
+    if (latency_ms >= 0.0) {
+        g_stats.latency_samples++;
+        g_stats.latency_ms_sum += latency_ms;
+        if (latency_ms > g_stats.latency_ms_max) g_stats.latency_ms_max = latency_ms;
+    }
+
+    if (!g_show_stats || now - g_stats.last_report < 1000.0) return;
+
+    printf("Quadros: %d, tempo medio %.2f ms (max %.2f ms), %zu faces/quadro, nivel de arraste %d, escala %.2f",
+           g_stats.frames, g_stats.frame_ms_sum / g_stats.frames, g_stats.frame_ms_max,
+           g_stats.faces_drawn / g_stats.frames, g_drag_level, g_render_scale);
+    if (g_stats.latency_samples > 0) {
+        printf(", latencia entrada-tela %.2f ms (max %.2f ms)",
+               g_stats.latency_ms_sum / g_stats.latency_samples, g_stats.latency_ms_max);
+    }
+    if (g_accum_samples > 0) printf(", amostras acumuladas %d/%d", g_accum_count, g_accum_samples);
+    if (g_ooc.nodes) {
+        printf(", residente %.1f/%zu MB, %zu lidos, %zu descartados", g_ooc.resident_bytes / 1048576.0,
+               g_ooc.budget / 1048576, g_ooc.loads, g_ooc.evictions);
+    }
+    printf("\n");
+    memset(&g_stats, 0, sizeof(g_stats));
+    g_stats.last_report = now;
+}
+
+void resizeRenderTarget(int w, int h) {
+    if (g_fbo == 0) {
+        glGenFramebuffers(1, &g_fbo);
+        glGenRenderbuffers(1, &g_fbo_color);
+        glGenRenderbuffers(1, &g_fbo_depth);
+    }
+
+    glBindRenderbuffer(GL_RENDERBUFFER, g_fbo_color);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, w, h);
+    glBindRenderbuffer(GL_RENDERBUFFER, g_fbo_depth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, w, h);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, g_fbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, g_fbo_color);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, g_fbo_depth);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        printf("Framebuffer fora da tela incompleto, resolucao dinamica desativada\n");
+        g_target_frame_ms = 0.0f;
+        g_render_scale = 1.0f;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+// Area renderizada escala com o quadrado do fator, entao a correcao usa a
+// raiz da razao alvo/medido, amortecida para nao oscilar.
+void updateRenderScale(double frame_ms) {
+    if (frame_ms <= 0.0) return;
+    float ideal = g_render_scale * sqrtf(g_target_frame_ms / (float)frame_ms);
+    g_render_scale += (ideal - g_render_scale) * 0.3f;
+    if (g_render_scale < g_min_render_scale) g_render_scale = g_min_render_scale;
+    if (g_render_scale > 1.0f) g_render_scale = 1.0f;
+}
+
+float halton(int index, int base) {
+    float f = 1.0f, r = 0.0f;
+    while (index > 0) {
+        f /= base;
+        r += f * (index % base);
+        index /= base;
+    }
+    return r;
+}
+
+// Deslocamento em fracao de pixel aplicado antes da perspectiva, usado para
+// as amostras jitteradas do acumulo.
+void applyProjection(float jitter_x, float jitter_y) {
+    int w = g_window_width > 0 ? g_window_width : 1;
+    int h = g_window_height > 0 ? g_window_height : 1;
+
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    glTranslatef(2.0f * jitter_x / w, 2.0f * jitter_y / h, 0.0f);
+    gluPerspective(60.0, (float)w / (float)h, 0.1, g_size * 100.0);
+    glMatrixMode(GL_MODELVIEW);
+}
+
+int accumulationIdle(double now) {
+    return g_accum_samples > 0 && !g_isDragging && !g_inputPending &&
+           now - g_last_change_time >= g_accum_idle_ms;
+}
+
+void myDisplay(void) {
+    double frame_start = get_time_ms();
+
+    // Consome de uma vez todo o movimento acumulado desde o ultimo quadro.
+    g_rotateX = g_targetRotateX;
+    g_rotateY = g_targetRotateY;
+    double input_time = g_inputPending ? g_inputTime : -1.0;
+    g_inputPending = 0;
+
+    if (g_rotateX != g_accum_rotate[0] || g_rotateY != g_accum_rotate[1]) {
+        g_accum_rotate[0] = g_rotateX;
+        g_accum_rotate[1] = g_rotateY;
+        g_accum_count = 0;
+        g_last_change_time = frame_start;
+    }
+
+    int accumulate = accumulationIdle(frame_start);
+    if (accumulate && g_accum_count >= g_accum_samples) {
+        glAccum(GL_RETURN, 1.0f / g_accum_count);
+        glutSwapBuffers();
+        return;
+    }
+    if (accumulate && g_accum_count > 0) {
+        applyProjection(halton(g_accum_count, 2) - 0.5f, halton(g_accum_count, 3) - 0.5f);
+    }
+
+    int dynamic_resolution = g_target_frame_ms > 0.0f && g_fbo != 0 && !accumulate;
+    int render_width = g_window_width;
+    int render_height = g_window_height;
+    if (dynamic_resolution) {
+        render_width = (int)(g_window_width * g_render_scale + 0.5f);
+        render_height = (int)(g_window_height * g_render_scale + 0.5f);
+        if (render_width < 1) render_width = 1;
+        if (render_height < 1) render_height = 1;
+        if (g_backend == BACKEND_GL) {
+            glBindFramebuffer(GL_FRAMEBUFFER, g_fbo);
+            glViewport(0, 0, render_width, render_height);
+        }
+    }
+
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+    
+    gluLookAt(g_center[0], g_center[1], g_center[2] + g_size * 2.0, g_center[0], g_center[1], g_center[2],  0.0, 1.0, 0.0);
+    GLfloat light_pos[] = {g_center[0], g_center[1] + g_size, g_center[2] + g_size, 1.0};
+    if (!g_kiosk) glLightfv(GL_LIGHT0, GL_POSITION, light_pos);
+    
+    glRotatef(g_rotateX, 1.0f, 0.0f, 0.0f);
+    glRotatef(g_rotateY, 0.0f, 1.0f, 0.0f);
+    if (g_kiosk) {
+        GLfloat kiosk_pos[] = {g_kiosk_light[0], g_kiosk_light[1], g_kiosk_light[2], 1.0};
+        glLightfv(GL_LIGHT0, GL_POSITION, kiosk_pos);
+    }
+    glGetDoublev(GL_MODELVIEW_MATRIX, g_pick_modelview);
+    
+    int lod = selectLOD();
+    size_t stride = 1;
+    int textured = 1;
+    if (g_isDragging && g_drag_level > 0) {
+        int lod_steps = g_num_lods > 1 ? g_num_lods - 1 : 0;
+        if (g_drag_level <= lod_steps) {
+            if (lod < g_drag_level) lod = g_drag_level;
+        } else {
+            lod = lod_steps;
+            textured = 0;
+            stride = (size_t)1 << (g_drag_level - lod_steps - 1);
+        }
+    }
+
+    face_t* faces = g_faces;
+    size_t num_faces = g_num_faces;
+    if (g_num_lods > 1) {
+        faces = g_lods[lod].faces;
+        num_faces = g_lods[lod].num_faces;
+    }
+
+    // Com grupos, o nivel completo e desenhado por submesh com descarte pelo frustum.
+    size_t faces_drawn = (num_faces + stride - 1) / stride;
+    int by_submesh = g_num_submeshes > 1 && faces == g_faces;
+    if (g_ooc.nodes) {
+        faces_drawn = drawOOC(g_pick_modelview);
+    } else if (g_backend == BACKEND_SW) {
+        swRenderFaces(faces, num_faces, stride, textured, render_width, render_height);
+    } else if (g_kiosk) {
+        updateBakedLighting();
+        glDisable(GL_LIGHTING);
+        if (!textured) glDisable(GL_TEXTURE_2D);
+        const int* wedges = g_lods[g_num_lods > 1 ? lod : 0].wedges;
+        if (by_submesh) faces_drawn = drawSubmeshes(wedges, stride, textured);
+        else drawBakedFaces(faces, wedges, num_faces, stride, textured);
+        if (!textured) glEnable(GL_TEXTURE_2D);
+        glEnable(GL_LIGHTING);
+    } else {
+        if (!textured) glDisable(GL_TEXTURE_2D);
+        if (by_submesh) faces_drawn = drawSubmeshes(NULL, stride, textured);
+        else drawFaces(faces, num_faces, stride, textured);
+        if (!textured) glEnable(GL_TEXTURE_2D);
+    }
+
+    glTranslatef(-g_center[0], -g_center[1] + 1, -g_center[2]);
+
+    if (dynamic_resolution && g_backend == BACKEND_GL) {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, g_fbo);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+        glBlitFramebuffer(0, 0, render_width, render_height, 0, 0, g_window_width, g_window_height,
+                          GL_COLOR_BUFFER_BIT, GL_LINEAR);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(0, 0, g_window_width, g_window_height);
+    }
+
+    if (accumulate) {
+        glAccum(g_accum_count == 0 ? GL_LOAD : GL_ACCUM, 1.0f);
+        g_accum_count++;
+        glAccum(GL_RETURN, 1.0f / g_accum_count);
+        applyProjection(0.0f, 0.0f);
+    }
+    glutSwapBuffers();
+
+    if (g_isDragging || input_time >= 0.0 || dynamic_resolution) glFinish();
+    double frame_end = get_time_ms();
+    double frame_ms = frame_end - frame_start;
+    if (g_isDragging) updateDragLevel(frame_ms);
+    if (dynamic_resolution) updateRenderScale(frame_ms);
+    reportStats(frame_ms, faces_drawn, input_time >= 0.0 ? frame_end - input_time : -1.0);
+}
+
+void myReshape(int w, int h) {
+    glViewport(0, 0, w, h);
+    g_window_width = w;
+    g_window_height = h;
+    if (g_target_frame_ms > 0.0f && w > 0 && h > 0) resizeRenderTarget(w, h);
+    applyProjection(0.0f, 0.0f);
+
+    g_accum_count = 0;
+    g_last_change_time = get_time_ms();
+}
+
+void myKeyboard(unsigned char key, int x, int y) {
+    if (key == 'b' || key == 'B') {
+        g_backend = g_backend == BACKEND_GL ? BACKEND_SW : BACKEND_GL;
+        printf("Backend: %s\n", g_backend == BACKEND_GL ? "OpenGL" : "software");
+        if (g_backend == BACKEND_SW && !g_keep_images) printf("Texturas so na GPU; o backend em software desenha sem elas (use -backend sw)\n");
+        g_accum_count = 0;
+        glutPostRedisplay();
+    } else if (g_kiosk && (key == 'l' || key == 'L')) {
+        // Gira a luz 15 graus em torno do eixo Y do modelo; a iluminacao e refeita no proximo quadro.
+        float angle = (key == 'l' ? 15.0f : -15.0f) * (float)M_PI / 180.0f;
+        float dx = g_kiosk_light[0] - g_center[0], dz = g_kiosk_light[2] - g_center[2];
+        g_kiosk_light[0] = g_center[0] + dx * cosf(angle) + dz * sinf(angle);
+        g_kiosk_light[2] = g_center[2] - dx * sinf(angle) + dz * cosf(angle);
+        g_accum_count = 0;
+        glutPostRedisplay();
+    }
+}
+
+// Desprojeta o cursor com as matrizes do ultimo quadro desenhado e lanca o
+// raio (no espaco do modelo) contra a BVH, construida no primeiro clique.
+void pickAt(int x, int y) {
+    if (g_num_faces == 0) return;
+    if (!g_pick_bvh_ready) {
+        buildBVH(&g_pick_bvh, g_faces, g_num_faces);
+        g_pick_bvh_ready = 1;
+        printf("BVH de selecao: %zu triangulos, %.1f ms\n", g_num_faces, g_pick_bvh.build_ms);
+    }
+
+    double start = get_time_ms();
+    GLdouble projection[16];
+    GLint viewport[4] = {0, 0, g_window_width, g_window_height};
+    glGetDoublev(GL_PROJECTION_MATRIX, projection);
+
+    GLdouble near_p[3], far_p[3];
+    double win_y = g_window_height - y - 1;
+    gluUnProject(x, win_y, 0.0, g_pick_modelview, projection, viewport, &near_p[0], &near_p[1], &near_p[2]);
+    gluUnProject(x, win_y, 1.0, g_pick_modelview, projection, viewport, &far_p[0], &far_p[1], &far_p[2]);
+
+    float org[3], dir[3];
+    float len = 0.0f;
+    for (int a = 0; a < 3; a++) {
+        org[a] = (float)near_p[a];
+        dir[a] = (float)(far_p[a] - near_p[a]);
+        len += dir[a] * dir[a];
+    }
+    len = sqrtf(len);
+    if (len == 0.0f) return;
+    for (int a = 0; a < 3; a++) dir[a] /= len;
+
+    hit_t hit = {INFINITY, 0.0f, 0.0f, -1};
+    int found = intersectBVH(&g_pick_bvh, org, dir, &hit, 0);
+    double elapsed = get_time_ms() - start;
+    if (!found) {
+        printf("Selecao: nada sob o cursor (%.3f ms)\n", elapsed);
+        return;
+    }
+
+    const face_t* f = &g_faces[hit.prim];
+    float pos[3] = {org[0] + dir[0] * hit.t, org[1] + dir[1] * hit.t, org[2] + dir[2] * hit.t};
+    float weights[3] = {1.0f - hit.u - hit.v, hit.u, hit.v};
+    int corner = 0;
+    for (int k = 1; k < 3; k++)
+        if (weights[k] > weights[corner]) corner = k;
+    int v_idx = f->v[corner].v_idx;
+    const vec3f* vp = &g_vertices[v_idx - 1];
+
+    printf("Selecao: face %d, material %s, posicao (%.6g, %.6g, %.6g), vertice %d (%.6g, %.6g, %.6g), %.3f ms\n",
+           hit.prim, f->material_id >= 0 ? g_materials[f->material_id].name : "(nenhum)",
+           pos[0], pos[1], pos[2], v_idx, vp->x, vp->y, vp->z, elapsed);
+}
+
+void myMouse(int button, int state, int x, int y) { 
+    if (button == GLUT_RIGHT_BUTTON && state == GLUT_DOWN) {
+        pickAt(x, y);
+    }
+    if (button == GLUT_LEFT_BUTTON) {
+        if (state == GLUT_DOWN) {
+            g_isDragging = 1;
+            g_lastX = x;
+            g_lastY = y;
+        } else if (state == GLUT_UP) {
+            g_isDragging = 0;
+            glutPostRedisplay();
+        }
+    }
+}
+
+void myMotion(int x, int y) { 
+    if (g_isDragging) {
+        int deltaX = x - g_lastX;
+        int deltaY = y - g_lastY;
+
+        g_targetRotateX += deltaY * 0.5f;
+        g_targetRotateY += deltaX * 0.5f;
+
+        g_lastX = x;
+        g_lastY = y;
+
+        if (!g_inputPending) {
+            g_inputPending = 1;
+            g_inputTime = get_time_ms();
+        }
+    }
+}
+
+// Redesenha no maximo uma vez por atualizacao da tela, e so se chegou
+// entrada nova desde o ultimo quadro.
+void myTimer(int value) {
+    if (g_inputPending || oocArrived() || (accumulationIdle(get_time_ms()) && g_accum_count < g_accum_samples)) {
+        glutPostRedisplay();
+    }
+    glutTimerFunc(1000 / g_refreshRate, myTimer, 0);
+}
+
+void printUsage(const char* program) {
+    printf("Uso: %s [opcoes] <arquivo.obj | .ply | .stl | .glb | .mcache | .ooc | - para stdin>\n", program);
+    printf("  -lod <niveis 2-5>       gera cadeia de LODs por quadricas\n");
+    printf("  -lod-pixel <pixels>     erro maximo na tela para escolher o LOD\n");
+    printf("  -budget <ms>            orcamento de tempo por quadro durante o arraste\n");
+    printf("  -target <ms>            resolucao dinamica para manter o tempo de quadro\n");
+    printf("  -min-scale <0-1>        escala minima da resolucao dinamica\n");
+    printf("  -accum <amostras>       supersampling progressivo com a camera parada\n");
+    printf("  -accum-idle <ms>        tempo parado antes de comecar a acumular\n");
+    printf("  -refresh <hz>           taxa maxima de redesenho\n");
+    printf("  -backend <gl|sw>        rasterizador OpenGL ou em software (tecla 'b' alterna)\n");
+    printf("  -threads <n>            threads de trabalho (padrao: numero de CPUs)\n");
+    printf("  -rotate <x> <y>         rotacao inicial em graus\n");
+    printf("  -pathtrace <saida.png>  renderiza uma imagem com path tracing, sem janela\n");
+    printf("  -spp <n>                amostras por pixel do path tracer\n");
+    printf("  -progress <n>           grava o PNG a cada n amostras\n");
+    printf("  -size <LxA>             resolucao da imagem do path tracer\n");
+    printf("  -bench-bvh <milhoes>    mede construcao e custo SAH da BVH (ex: 1,10,50)\n");
+    printf("  -convert <saida>        grava o modelo em .obj ou no cache binario .mcache, sem janela\n");
+    printf("  -part <nome>            carrega so o grupo/objeto indicado (\"o\"/\"g\" do OBJ)\n");
+    printf("  -index                  (re)gera o indice <obj>.idx usado por -part e lista as secoes, sem janela\n");
+    printf("  -build-ooc <saida.ooc>  grava octree com LODs, sem janela (um .obj e lido em streaming e pode ser maior que a memoria)\n");
+    printf("  -ooc-budget <MB>        memoria para blocos de um .ooc (padrao 512)\n");
+    printf("  -list-parts             lista grupos e objetos com faces, caixas e materiais, sem janela\n");
+    printf("  -clean                  remove faces degeneradas e duplicadas ao carregar\n");
+    printf("  -clean-eps <e>          area minima de uma face, relativa ao tamanho do modelo ao quadrado\n");
+    printf("  -passes <lista>         passadas antes de gravar: weld,degen,cache (soldar, degeneradas, cache de vertices)\n");
+    printf("  -weld <epsilon>         tolerancia de soldagem do STL, de -weld-positions e da passada weld (0 = exata)\n");
+    printf("  -weld-positions         solda posicoes a ate -weld de distancia ao carregar (grade espacial paralela)\n");
+    printf("  -bench-weld <milhoes>   mede a soldagem numa malha de teste com um vertice por canto\n");
+    printf("  -base <dir>             diretorio para MTL e texturas (padrao: o do .obj; use com '-' = stdin)\n");
+    printf("  -chunk <MB>             tamanho do bloco de leitura de pipes e arquivos comprimidos\n");
+    printf("  -bench-stream <obj.gz>  compara a carga em streaming com descomprimir antes\n");
+    printf("  -bench-lines <obj>      mede a separacao de linhas do tokenizador em GB/s\n");
+    printf("  -bench-faces <linhas>   compara o parser generico de faces com os especializados\n");
+    printf("  -ao <raios>             oclusao ambiente por vertice (cache em <obj>.ao)\n");
+    printf("  -bake-ao <raios>        so gera o cache de oclusao ambiente, sem janela\n");
+    printf("  -kiosk                  luz fixa no modelo, iluminacao pre-calculada por vertice (l/L gira a luz)\n");
+    printf("  -stats                  imprime estatisticas a cada segundo\n");
+    printf("  Botao direito: seleciona face/vertice sob o cursor\n");
+}
+
+// Modos sem janela nao chamam glutInit, que exige um display.
+int isOfflineMode(int argc, char** argv) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-pathtrace") == 0 || strcmp(argv[i], "-bench-bvh") == 0 ||
+            strcmp(argv[i], "-bench-faces") == 0 || strcmp(argv[i], "-bench-lines") == 0 ||
+            strcmp(argv[i], "-bench-stream") == 0 || strcmp(argv[i], "-convert") == 0 ||
+            strcmp(argv[i], "-bench-weld") == 0 || strcmp(argv[i], "-list-parts") == 0 ||
+            strcmp(argv[i], "-index") == 0 || strcmp(argv[i], "-build-ooc") == 0 ||
+            strcmp(argv[i], "-bake-ao") == 0) return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    int offline = isOfflineMode(argc, argv);
+    g_no_gl = offline;
+    if (!offline) glutInit(&argc, argv);
+    
+    const char* obj_path = NULL;
+    const char* pathtrace_output = NULL;
+    const char* bench_bvh_sizes = NULL;
+    int bench_faces = 0;
+    const char* bench_lines = NULL;
+    const char* bench_stream = NULL;
+    const char* convert_output = NULL;
+    double bench_weld = 0.0;
+    int list_parts = 0;
+    int index_only = 0;
+    const char* ooc_output = NULL;
+    const char* passes = NULL;
+    int image_width = 1000, image_height = 900;
+    int samples = 64, progress_every = 8;
+    int ao_rays = 0, bake_only = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-lod") == 0 && i + 1 < argc) {
+            g_lod_levels = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-lod-pixel") == 0 && i + 1 < argc) {
+            g_lod_pixel_error = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-budget") == 0 && i + 1 < argc) {
+            g_frame_budget_ms = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-target") == 0 && i + 1 < argc) {
+            g_target_frame_ms = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-min-scale") == 0 && i + 1 < argc) {
+            g_min_render_scale = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-accum") == 0 && i + 1 < argc) {
+            g_accum_samples = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-accum-idle") == 0 && i + 1 < argc) {
+            g_accum_idle_ms = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-refresh") == 0 && i + 1 < argc) {
+            g_refreshRate = atoi(argv[++i]);
+            if (g_refreshRate < 1) g_refreshRate = 60;
+            if (g_refreshRate > 1000) g_refreshRate = 1000;
+        } else if (strcmp(argv[i], "-backend") == 0 && i + 1 < argc) {
+            g_backend = strcmp(argv[++i], "sw") == 0 ? BACKEND_SW : BACKEND_GL;
+        } else if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc) {
+            g_num_threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-kiosk") == 0) {
+            g_kiosk = 1;
+        } else if (strcmp(argv[i], "-stats") == 0) {
+            g_show_stats = 1;
+        } else if (strcmp(argv[i], "-rotate") == 0 && i + 2 < argc) {
+            g_rotateX = g_targetRotateX = atof(argv[++i]);
+            g_rotateY = g_targetRotateY = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-pathtrace") == 0 && i + 1 < argc) {
+            pathtrace_output = argv[++i];
+        } else if (strcmp(argv[i], "-bench-bvh") == 0 && i + 1 < argc) {
+            bench_bvh_sizes = argv[++i];
+        } else if (strcmp(argv[i], "-convert") == 0 && i + 1 < argc) {
+            convert_output = argv[++i];
+        } else if (strcmp(argv[i], "-part") == 0 && i + 1 < argc) {
+            g_part_filter = argv[++i];
+        } else if (strcmp(argv[i], "-list-parts") == 0) {
+            list_parts = 1;
+        } else if (strcmp(argv[i], "-build-ooc") == 0 && i + 1 < argc) {
+            ooc_output = argv[++i];
+        } else if (strcmp(argv[i], "-ooc-budget") == 0 && i + 1 < argc) {
+            g_ooc_budget_mb = (size_t)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-index") == 0) {
+            index_only = 1;
+        } else if (strcmp(argv[i], "-clean") == 0) {
+            g_clean_faces = 1;
+        } else if (strcmp(argv[i], "-clean-eps") == 0 && i + 1 < argc) {
+            g_degenerate_epsilon = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-passes") == 0 && i + 1 < argc) {
+            passes = argv[++i];
+        } else if (strcmp(argv[i], "-weld") == 0 && i + 1 < argc) {
+            g_weld_epsilon = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-weld-positions") == 0) {
+            g_weld_positions = 1;
+        } else if (strcmp(argv[i], "-bench-weld") == 0 && i + 1 < argc) {
+            bench_weld = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-base") == 0 && i + 1 < argc) {
+            g_base_dir = argv[++i];
+        } else if (strcmp(argv[i], "-chunk") == 0 && i + 1 < argc) {
+            g_stream_chunk = (size_t)(atof(argv[++i]) * 1048576.0);
+            if (g_stream_chunk < 4096) g_stream_chunk = 4096;
+        } else if (strcmp(argv[i], "-bench-stream") == 0 && i + 1 < argc) {
+            bench_stream = argv[++i];
+        } else if (strcmp(argv[i], "-bench-lines") == 0 && i + 1 < argc) {
+            bench_lines = argv[++i];
+        } else if (strcmp(argv[i], "-bench-faces") == 0 && i + 1 < argc) {
+            bench_faces = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-ao") == 0 && i + 1 < argc) {
+            ao_rays = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-bake-ao") == 0 && i + 1 < argc) {
+            ao_rays = atoi(argv[++i]);
+            bake_only = 1;
+        } else if (strcmp(argv[i], "-spp") == 0 && i + 1 < argc) {
+            samples = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-progress") == 0 && i + 1 < argc) {
+            progress_every = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-size") == 0 && i + 1 < argc) {
+            sscanf(argv[++i], "%dx%d", &image_width, &image_height);
+        } else {
+            obj_path = argv[i];
+        }
+    }
+
+    g_keep_images = g_backend == BACKEND_SW || pathtrace_output || convert_output || ooc_output;
+
+    if (bench_bvh_sizes) {
+        if (obj_path) loadMesh(obj_path);
+        benchmarkBVH(bench_bvh_sizes);
+        return 0;
+    }
+
+    if (bench_weld > 0.0) {
+        benchmarkWeld(bench_weld);
+        return 0;
+    }
+
+    if (bench_stream) {
+        benchmarkStream(bench_stream);
+        return 0;
+    }
+
+    if (bench_lines) {
+        benchmarkLineSplit(bench_lines);
+        return 0;
+    }
+
+    if (bench_faces > 0) {
+        benchmarkFaceParsers(bench_faces);
+        return 0;
+    }
+
+    if (!obj_path) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    if (index_only) {
+        indexOBJ(obj_path);
+        return 0;
+    }
+
+    if (list_parts) {
+        loadMesh(obj_path);
+        listParts();
+        return 0;
+    }
+
+    if (ooc_output) {
+        return buildOOC(obj_path, ooc_output) ? 0 : 1;
+    }
+
+    if (convert_output) {
+        return convertMesh(obj_path, convert_output, passes) ? 0 : 1;
+    }
+
+    if (bake_only) {
+        loadMesh(obj_path);
+        bakeAO(obj_path, ao_rays);
+        return 0;
+    }
+
+    if (pathtrace_output) {
+        loadMesh(obj_path);
+        renderPathTraced(pathtrace_output, image_width, image_height, samples, progress_every);
+        return 0;
+    }
+
+    glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH | (g_accum_samples > 0 ? GLUT_ACCUM : 0));
+    glutInitWindowSize(1000, 900);
+    glutInitWindowPosition(100, 100);
+    glutCreateWindow("Trabalho Computacao grafica"); 
+
+    // Um .ooc nao passa pelos arrays g_*: os blocos sao lidos sob demanda.
+    if (has_extension(obj_path, ".ooc")) {
+        if (!openOOC(obj_path)) return 1;
+    } else {
+        loadMesh(obj_path);
+    }
+    if (ao_rays > 0 && g_num_faces > 0) bakeAO(obj_path, ao_rays);
+    if (g_lod_levels > 0) buildLODs(g_lod_levels);
+    g_kiosk_light[0] = g_center[0];
+    g_kiosk_light[1] = g_center[1] + g_size;
+    g_kiosk_light[2] = g_center[2] + g_size;
+    
+    g_default_texture = createDefaultTexture();
+    for (size_t i = 0; i < g_num_materials; i++) {
+        if (g_materials[i].texture_id == 0) {
+            g_materials[i].texture_id = g_default_texture;
+        } 
+    }
+
+    if (g_accum_samples > 0) {
+        GLint accum_bits = 0;
+        glGetIntegerv(GL_ACCUM_RED_BITS, &accum_bits);
+        if (accum_bits == 0) {
+            printf("Buffer de acumulo indisponivel, supersampling progressivo desativado\n");
+            g_accum_samples = 0;
+        }
+    }
+
+    glEnable(GL_DEPTH_TEST); 
+    glEnable(GL_LIGHTING);   
+    glEnable(GL_LIGHT0);    
+    glShadeModel(GL_SMOOTH);
+    glEnable(GL_TEXTURE_2D);
+
+    GLfloat light_ambient[] = {1.0, 1.0, 1.0, 1.0};
+    GLfloat light_diffuse[] = {1.0, 1.0, 1.0, 1.0};
+    GLfloat light_specular[] = {1.0, 1.0, 1.0, 1.0};
+    glLightfv(GL_LIGHT0, GL_AMBIENT, light_ambient); 
+    glLightfv(GL_LIGHT0, GL_DIFFUSE, light_diffuse);
+    glLightfv(GL_LIGHT0, GL_SPECULAR, light_specular);
+
+    if (g_vertex_colors) {
+        // A cor do vertice vira ambiente e difuso do material (0.8 * cor); com a
+        // luz ambiente movida para o modelo (0.3) o resultado e exatamente a
+        // iluminacao original multiplicada pela cor.
+        GLfloat no_ambient[] = {0.0, 0.0, 0.0, 1.0};
+        GLfloat model_ambient[] = {0.3, 0.3, 0.3, 1.0};
+        glLightfv(GL_LIGHT0, GL_AMBIENT, no_ambient);
+        glLightModelfv(GL_LIGHT_MODEL_AMBIENT, model_ambient);
+        glColorMaterial(GL_FRONT_AND_BACK, GL_AMBIENT_AND_DIFFUSE);
+        glEnable(GL_COLOR_MATERIAL);
+    }
 
     glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
 
@@ -370,6 +7638,8 @@ int main(int argc, char** argv) {
     glutReshapeFunc(myReshape);
     glutMouseFunc(myMouse);   
     glutMotionFunc(myMotion);   
+    glutKeyboardFunc(myKeyboard);
+    glutTimerFunc(1000 / g_refreshRate, myTimer, 0);
 
     glutMainLoop();
 